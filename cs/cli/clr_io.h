@@ -37,6 +37,8 @@ namespace VW
 
         virtual bool compressed();
 
+        virtual int64_t file_offset(bool) { return -1; }
+
         virtual void flush();
 
         virtual bool close_file();
@@ -38,6 +38,8 @@ namespace VW
 
         virtual bool compressed();
 
+        virtual int64_t file_offset(bool) { return -1; }
+
         virtual bool close_file();
     };
 }
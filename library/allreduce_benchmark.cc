@@ -0,0 +1,118 @@
+// Times AllReduceSockets between processes on this machine, talking over loopback
+// through an in-process spanning tree server: the tree (reduce up, broadcast down)
+// against the ring (reduce-scatter then allgather).
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <boost/program_options.hpp>
+#include "../vowpalwabbit/allreduce.h"
+#include "../vowpalwabbit/spanning_tree.h"
+
+using namespace std;
+namespace po = boost::program_options;
+
+void add_float(float& c1, const float& c2) { c1 += c2; }
+
+// small integers, so that every order of summation gives the same floats
+float value(size_t node, size_t i) { return (float)(node + i % 13); }
+
+// run by each node: returns false if the sums are wrong
+bool run_node(size_t nodes, size_t node, size_t floats, size_t rounds, bool ring, size_t unique_id)
+{ AllReduceSockets ar("localhost", unique_id, nodes, node, ring);
+  vector<float> buffer(floats);
+  double secs = 0.;
+  bool right = true;
+  for (size_t r = 0; r <= rounds; r++) // round 0 sets up the connections
+  { for (size_t i = 0; i < floats; i++)
+      buffer[i] = value(node, i);
+    auto start = chrono::steady_clock::now();
+    ar.all_reduce<float, add_float>(buffer.data(), floats);
+    if (r > 0)
+      secs += chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    for (size_t i = 0; i < floats; i++)
+      right = right && buffer[i] == (float)(nodes * (i % 13) + nodes * (nodes - 1) / 2);
+  }
+  if (node == 0 && rounds > 0)
+    printf("%s: %10.3f ms per allreduce, %8.1f MB/s\n", ring ? "ring" : "tree",
+           1000. * secs / rounds, floats * sizeof(float) * rounds / secs / 1e6);
+  fflush(stdout);
+  return right;
+}
+
+bool run(size_t nodes, size_t floats, size_t rounds, bool ring, size_t unique_id, bool verbose)
+{ vector<pid_t> children;
+  for (size_t node = 0; node < nodes; node++)
+  { pid_t pid = fork();
+    if (pid == -1)
+    { perror("fork");
+      exit(1);
+    }
+    if (pid == 0)
+    { if (!verbose && freopen("/dev/null", "w", stderr) == nullptr)
+        perror("freopen");
+      bool right = false;
+      try
+      { right = run_node(nodes, node, floats, rounds, ring, unique_id);
+      }
+      catch (exception& e)
+      { cerr << "node " << node << ": " << e.what() << endl;
+      }
+      _exit(right ? 0 : 1); // the spanning tree object belongs to the parent
+    }
+    children.push_back(pid);
+  }
+  bool right = true;
+  for (pid_t pid : children)
+  { int status;
+    waitpid(pid, &status, 0);
+    right = right && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+  if (!right)
+    printf("%s: wrong sums!\n", ring ? "ring" : "tree");
+  return right;
+}
+
+int main(int argc, char *argv[])
+{ size_t nodes = 4;
+  size_t floats = 1 << 22;
+  size_t rounds = 10;
+
+  po::variables_map vm;
+  po::options_description desc("Allowed options");
+  desc.add_options()
+  ("help,h", "produce help message")
+  ("nodes,n", po::value<size_t>(&nodes), "number of processes (default: 4)")
+  ("floats,f", po::value<size_t>(&floats), "number of floats reduced (default: 4194304)")
+  ("rounds,r", po::value<size_t>(&rounds), "number of timed allreduces (default: 10)")
+  ("verbose,v", "show what the nodes and the spanning tree server say")
+  ;
+
+  try
+  { po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+  }
+  catch(exception & e)
+  { cout << endl << argv[0] << ": " << e.what() << endl << endl << desc << endl;
+    exit(2);
+  }
+
+  if (vm.count("help") || nodes == 0)
+  { cout << desc << endl;
+    exit(2);
+  }
+  bool verbose = vm.count("verbose") > 0;
+  if (!verbose && freopen("/dev/null", "w", stderr) == nullptr)
+    perror("freopen");
+
+  VW::SpanningTree server;
+  server.Start();
+  printf("%zu nodes, %zu floats\n", nodes, floats);
+  fflush(stdout);
+  bool right = run(nodes, floats, rounds, false, 1, verbose);
+  right = run(nodes, floats, rounds, true, 2, verbose) && right;
+  server.Stop();
+  return right ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+// Measures candidates/sec scored by a ranking service: each request brings the same
+// query features with many documents, and every query-document line is predicted.
+// "per example" reads each line into a ring example and predicts and finishes it,
+// "batch" refills examples of alloc_examples with VW::parse_example and predicts
+// them with VW::predict_batch, "batch, shared" also sums the query's terms once per
+// request.  The "predict only" lines leave parsing out.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <boost/program_options.hpp>
+#include "../vowpalwabbit/vw.h"
+
+using namespace std;
+namespace po = boost::program_options;
+
+vector<string> make_request(size_t candidates, size_t query_features, size_t document_features, unsigned& seed)
+{ stringstream query;
+  query << "|q";
+  for (size_t f = 0; f < query_features; f++)
+    query << " t" << rand_r(&seed) % 100000;
+  vector<string> lines;
+  for (size_t c = 0; c < candidates; c++)
+  { stringstream line;
+    line << query.str() << " |d";
+    for (size_t f = 0; f < document_features; f++)
+      line << " w" << rand_r(&seed) % 1000000 << ":" << (rand_r(&seed) % 100) / 100.;
+    lines.push_back(line.str());
+  }
+  return lines;
+}
+
+double seconds_since(chrono::steady_clock::time_point start)
+{ return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{ size_t requests = 200;
+  size_t candidates = 500;
+  size_t query_features = 10;
+  size_t document_features = 40;
+  string args = "-b 24 -q qd";
+
+  po::variables_map vm;
+  po::options_description desc("Allowed options");
+  desc.add_options()
+  ("help,h", "produce help message")
+  ("requests,n", po::value<size_t>(&requests), "number of requests (default: 200)")
+  ("candidates,c", po::value<size_t>(&candidates), "candidates per request (default: 500)")
+  ("query_features", po::value<size_t>(&query_features), "query features per request (default: 10)")
+  ("document_features", po::value<size_t>(&document_features), "document features per candidate (default: 40)")
+  ("vw", po::value<string>(&args), "vw arguments (default: \"-b 24 -q qd\")")
+  ;
+
+  try
+  { po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+  }
+  catch(exception & e)
+  { cout << endl << argv[0] << ": " << e.what() << endl << endl << desc << endl;
+    exit(2);
+  }
+
+  if (vm.count("help") || candidates == 0)
+  { cout << desc << endl;
+    exit(2);
+  }
+
+  vw* model = VW::initialize(args + " --quiet --no_stdin -t --random_weights 1"
+                           " --min_prediction -1000 --max_prediction 1000"); // not clipped to 0
+  vw& all = *model;
+  unsigned seed = 17;
+  vector<vector<string>> lines;
+  for (size_t r = 0; r < requests; r++)
+    lines.push_back(make_request(candidates, query_features, document_features, seed));
+
+  vector<float> expected(candidates);
+  vector<char> line;
+  double check = 0.;
+  auto start = chrono::steady_clock::now();
+  for (size_t r = 0; r < requests; r++)
+    for (size_t c = 0; c < candidates; c++)
+    { line.assign(lines[r][c].begin(), lines[r][c].end());
+      line.push_back('\0');
+      example* ec = VW::read_example(all, line.data());
+      all.l->predict(*ec);
+      expected[c] = ec->pred.scalar;
+      check += ec->pred.scalar;
+      VW::finish_example(all, ec);
+    }
+  double per_example = seconds_since(start);
+
+  example* batch = VW::alloc_examples(all.p->lp.label_size, candidates);
+  double batch_check = 0.;
+  size_t mismatches = 0;
+  start = chrono::steady_clock::now();
+  for (size_t r = 0; r < requests; r++)
+  { for (size_t c = 0; c < candidates; c++)
+    { line.assign(lines[r][c].begin(), lines[r][c].end());
+      line.push_back('\0');
+      VW::parse_example(all, batch + c, line.data());
+    }
+    VW::predict_batch(all, batch, candidates);
+    for (size_t c = 0; c < candidates; c++)
+      batch_check += batch[c].pred.scalar;
+  }
+  double batched = seconds_since(start);
+  for (size_t c = 0; c < candidates; c++) // the last request, predicted both ways
+    if (batch[c].pred.scalar != expected[c])
+      mismatches++;
+
+  double shared_check = 0.;
+  float max_difference = 0.;
+  start = chrono::steady_clock::now();
+  for (size_t r = 0; r < requests; r++)
+  { for (size_t c = 0; c < candidates; c++)
+    { line.assign(lines[r][c].begin(), lines[r][c].end());
+      line.push_back('\0');
+      VW::parse_example(all, batch + c, line.data());
+    }
+    VW::predict_batch(all, batch, candidates, true);
+    for (size_t c = 0; c < candidates; c++)
+      shared_check += batch[c].pred.scalar;
+  }
+  double shared = seconds_since(start);
+  for (size_t c = 0; c < candidates; c++)
+    max_difference = max(max_difference, fabsf(batch[c].pred.scalar - expected[c]));
+
+  // the same examples predicted again, one by one and as a batch
+  size_t rounds = requests;
+  start = chrono::steady_clock::now();
+  for (size_t r = 0; r < rounds; r++)
+    for (size_t c = 0; c < candidates; c++)
+      all.l->predict(batch[c]);
+  double predict_loop = seconds_since(start);
+  start = chrono::steady_clock::now();
+  for (size_t r = 0; r < rounds; r++)
+    VW::predict_batch(all, batch, candidates);
+  double predict_batched = seconds_since(start);
+  start = chrono::steady_clock::now();
+  for (size_t r = 0; r < rounds; r++)
+    VW::predict_batch(all, batch, candidates, true);
+  double predict_shared = seconds_since(start);
+
+  size_t total = requests * candidates;
+  printf("per example:                %12.0f candidates/sec\n", total / per_example);
+  printf("batch:                      %12.0f candidates/sec%s\n", total / batched,
+         mismatches == 0 && check == batch_check ? "" : "  (predictions differ!)");
+  printf("batch, shared:              %12.0f candidates/sec  (largest difference %g, sum %g vs %g)\n",
+         total / shared, max_difference, shared_check, check);
+  printf("predict only, per example:  %12.0f candidates/sec\n", rounds * candidates / predict_loop);
+  printf("predict only, batch:        %12.0f candidates/sec\n", rounds * candidates / predict_batched);
+  printf("predict only, batch shared: %12.0f candidates/sec\n", rounds * candidates / predict_shared);
+
+  for (size_t c = 0; c < candidates; c++)
+    VW::dealloc_example(all.p->lp.delete_label, batch[c]);
+  free(batch);
+  VW::finish(all);
+  return 0;
+}
@@ -0,0 +1,108 @@
+// Counts the heap allocations made while generating interactions for an example
+// that has been seen before: predicting, learning and eval_count_of_generated_ft
+// must not allocate once the example's scratch space has grown.
+#include <stdio.h>
+#include <string.h>
+#include <new>
+#include "../vowpalwabbit/parser.h"
+#include "../vowpalwabbit/vw.h"
+#include "../vowpalwabbit/gd.h"
+#include "../vowpalwabbit/interactions.h"
+
+using namespace std;
+
+static bool counting = false;
+static size_t allocations = 0;
+
+#ifdef __GLIBC__
+// v_array and calloc_or_throw allocate with malloc, calloc and realloc.  Only glibc lets
+// them be replaced for the whole process while still reaching the real ones, so
+// elsewhere only operator new is counted.
+extern "C"
+{ void* __libc_malloc(size_t);
+  void* __libc_calloc(size_t, size_t);
+  void* __libc_realloc(void*, size_t);
+
+  void* malloc(size_t size)
+  { if (counting) allocations++;
+    return __libc_malloc(size);
+  }
+
+  void* calloc(size_t count, size_t size)
+  { if (counting) allocations++;
+    return __libc_calloc(count, size);
+  }
+
+  void* realloc(void* p, size_t size)
+  { if (counting) allocations++;
+    return __libc_realloc(p, size);
+  }
+}
+#define uncounted_malloc __libc_malloc
+#else
+#define uncounted_malloc malloc
+#endif
+
+// replacing the global operator new is allowed everywhere
+void* operator new(size_t size)
+{ if (counting) allocations++;
+  void* p = uncounted_malloc(size > 0 ? size : 1);
+  if (p == nullptr)
+    throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t size)
+{ return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{ free(p);
+}
+
+void operator delete[](void* p) noexcept
+{ free(p);
+}
+
+size_t count_allocations(vw& all, example& ec, const char* what, size_t rounds)
+{ allocations = 0;
+  counting = true;
+  for (size_t i = 0; i < rounds; i++)
+    if (!strcmp(what, "predict"))
+      all.l->predict(ec);
+    else if (!strcmp(what, "learn"))
+      all.l->learn(ec);
+    else if (!strcmp(what, "foreach_feature"))
+    { float p = 0.;
+      GD::foreach_feature<float, GD::vec_add>(all, ec, p);
+    }
+    else
+    { size_t new_features_cnt;
+      float new_features_value;
+      INTERACTIONS::eval_count_of_generated_ft(all, ec, new_features_cnt, new_features_value);
+    }
+  counting = false;
+  return allocations;
+}
+
+int main(int argc, char *argv[])
+{ const char* args[] =
+  { "--quiet --noconstant --no_stdin -q ab --cubic abc --interactions abcd --interactions aaab",
+    "--quiet --noconstant --no_stdin --interactions abcd --interactions aaaa --permutations --sgd"
+  };
+  const char* whats[] = { "predict", "learn", "foreach_feature", "eval_count_of_generated_ft" };
+
+  for (const char* arg : args)
+  { vw* model = VW::initialize(arg);
+    example* ec = VW::read_example(*model, (char*)"1 |a x y z w:0.5 v |b p q:2 |c r s |d t u");
+
+    for (const char* what : whats)
+      count_allocations(*model, *ec, what, 1); // let the scratch space grow
+    cout << arg << endl;
+    for (const char* what : whats)
+      cout << "  " << what << ": " << count_allocations(*model, *ec, what, 1000) << " allocations" << endl;
+
+    VW::finish_example(*model, ec);
+    VW::finish(*model);
+  }
+}
@@ -0,0 +1,171 @@
+// Measures topics/sec through the loops over topics of --lda: expdigammify on a
+// document's gamma, expdigammify_2 on a word's weights and find_cw's dot product.
+// Each of vowpalwabbit/lda_simd.h's kernel sets the cpu supports is timed, next to
+// the "precise" loops of --math-mode precise (boost's digamma, exp and inner_product).
+// The widths should give exactly the floats of the scalar kernels; the error is the
+// largest relative difference from the precise results.
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <vector>
+#include <chrono>
+#include <boost/program_options.hpp>
+#include <boost/math/special_functions/digamma.hpp>
+#include "../vowpalwabbit/lda_simd.h"
+
+using namespace std;
+namespace po = boost::program_options;
+
+const float threshold = 1.0e-10f; // lda's underflow_threshold
+
+void precise_expdigammify(float* gamma, size_t n, float threshold)
+{ float sum = boost::math::digamma(accumulate(gamma, gamma + n, 0.f));
+  for (size_t k = 0; k < n; k++)
+    gamma[k] = fmax(threshold, exp(boost::math::digamma(gamma[k]) - sum));
+}
+
+void precise_expdigammify_2(float* gamma, const float* norm, size_t n, float threshold)
+{ for (size_t k = 0; k < n; k++)
+    gamma[k] = fmax(threshold, exp(boost::math::digamma(gamma[k]) - norm[k]));
+}
+
+float precise_dot(const float* a, const float* b, size_t n) { return inner_product(a, a + n, b, 0.f); }
+
+void precise_axpy(float* y, float a, const float* x, size_t n)
+{ for (size_t k = 0; k < n; k++)
+    y[k] += a * x[k];
+}
+
+const LDA_SIMD::kernels precise = { "precise", precise_expdigammify, precise_expdigammify_2, precise_dot, precise_axpy };
+
+double seconds_since(chrono::steady_clock::time_point start)
+{ return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+struct rows // on 64 byte lines, as lda keeps u_for_w
+{ vector<float> space;
+  size_t stride;
+  float* first;
+  rows(size_t count, size_t topics) : space(count * ((topics + 15) & ~(size_t)15) + 16), stride((topics + 15) & ~(size_t)15)
+  { first = space.data();
+    while ((uintptr_t)first % 64 != 0)
+      first++;
+  }
+  float* operator[](size_t r) { return first + r * stride; }
+};
+
+struct result
+{ double seconds;
+  vector<float> out;
+};
+
+float relative_error(const vector<float>& out, const vector<float>& reference)
+{ float error = 0.f;
+  for (size_t i = 0; i < out.size(); i++)
+    error = max(error, fabs(out[i] - reference[i]) / max(fabs(reference[i]), 1e-6f));
+  return error;
+}
+
+int main(int argc, char *argv[])
+{ size_t topics = 500;
+  size_t count = 1000;
+  size_t rounds = 20;
+
+  po::variables_map vm;
+  po::options_description desc("Allowed options");
+  desc.add_options()
+  ("help,h", "produce help message")
+  ("topics,t", po::value<size_t>(&topics), "topics (default: 500)")
+  ("rows,r", po::value<size_t>(&count), "rows of topics (default: 1000)")
+  ("rounds,n", po::value<size_t>(&rounds), "times each kernel goes over the rows (default: 20)")
+  ;
+
+  try
+  { po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+  }
+  catch(exception & e)
+  { cout << endl << argv[0] << ": " << e.what() << endl << endl << desc << endl;
+    exit(2);
+  }
+
+  if (vm.count("help") || topics == 0 || count == 0 || rounds == 0)
+  { cout << desc << endl;
+    exit(2);
+  }
+
+  // gamma as lda_loop has it, a word's weights plus lda_rho, the digammas of the
+  // topic totals, and u_for_w and v as find_cw gets them
+  unsigned seed = 17;
+  rows gamma(count, topics), weights(count, topics), u(count, topics), v(count, topics), work(1, topics);
+  vector<float> norm(topics);
+  for (size_t r = 0; r < count; r++)
+    for (size_t k = 0; k < topics; k++)
+    { gamma[r][k] = 0.01f + (rand_r(&seed) % 10000) / 100.f;
+      weights[r][k] = 0.01f + (rand_r(&seed) % 100000) / 1000.f;
+      u[r][k] = (rand_r(&seed) % 10000) / 10000.f;
+      v[r][k] = (rand_r(&seed) % 10000) / 1000.f;
+    }
+  for (size_t k = 0; k < topics; k++)
+    norm[k] = boost::math::digamma(1000.f + rand_r(&seed) % 100000);
+
+  const LDA_SIMD::kernels* sets[] = { &precise, &LDA_SIMD::scalar, &LDA_SIMD::sse, &LDA_SIMD::avx2, &LDA_SIMD::avx512 };
+  vector<result> expdigammify, expdigammify_2, dot;
+  for (const LDA_SIMD::kernels* k : sets)
+  { result e, e2, d;
+    e.out.resize(count * topics);
+    e2.out.resize(count * topics);
+    d.out.resize(count);
+    if (k == &precise || LDA_SIMD::supported(*k))
+    { auto start = chrono::steady_clock::now();
+      for (size_t n = 0; n < rounds; n++)
+        for (size_t r = 0; r < count; r++)
+        { copy(gamma[r], gamma[r] + topics, work[0]);
+          k->expdigammify(work[0], topics, threshold);
+          if (n == 0)
+            copy(work[0], work[0] + topics, &e.out[r * topics]);
+        }
+      e.seconds = seconds_since(start);
+
+      start = chrono::steady_clock::now();
+      for (size_t n = 0; n < rounds; n++)
+        for (size_t r = 0; r < count; r++)
+        { copy(weights[r], weights[r] + topics, work[0]);
+          k->expdigammify_2(work[0], norm.data(), topics, threshold);
+          if (n == 0)
+            copy(work[0], work[0] + topics, &e2.out[r * topics]);
+        }
+      e2.seconds = seconds_since(start);
+
+      start = chrono::steady_clock::now();
+      for (size_t n = 0; n < rounds; n++)
+        for (size_t r = 0; r < count; r++)
+          d.out[r] = k->dot(u[r], v[(r * 7) % count], topics);
+      d.seconds = seconds_since(start);
+    }
+    expdigammify.push_back(e);
+    expdigammify_2.push_back(e2);
+    dot.push_back(d);
+  }
+
+  printf("%-10s %16s %16s %16s   (million topics/sec)\n", "", "expdigammify", "expdigammify_2", "dot");
+  double total = (double)rounds * count * topics / 1e6;
+  for (size_t i = 0; i < sizeof(sets) / sizeof(sets[0]); i++)
+  { if (i > 0 && !LDA_SIMD::supported(*sets[i]))
+    { printf("%-10s %16s\n", sets[i]->name, "not supported");
+      continue;
+    }
+    printf("%-10s %16.1f %16.1f %16.1f", sets[i]->name, total / expdigammify[i].seconds,
+           total / expdigammify_2[i].seconds, total / dot[i].seconds);
+    if (i > 0)
+      printf("   error %.2g %.2g %.2g%s", relative_error(expdigammify[i].out, expdigammify[0].out),
+             relative_error(expdigammify_2[i].out, expdigammify_2[0].out), relative_error(dot[i].out, dot[0].out),
+             expdigammify[i].out == expdigammify[1].out && expdigammify_2[i].out == expdigammify_2[1].out
+             && dot[i].out == dot[1].out ? "" : "  (differs from scalar!)");
+    printf("%s\n", sets[i] == LDA_SIMD::best ? "  <- lda uses" : "");
+  }
+  return 0;
+}
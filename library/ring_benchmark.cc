@@ -0,0 +1,224 @@
+// Measures examples/sec through the parser -> learner example ring.
+// "locked" replicates the former examples_lock/condition variable handoff,
+// "lockfree" uses the atomic handoff of vowpalwabbit/example_ring.h that parser.cc uses now.
+#include <stdio.h>
+#include "../vowpalwabbit/example_ring.h"
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <boost/program_options.hpp>
+
+using namespace std;
+namespace po = boost::program_options;
+
+struct slot
+{ bool in_use;
+  uint64_t payload;
+};
+
+struct ring
+{ size_t ring_size;
+  slot* slots;
+  uint64_t begin_parsed_examples;
+  uint64_t end_parsed_examples;
+  uint64_t used_index;
+  bool done;
+  MUTEX examples_lock;
+  CV example_available;
+  CV example_unused;
+  uint64_t parked_learners;
+  uint64_t parked_producers;
+
+  ring(size_t size) : ring_size(size), begin_parsed_examples(0), end_parsed_examples(0), used_index(0), done(false),
+    parked_learners(0), parked_producers(0)
+  { slots = new slot[ring_size]();
+    initialize_mutex(&examples_lock);
+    initialize_condition_variable(&example_available);
+    initialize_condition_variable(&example_unused);
+  }
+  ~ring()
+  { delete[] slots;
+    delete_mutex(&examples_lock);
+  }
+};
+
+struct locked
+{ static slot* get_unused(ring& r, uint64_t& position)
+  { while (true)
+    { mutex_lock(&r.examples_lock);
+      if (r.slots[r.begin_parsed_examples % r.ring_size].in_use == false)
+      { position = r.begin_parsed_examples++;
+        slot& ret = r.slots[position % r.ring_size];
+        ret.in_use = true;
+        mutex_unlock(&r.examples_lock);
+        return &ret;
+      }
+      else
+        condition_variable_wait(&r.example_unused, &r.examples_lock);
+      mutex_unlock(&r.examples_lock);
+    }
+  }
+
+  // the old ring publishes in claim order because there is a single parser thread;
+  // with several producers wait for our turn so that both rings do the same work.
+  static void publish(ring& r, uint64_t index)
+  { mutex_lock(&r.examples_lock);
+    while (r.end_parsed_examples != index)
+    { mutex_unlock(&r.examples_lock);
+      this_thread::yield();
+      mutex_lock(&r.examples_lock);
+    }
+    r.end_parsed_examples++;
+    condition_variable_signal_all(&r.example_available);
+    mutex_unlock(&r.examples_lock);
+  }
+
+  static void set_done(ring& r)
+  { mutex_lock(&r.examples_lock);
+    r.done = true;
+    condition_variable_signal_all(&r.example_available);
+    mutex_unlock(&r.examples_lock);
+  }
+
+  static slot* get(ring& r)
+  { mutex_lock(&r.examples_lock);
+    while (r.end_parsed_examples == r.used_index)
+    { if (r.done)
+      { mutex_unlock(&r.examples_lock);
+        return nullptr;
+      }
+      condition_variable_wait(&r.example_available, &r.examples_lock);
+    }
+    slot* ret = r.slots + r.used_index++ % r.ring_size;
+    mutex_unlock(&r.examples_lock);
+    return ret;
+  }
+
+  static void finish(ring& r, slot* s)
+  { mutex_lock(&r.examples_lock);
+    s->in_use = false;
+    condition_variable_signal(&r.example_unused);
+    mutex_unlock(&r.examples_lock);
+  }
+};
+
+struct lockfree
+{ static slot* get_unused(ring& r, uint64_t& position)
+  { while (true)
+    { uint64_t begin = RING::load(&r.begin_parsed_examples);
+      slot* ret = r.slots + begin % r.ring_size;
+      if (!RING::load(&ret->in_use))
+      { if (RING::compare_exchange(&r.begin_parsed_examples, begin, begin + 1))
+        { RING::store(&ret->in_use, true);
+          position = begin;
+          return ret;
+        }
+        continue;
+      }
+      ring* p = &r;
+      RING::spin_then_park([p, begin, ret] { return !RING::load(&ret->in_use) || RING::load(&p->begin_parsed_examples) != begin; },
+                           &r.examples_lock, &r.example_unused, &r.parked_producers);
+    }
+  }
+
+  static void publish(ring& r, uint64_t index)
+  { while (RING::load(&r.end_parsed_examples) != index)
+      this_thread::yield();
+    RING::fetch_add(&r.end_parsed_examples, 1);
+    RING::wake_parked(&r.examples_lock, &r.example_available, &r.parked_learners);
+  }
+
+  static void set_done(ring& r)
+  { RING::store(&r.done, true);
+    RING::wake_parked(&r.examples_lock, &r.example_available, &r.parked_learners);
+  }
+
+  static slot* get(ring& r)
+  { ring* p = &r;
+    while (true)
+    { bool done = RING::load(&r.done);
+      if (RING::load(&r.end_parsed_examples) != r.used_index)
+        return r.slots + r.used_index++ % r.ring_size;
+      if (done)
+        return nullptr;
+      RING::spin_then_park([p] { return RING::load(&p->end_parsed_examples) != p->used_index || RING::load(&p->done); },
+                           &r.examples_lock, &r.example_available, &r.parked_learners);
+    }
+  }
+
+  static void finish(ring& r, slot* s)
+  { RING::store(&s->in_use, false);
+    RING::wake_parked(&r.examples_lock, &r.example_unused, &r.parked_producers);
+  }
+};
+
+template<class R> double run(size_t examples, size_t producers, size_t ring_size, uint64_t& checksum)
+{ ring r(ring_size);
+  uint64_t next = 0;  // examples handed out to producers
+  auto start = chrono::steady_clock::now();
+
+  vector<thread> threads;
+  for (size_t t = 0; t < producers; t++)
+    threads.push_back(thread([&r, &next, examples]
+    { while (RING::fetch_add(&next, 1) < examples)
+      { uint64_t position;
+        slot* s = R::get_unused(r, position);
+        s->payload = position;
+        R::publish(r, position);
+      }
+    }));
+
+  checksum = 0;
+  for (size_t i = 0; i < examples; i++)
+  { slot* s = R::get(r);
+    if (s == nullptr)
+      break;
+    checksum += s->payload;
+    R::finish(r, s);
+  }
+  for (auto& t : threads)
+    t.join();
+  R::set_done(r);
+  if (R::get(r) != nullptr)
+    cerr << "error: example left in the ring" << endl;
+
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{ size_t examples = 10000000;
+  size_t producers = 1;
+  size_t ring_size = 1 << 8;
+
+  po::variables_map vm;
+  po::options_description desc("Allowed options");
+  desc.add_options()
+  ("help,h", "produce help message")
+  ("examples,n", po::value<size_t>(&examples), "number of examples to pass through the ring (default: 10000000)")
+  ("producers,p", po::value<size_t>(&producers), "number of producer threads (default: 1)")
+  ("ring_size,r", po::value<size_t>(&ring_size), "number of ring slots (default: 256)")
+  ;
+
+  try
+  { po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+  }
+  catch(exception & e)
+  { cout << endl << argv[0] << ": " << e.what() << endl << endl << desc << endl;
+    exit(2);
+  }
+
+  if (vm.count("help") || producers == 0 || ring_size == 0)
+  { cout << desc << endl;
+    exit(2);
+  }
+
+  uint64_t expected = examples * (examples - 1) / 2;
+  uint64_t checksum;
+  double secs = run<locked>(examples, producers, ring_size, checksum);
+  printf("locked:   %12.0f examples/sec%s\n", examples / secs, checksum == expected ? "" : "  (checksum mismatch!)");
+  secs = run<lockfree>(examples, producers, ring_size, checksum);
+  printf("lockfree: %12.0f examples/sec%s\n", examples / secs, checksum == expected ? "" : "  (checksum mismatch!)");
+  return 0;
+}
@@ -1,6 +1,7 @@
 #!/bin/bash
 # -- vw daemon test
 #
+# Any arguments are passed on to the daemon (e.g. --epoll).
 NAME='vw-daemon-test'
 
 export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
@@ -46,7 +47,7 @@ fi
 
 
 # A command (+pattern) that is unlikely to match anything but our own test
-DaemonCmd="$VW -t -i $MODEL --daemon --num_children 1 --quiet --port $PORT"
+DaemonCmd="$VW -t -i $MODEL --daemon --num_children 1 --quiet --port $PORT $*"
 # libtool may wrap vw with '.libs/lt-vw' so we need to be flexible
 # on the exact process pattern we try to kill.
 DaemonPat=`echo $DaemonCmd | sed 's/^[^ ]*vw /.*vw /'`
@@ -0,0 +1,92 @@
+#!/bin/bash
+# -- vw --sendto test: examples sent to two daemons come back with the
+#    predictions the model makes locally, in the order they were read
+#
+NAME='vw-sendto-test'
+
+export PATH="vowpalwabbit:../vowpalwabbit:${PATH}"
+# The VW under test
+VW=`which vw`
+
+MODEL=$NAME.model
+PREDREF=$NAME.predref
+PREDOUT=$NAME.predict
+TRAINSET=train-sets/0001.dat
+PORT1=54249
+PORT2=54250
+
+# -- make sure we can find vw first
+if [ -x "$VW" ]; then
+    : cool found vw at: $VW
+else
+    echo "$NAME: can not find 'vw' in $PATH - sorry"
+    exit 1
+fi
+
+# -- and pkill
+PKILL=`which pkill`
+if [ -x "$PKILL" ]; then
+    : cool found pkill at: $PKILL
+else
+    echo "$NAME: can not find 'pkill' in $PATH - sorry"
+    exit 1
+fi
+
+# Commands (+patterns) that are unlikely to match anything but our own test
+DaemonCmd1="$VW -t -i $MODEL --daemon --num_children 1 --quiet --port $PORT1"
+DaemonCmd2="$VW -t -i $MODEL --daemon --num_children 1 --quiet --port $PORT2"
+# libtool may wrap vw with '.libs/lt-vw' so we need to be flexible
+# on the exact process pattern we try to kill.
+DaemonPat1=`echo $DaemonCmd1 | sed 's/^[^ ]*vw /.*vw /'`
+DaemonPat2=`echo $DaemonCmd2 | sed 's/^[^ ]*vw /.*vw /'`
+
+stop_daemons() {
+    $PKILL -9 -f "$DaemonPat1" 2>&1 | grep -q 'no process found'
+    $PKILL -9 -f "$DaemonPat2" 2>&1 | grep -q 'no process found'
+    wait
+}
+
+# wait until a daemon listens on port $1
+wait_for_port() {
+    for i in `seq 100`; do
+        (exec 3<>/dev/tcp/localhost/$1) 2>/dev/null && return 0
+        sleep 0.1
+    done
+    echo "$NAME: no daemon on port $1"
+    stop_daemons
+    exit 1
+}
+
+cleanup() {
+    /bin/rm -f $MODEL $PREDREF $PREDOUT
+    stop_daemons
+}
+
+# -- main
+cleanup
+
+$VW -b 18 --quiet -d $TRAINSET -f $MODEL
+$VW --quiet -t -i $MODEL -d $TRAINSET -p $PREDREF
+
+$DaemonCmd1 </dev/null >/dev/null &
+$DaemonCmd2 </dev/null >/dev/null &
+wait_for_port $PORT1
+wait_for_port $PORT2
+
+$VW --quiet -d $TRAINSET --sendto localhost:$PORT1,localhost:$PORT2 --sendto_batch 8 -p $PREDOUT
+
+diff $PREDREF $PREDOUT > /dev/null
+case $? in
+    0)  echo "$NAME: OK"
+        cleanup
+        exit 0
+        ;;
+    1)  echo "$NAME FAILED: see $PREDREF vs $PREDOUT"
+        stop_daemons
+        exit 1
+        ;;
+    *)  echo "$NAME: diff failed - something is fishy"
+        stop_daemons
+        exit 2
+        ;;
+esac
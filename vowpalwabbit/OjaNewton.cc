@@ -447,7 +447,7 @@ void learn(OjaNewton& ON, base_learner& base, example& ec) {
 
 void save_load(OjaNewton& ON, io_buf& model_file, bool read, bool text) {
     vw* all = ON.all;
-    if (read) {
+    if (read && !all->seeded) {
         initialize_regressor(*all);
         ON.initialize_Z();
     }
@@ -41,9 +41,25 @@ typedef int socket_t;
 #endif
 #include "vw_exception.h"
 #include <assert.h>
+#include <errno.h>
+#include <string.h>
 
 const size_t ar_buf_size = 1<<16;
 
+// set in the node id a client sends to the spanning tree server to ask for a ring
+// instead of a tree.  Servers that do not know about rings refuse the id.
+const size_t span_ring_request = ((size_t)1) << (sizeof(size_t) * 8 - 1);
+
+inline bool socket_would_block()
+{
+#ifdef _WIN32
+  return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+  return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+}
+
+// In a ring parent is the next node and children[0] the previous one.
 struct node_socks
 { std::string current_master;
   socket_t parent;
@@ -174,9 +190,100 @@ private:
   node_socks socks;
   std::string span_server;
   size_t unique_id; //unique id for each node in the network, id == 0 means extra io.
+  bool ring; //reduce around a ring instead of up and down a tree
+  size_t ring_position; //our place in the ring, which the server orders by address
 
   void all_reduce_init();
 
+  // first byte of the ring's chunk c of a buffer of n bytes
+  size_t chunk_begin(size_t c, const size_t n, const size_t element_size)
+  { return n / element_size * c / total * element_size;
+  }
+
+  /* Reduce-scatter then allgather around the ring, each node sending and
+  ** receiving 2(total-1) chunks of n/total bytes.  The chunk sent k-th is the one
+  ** received (k-1)-th, so the whole exchange is a single stream each way: bytes
+  ** are passed on as soon as they have been added in (or copied, once the chunk
+  ** is complete), without waiting for the rest of their chunk.  Both sockets are
+  ** non-blocking, as every node sends and receives at the same time.
+  */
+  template <class T, void(*f)(T&, const T&)> void ring_all_reduce(char* buffer, const size_t n)
+  { const size_t segments = 2 * (total - 1);
+    const size_t reduce_segments = total - 1;
+    size_t sent_segment = 0, sent = 0;
+    size_t read_segment = 0, read = 0; //bytes of the segment added in or copied
+    size_t unprocessed = 0; //bytes of a partially received element
+    char read_buf[ar_buf_size + sizeof(T) - 1];
+    socket_t max_fd = (std::max)(socks.parent, socks.children[0]) + 1;
+
+    while (true)
+    { size_t send_chunk = (ring_position + 2 * total - sent_segment) % total;
+      size_t read_chunk = (ring_position + 2 * total - read_segment - 1) % total;
+      size_t send_length = chunk_begin(send_chunk + 1, n, sizeof(T)) - chunk_begin(send_chunk, n, sizeof(T));
+      size_t read_length = chunk_begin(read_chunk + 1, n, sizeof(T)) - chunk_begin(read_chunk, n, sizeof(T));
+      if (sent_segment < segments && sent == send_length)
+      { sent_segment++;
+        sent = 0;
+        continue;
+      }
+      if (read_segment < segments && read == read_length)
+      { read_segment++;
+        read = 0;
+        continue;
+      }
+      if (sent_segment == segments && read_segment == segments)
+        break;
+
+      size_t ready = 0; //bytes of the segment we may send
+      if (sent_segment < segments)
+        ready = (sent_segment == 0 || sent_segment <= read_segment) ? send_length : read;
+
+      fd_set readable, writable;
+      FD_ZERO(&readable);
+      FD_ZERO(&writable);
+      if (read_segment < segments)
+        FD_SET(socks.children[0], &readable);
+      if (sent < ready)
+        FD_SET(socks.parent, &writable);
+      if (select((int)max_fd, &readable, &writable, nullptr, nullptr) == -1)
+        THROWERRNO("select");
+
+      if (FD_ISSET(socks.parent, &writable))
+      { char* from = buffer + chunk_begin(send_chunk, n, sizeof(T)) + sent;
+        int write_size = send(socks.parent, from, (int)(std::min)(ar_buf_size, ready - sent), 0);
+        if (write_size >= 0)
+          sent += write_size;
+        else if (!socket_would_block())
+          THROWERRNO("send to next node");
+      }
+
+      if (FD_ISSET(socks.children[0], &readable))
+      { char* to = buffer + chunk_begin(read_chunk, n, sizeof(T)) + read;
+        int read_size;
+        if (read_segment < reduce_segments)
+        { size_t count = (std::min)(ar_buf_size, read_length - read - unprocessed);
+          read_size = recv(socks.children[0], read_buf + unprocessed, (int)count, 0);
+          if (read_size > 0)
+          { size_t elements = (unprocessed + read_size) / sizeof(T);
+            addbufs<T, f>((T*)to, (T*)read_buf, elements);
+            read += elements * sizeof(T);
+            unprocessed = (unprocessed + read_size) % sizeof(T);
+            memmove(read_buf, read_buf + elements * sizeof(T), unprocessed);
+          }
+        }
+        else
+        { read_size = recv(socks.children[0], to, (int)(std::min)(ar_buf_size, read_length - read), 0);
+          if (read_size > 0)
+            read += read_size;
+        }
+        if (read_size == 0)
+          THROW("previous node closed the connection");
+        if (read_size < 0 && !socket_would_block())
+          THROWERRNO("recv from previous node");
+      }
+    }
+  }
+
   template <class T> void pass_up(char* buffer, size_t left_read_pos, size_t right_read_pos, size_t& parent_sent_pos)
     { size_t my_bufsize = (std::min)(ar_buf_size, (std::min)(left_read_pos, right_read_pos) / sizeof(T) * sizeof(T) - parent_sent_pos);
 
@@ -262,8 +369,8 @@ private:
   void broadcast(char* buffer, const size_t n);
 
 public:
-  AllReduceSockets(std::string pspan_server, const size_t punique_id, size_t ptotal, const size_t pnode)
-    : AllReduce(ptotal, pnode), span_server(pspan_server), unique_id(punique_id)
+  AllReduceSockets(std::string pspan_server, const size_t punique_id, size_t ptotal, const size_t pnode, bool pring = false)
+    : AllReduce(ptotal, pnode), span_server(pspan_server), unique_id(punique_id), ring(pring), ring_position(0)
   {
   }
 
@@ -274,7 +381,11 @@ public:
   template <class T, void(*f)(T&, const T&)> void all_reduce(T* buffer, const size_t n)
   { if (span_server != socks.current_master)
       all_reduce_init();
-    reduce<T, f>((char*)buffer, n*sizeof(T));
-    broadcast((char*)buffer, n*sizeof(T));
+    if (ring)
+      ring_all_reduce<T, f>((char*)buffer, n*sizeof(T));
+    else
+    { reduce<T, f>((char*)buffer, n*sizeof(T));
+      broadcast((char*)buffer, n*sizeof(T));
+    }
   }
 };
@@ -22,6 +22,7 @@ Alekh Agarwal and John Langford, with help Olivier Chapelle.
 #include <io.h>
 #else
 #include <unistd.h>
+#include <fcntl.h>
 #include <arpa/inet.h>
 #endif
 #include <sys/timeb.h>
@@ -96,6 +97,19 @@ socket_t getsock()
   return sock;
 }
 
+void set_nonblocking(socket_t sock)
+{
+#ifdef _WIN32
+  u_long on = 1;
+  if (ioctlsocket(sock, FIONBIO, &on) != 0)
+    THROW("ioctlsocket FIONBIO: " << WSAGetLastError());
+#else
+  int flags = fcntl(sock, F_GETFL, 0);
+  if (flags == -1 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) == -1)
+    THROWERRNO("fcntl O_NONBLOCK");
+#endif
+}
+
 void AllReduceSockets::all_reduce_init()
 {
 #ifdef _WIN32
@@ -123,13 +137,16 @@ void AllReduceSockets::all_reduce_init()
   if(send(master_sock, (const char*)&total, sizeof(total), 0) < (int)sizeof(total))
     cerr << "write total=" << total << " failed!" << endl;
   else cerr << "wrote total=" << total << endl;
-  if(send(master_sock, (char*)&node, sizeof(node), 0) < (int)sizeof(node))
+  size_t node_request = ring ? node | span_ring_request : node;
+  if(send(master_sock, (char*)&node_request, sizeof(node_request), 0) < (int)sizeof(node_request))
     cerr << "write node=" << node << " failed!" << endl;
-  else cerr << "wrote node=" << node << endl;
+  else cerr << "wrote node=" << node << (ring ? " (ring)" : "") << endl;
   int ok;
   if (recv(master_sock, (char*)&ok, sizeof(ok), 0) < (int)sizeof(ok))
     cerr << "read ok failed!" << endl;
   else cerr << "read ok=" << ok << endl;
+  if (!ok && ring)
+    THROW("mapper already connected, asked for another topology, or the spanning tree server is too old to set up rings");
   if (!ok)
     THROW("mapper already connected");
 
@@ -195,6 +212,12 @@ void AllReduceSockets::all_reduce_init()
     cerr << "read parent_port failed!" << endl;
   else cerr << "read parent_port=" << parent_port << endl;
 
+  if (ring)
+  { if(recv(master_sock, (char*)&ring_position, sizeof(ring_position), 0) < (int)sizeof(ring_position))
+      THROW("read ring_position failed!");
+    cerr << "read ring_position=" << ring_position << endl;
+  }
+
   CLOSESOCK(master_sock);
 
   if(parent_ip != (uint32_t)-1)
@@ -220,6 +243,11 @@ void AllReduceSockets::all_reduce_init()
 
   if (kid_count > 0)
     CLOSESOCK(sock);
+
+  if (ring && total > 1)
+  { set_nonblocking(socks.parent);
+    set_nonblocking(socks.children[0]);
+  }
 }
 
 
@@ -6,6 +6,7 @@ license as described in the file LICENSE.
 #include "cache.h"
 #include "unique_sort.h"
 #include "global_data.h"
+#include "parser.h"
 
 using namespace std;
 
@@ -57,30 +58,137 @@ __attribute__((packed))
 #endif
 ;
 
-int read_cached_features(void* in, example* ec)
-{ vw* all = (vw*)in;
-  example* ae = (example*)ec;
-  ae->sorted = all->p->sorted_cache;
-  io_buf* input = all->p->input;
+// group varints: a control byte holding the length code of 4 values, then the values
+const size_t group_length[4] = { 1, 2, 4, 8 };
+const uint64_t group_mask[4] = { 0xff, 0xffff, 0xffffffff, ~(uint64_t)0 };
+const size_t max_group_size = 1 + 4 * sizeof(uint64_t);
+
+inline char* group_varint_encode(char* p, const uint64_t* v)
+{ unsigned char control = 0;
+  char* c = p + 1;
+  for (size_t k = 0; k < 4; k++)
+  { size_t code = v[k] <= group_mask[0] ? 0 : v[k] <= group_mask[1] ? 1 : v[k] <= group_mask[2] ? 2 : 3;
+    control |= code << (2 * k);
+    memcpy(c, &v[k], group_length[code]);
+    c += group_length[code];
+  }
+  *p = control;
+  return c;
+}
+
+// reads 8 bytes per value and masks: the caller makes sure max_group_size bytes are readable
+inline char* group_varint_decode(char* p, uint64_t* v)
+{ unsigned char control = *(unsigned char*)p++;
+  for (size_t k = 0; k < 4; k++)
+  { size_t code = (control >> (2 * k)) & 3;
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    v[k] = x & group_mask[code];
+    p += group_length[code];
+  }
+  return p;
+}
+
+inline char* group_varint_decode_tail(char* p, uint64_t* v)
+{ unsigned char control = *(unsigned char*)p++;
+  for (size_t k = 0; k < 4; k++)
+  { size_t code = (control >> (2 * k)) & 3;
+    v[k] = 0;
+    memcpy(&v[k], p, group_length[code]);
+    p += group_length[code];
+  }
+  return p;
+}
 
-  size_t total = all->p->lp.read_cached_label(all->sd, &ae->l, *input);
+// v1 namespaces: the run length encoded indices, each followed by its value unless that is 1 or -1
+char* read_cached_features_v1(example* ae, features& ours, char* c, char* end)
+{ uint64_t last = 0;
+
+  for (; c!= end;)
+  { feature_index i = 0;
+    c = run_len_decode(c,i);
+    feature_value v = 1.f;
+    if (i & neg_1)
+      v = -1.;
+    else if (i & general)
+    { v = ((one_float *)c)->f;
+      c += sizeof(float);
+    }
+    uint64_t diff = i >> 2;
+    int64_t s_diff = ZigZagDecode(diff);
+    if (s_diff < 0)
+      ae->sorted = false;
+    i = last + s_diff;
+    last = i;
+    ours.push_back(v,i);
+  }
+  return c;
+}
+
+// v2 namespaces: all the indices as group varints, then the values that are not 1 or -1
+char* read_cached_features_v2(example* ae, features& ours, size_t count, char* c, char* end)
+{ size_t first = ours.size();
+  if ((size_t)(ours.values.end_array - ours.values.begin()) < first + count)
+  { ours.values.resize(first + count);
+    ours.indicies.resize(first + count);
+  }
+  feature_value* values = ours.values.begin() + first;
+  feature_index* indices = ours.indicies.begin() + first;
+
+  size_t k = 0;
+  for (; k + 4 <= count && c + max_group_size <= end; k += 4)
+    c = group_varint_decode(c, indices + k);
+  uint64_t tail[4];
+  for (; k < count; k += 4)
+  { c = group_varint_decode_tail(c, tail);
+    memcpy(indices + k, tail, min(count - k, (size_t)4) * sizeof(uint64_t));
+  }
+
+  uint64_t last = 0;
+  for (k = 0; k < count; k++)
+  { uint64_t i = indices[k];
+    feature_value v = 1.f;
+    if (i & neg_1)
+      v = -1.;
+    else if (i & general)
+    { v = ((one_float *)c)->f;
+      c += sizeof(float);
+    }
+    int64_t s_diff = ZigZagDecode(i >> 2);
+    if (s_diff < 0)
+      ae->sorted = false;
+    last += s_diff;
+    indices[k] = last;
+    values[k] = v;
+    ours.sum_feat_sq += v*v;
+  }
+  ours.values.end() = values + count;
+  ours.indicies.end() = indices + count;
+  return c;
+}
+
+int read_cached_example(vw* all, io_buf& input, char format, example* ae)
+{ ae->sorted = all->p->sorted_cache;
+
+  size_t total = all->p->lp.read_cached_label(all->sd, &ae->l, input);
   if (total == 0)
     return 0;
-  if (read_cached_tag(*input,ae) == 0)
+  if (read_cached_tag(input,ae) == 0)
     return 0;
   char* c;
   unsigned char num_indices = 0;
-  if (buf_read(*input, c, sizeof(num_indices)) < sizeof(num_indices))
+  if (buf_read(input, c, sizeof(num_indices)) < sizeof(num_indices))
     return 0;
   num_indices = *(unsigned char*)c;
   c += sizeof(num_indices);
 
-  all->p->input->set(c);
+  input.set(c);
+  size_t header = format == CACHE_V1 ? sizeof(unsigned char) + sizeof(size_t) : sizeof(unsigned char) + 2 * sizeof(uint32_t);
   for (; num_indices > 0; num_indices--)
   { size_t temp;
     unsigned char index = 0;
-    if((temp = buf_read(*input,c,sizeof(index) + sizeof(size_t))) < sizeof(index) + sizeof(size_t))
-    { cerr << "truncated example! " << temp << " " << char_size + sizeof(size_t) << endl;
+    if((temp = buf_read(input,c,header)) < header)
+    { cerr << "truncated example! " << temp << " " << header << endl;
       return 0;
     }
 
@@ -88,43 +196,79 @@ int read_cached_features(void* in, example* ec)
     c+= sizeof(index);
     ae->indices.push_back((size_t)index);
     features& ours = ae->feature_space[index];
-    size_t storage = *(size_t *)c;
-    c += sizeof(size_t);
-    all->p->input->set(c);
+    size_t count = 0;
+    size_t storage;
+    if (format == CACHE_V1)
+    { storage = *(size_t *)c;
+      c += sizeof(size_t);
+    }
+    else
+    { count = *(uint32_t *)c;
+      c += sizeof(uint32_t);
+      storage = *(uint32_t *)c;
+      c += sizeof(uint32_t);
+    }
+    input.set(c);
     total += storage;
-    if (buf_read(*input,c,storage) < storage)
+    if (buf_read(input,c,storage) < storage)
     { cerr << "truncated example! wanted: " << storage << " bytes" << endl;
       return 0;
     }
 
     char *end = c+storage;
-
-    uint64_t last = 0;
-
-    for (; c!= end;)
-      { feature_index i = 0;
-        c = run_len_decode(c,i);
-        feature_value v = 1.f;
-        if (i & neg_1)
-          v = -1.;
-        else if (i & general)
-          { v = ((one_float *)c)->f;
-            c += sizeof(float);
-          }
-        uint64_t diff = i >> 2;
-        int64_t s_diff = ZigZagDecode(diff);
-        if (s_diff < 0)
-          ae->sorted = false;
-        i = last + s_diff;
-        last = i;
-        ours.push_back(v,i);
-      }
-    all->p->input->set(c);
+    if (format == CACHE_V1)
+      c = read_cached_features_v1(ae, ours, c, end);
+    else
+      c = read_cached_features_v2(ae, ours, count, c, end);
+    input.set(c);
   }
 
   return (int)total;
 }
 
+cache_view::cache_view()
+{ buffer = space;
+  files.push_back(-1); // buf_read looks at the current file when it runs out of bytes
+}
+
+cache_view::~cache_view()
+{ space = buffer;
+}
+
+void cache_view::view(char* begin, char* end)
+{ space.begin() = begin;
+  space.end() = space.end_array = end;
+  head = begin;
+  current = 0;
+}
+
+// move on to the next example of a v2 cache and read its length, stepping over block headers
+bool next_cached_example(parser* p, io_buf& input, uint32_t& length)
+{ char* c;
+  while (p->cache_examples_left == 0)
+  { if (buf_read(input, c, sizeof(uint32_t) + sizeof(uint64_t)) < sizeof(uint32_t) + sizeof(uint64_t))
+      return false;
+    uint32_t examples = *(uint32_t*)c;
+    if (examples == 0) // the end block
+      return false;
+    p->cache_examples_left = examples;
+  }
+  p->cache_examples_left--;
+  if (buf_read(input, c, sizeof(length)) < sizeof(length))
+    return false;
+  length = *(uint32_t*)c;
+  return true;
+}
+
+int read_cached_features(void* in, example* ec)
+{ vw* all = (vw*)in;
+  parser* p = all->p;
+  uint32_t length;
+  if (p->cache_format == CACHE_V2 && !next_cached_example(p, *p->input, length))
+    return 0;
+  return read_cached_example(all, *p->input, p->cache_format, ec);
+}
+
 inline uint64_t ZigZagEncode(int64_t n)
 { uint64_t ret = (n << 1) ^ (n >> 63);
   return ret;
@@ -193,3 +337,134 @@ void cache_features(io_buf& cache, example* ae, uint64_t mask)
   for (namespace_index ns : ae->indices)
     output_features(cache, ns, ae->feature_space[ns], mask);
 }
+
+void output_features_v2(io_buf& cache, unsigned char index, features& fs, uint64_t mask)
+{ char* c;
+  size_t count = fs.size();
+  size_t storage = (count + 3) / 4 * max_group_size;
+  for (feature_value f : fs.values)
+    if (f != 1. && f != -1.)
+      storage += sizeof(feature_value);
+
+  buf_write(cache, c, sizeof(index) + 2 * sizeof(uint32_t) + storage);
+  *reinterpret_cast<unsigned char*>(c) = index;
+  c += sizeof(index);
+  *(uint32_t*)c = (uint32_t)count;
+  c += sizeof(uint32_t);
+
+  char *storage_size_loc = c;
+  c += sizeof(uint32_t);
+
+  uint64_t last = 0;
+  uint64_t group[4];
+  size_t k = 0;
+  for (features::iterator& f : fs)
+  { feature_index fi = f.index() & mask;
+    int64_t s_diff = (fi - last);
+    uint64_t diff = ZigZagEncode(s_diff) << 2;
+    last = fi;
+
+    if (f.value() == 1.)
+      group[k] = diff;
+    else if (f.value() == -1.)
+      group[k] = diff | neg_1;
+    else
+      group[k] = diff | general;
+    if (++k == 4)
+    { c = group_varint_encode(c, group);
+      k = 0;
+    }
+  }
+  if (k > 0)
+  { for (; k < 4; k++)
+      group[k] = 0;
+    c = group_varint_encode(c, group);
+  }
+
+  for (feature_value f : fs.values)
+    if (f != 1. && f != -1.)
+    { memcpy(c, &f, sizeof(feature_value));
+      c += sizeof(feature_value);
+    }
+
+  cache.set(c);
+  *(uint32_t*)storage_size_loc = (uint32_t)(c - storage_size_loc - sizeof(uint32_t));
+}
+
+// the block being written to a v2 cache file
+const uint32_t block_examples = 1 << 10;
+const size_t block_bytes = 1 << 20;
+
+class block_buf : public io_buf
+{
+public:
+  // keep growing: the block is written out as a whole once it is complete
+  virtual void flush()
+  { space.end() = head; // resize keeps the values up to space.end
+    space.resize(2 * (space.end_array - space.begin()));
+    head = space.end();
+  }
+};
+
+struct cache_writer
+{ block_buf block;
+  uint32_t examples;
+};
+
+void start_cache_blocks(parser* p)
+{ cache_writer* w = new cache_writer;
+  w->examples = 0;
+  p->cache_out = w;
+}
+
+void write_block_header(io_buf& cache, uint32_t examples, uint64_t bytes)
+{ char* c;
+  buf_write(cache, c, sizeof(examples) + sizeof(bytes));
+  memcpy(c, &examples, sizeof(examples));
+  memcpy(c + sizeof(examples), &bytes, sizeof(bytes));
+}
+
+void write_cache_block(io_buf& cache, cache_writer& w)
+{ uint64_t bytes = w.block.head - w.block.space.begin();
+  write_block_header(cache, w.examples, bytes);
+  bin_write_fixed(cache, w.block.space.begin(), (size_t)bytes);
+  w.examples = 0;
+  w.block.head = w.block.space.begin();
+}
+
+void cache_example(vw& all, example* ae)
+{ cache_writer& w = *all.p->cache_out;
+  io_buf& block = w.block;
+  char* c;
+  buf_write(block, c, sizeof(uint32_t));
+  size_t start = block.head - block.space.begin();
+
+  all.p->lp.cache_label(&ae->l, block);
+  cache_tag(block, ae->tag);
+  output_byte(block, (unsigned char) ae->indices.size());
+  for (namespace_index ns : ae->indices)
+    output_features_v2(block, ns, ae->feature_space[ns], all.parse_mask);
+
+  // the block may have moved while growing
+  uint32_t length = (uint32_t)(block.head - block.space.begin() - start);
+  memcpy(block.space.begin() + start - sizeof(uint32_t), &length, sizeof(length));
+
+  if (++w.examples == block_examples || (size_t)(block.head - block.space.begin()) >= block_bytes)
+    write_cache_block(*all.p->output, w);
+}
+
+void finish_cache_blocks(parser* p)
+{ cache_writer& w = *p->cache_out;
+  if (w.examples > 0)
+    write_cache_block(*p->output, w);
+
+  write_block_header(*p->output, 0, 0);
+  free_cache_blocks(p);
+}
+
+void free_cache_blocks(parser* p)
+{ if (p->cache_out == nullptr)
+    return;
+  delete p->cache_out;
+  p->cache_out = nullptr;
+}
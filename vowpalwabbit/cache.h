@@ -8,12 +8,54 @@ license as described in the file LICENSE.
 #include "io_buf.h"
 #include "example.h"
 
+/* A cache file starts with the length of the version string, the version string,
+** a format byte and the number of bits.  The format byte is
+**
+** CACHE_V1: a plain sequence of examples.  This is also what --sendto writes to a daemon.
+** CACHE_V2: examples grouped in blocks, each prefixed with its length, so that they can
+**           be decoded in parallel:
+**             block:  uint32 examples, uint64 bytes, then each example as a uint32 length and its bytes
+**             end:    a block of 0 examples; whatever follows it is not read
+**           Within an example the feature indices of a namespace are stored as group varints
+**           followed by the values that are neither 1 nor -1.
+**           There is no index of the blocks: a v2 cache is read from its start like a v1
+**           cache, and cannot be seeked into, e.g. to sample holdout blocks.  --parse_threads
+**           splits the examples of a batch, not blocks, across its workers.
+*/
+const char CACHE_V1 = 'c';
+const char CACHE_V2 = 'b';
+
+struct vw;
+struct parser;
+
+// decodes cached examples that are already in memory
+class cache_view : public io_buf
+{
+public:
+  v_array<char> buffer; // the allocated space, put aside while viewing
+
+  cache_view();
+  virtual ~cache_view();
+
+  void view(char* begin, char* end);
+
+  virtual ssize_t fill(int) { return 0; }
+  virtual void shift() {}
+  virtual int64_t file_offset(bool) { return -1; }
+};
+
 char* run_len_decode(char *p, size_t& i);
 char* run_len_encode(char *p, size_t i);
 
 int read_cached_features(void*a, example* ec);
+int read_cached_example(vw* all, io_buf& input, char format, example* ae);
+bool next_cached_example(parser* p, io_buf& input, uint32_t& length);
 void cache_tag(io_buf& cache, v_array<char> tag);
 void cache_features(io_buf& cache, example* ae, uint64_t mask);
 void output_byte(io_buf& cache, unsigned char s);
 void output_features(io_buf& cache, unsigned char index, features& fs, uint64_t mask);
 
+void start_cache_blocks(parser* p);
+void cache_example(vw& all, example* ae);
+void finish_cache_blocks(parser* p);
+void free_cache_blocks(parser* p);
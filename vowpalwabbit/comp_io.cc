@@ -1,59 +1,805 @@
 #include "zlib.h"
 #include "comp_io.h"
+#include "example_ring.h"
+#include <algorithm>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#ifdef HAVE_LZ4
+#include <lz4frame.h>
+#ifndef LZ4F_HEADER_SIZE_MAX
+#define LZ4F_HEADER_SIZE_MAX 19
+#endif
+#endif
+
+using namespace std;
+
+const size_t comp_chunk = 1 << 16;
+
+// the bytes of a file, with room to put back what was looked at to detect its format
+struct raw_source
+{ int fd;
+  v_array<char> pending; // put back bytes, returned before the file is read again
+  size_t used;
+
+  ssize_t read(char* buf, size_t n)
+  { if (used < pending.size())
+    { n = min(n, pending.size() - used);
+      memcpy(buf, pending.begin() + used, n);
+      used += n;
+      return n;
+    }
+    return io_buf::read_file_or_socket(fd, buf, n);
+  }
+
+  // read n bytes unless the file ends first
+  size_t read_fully(char* buf, size_t n)
+  { size_t got = 0;
+    while (got < n)
+    { ssize_t r = read(buf + got, n - got);
+      if (r <= 0)
+        break;
+      got += r;
+    }
+    return got;
+  }
+
+  void unread(const char* p, size_t n)
+  { v_array<char> rest = v_init<char>();
+    push_many(rest, p, n);
+    push_many(rest, pending.begin() + used, pending.size() - used);
+    pending.delete_v();
+    pending = rest;
+    used = 0;
+  }
+
+  void clear()
+  { pending.erase();
+    used = 0;
+  }
+};
+
+bool write_fully(int fd, const char* buf, size_t n)
+{ while (n > 0)
+  { ssize_t w = io_buf::write_file_or_socket(fd, buf, n);
+    if (w <= 0)
+      return false;
+    buf += w;
+    n -= w;
+  }
+  return true;
+}
+
+struct decoder
+{ virtual ~decoder() {}
+  // returns 0 at the end of the data
+  virtual ssize_t read(raw_source& src, char* buf, size_t n) = 0;
+};
+
+struct encoder
+{ virtual ~encoder() {}
+  virtual bool write(int fd, const char* buf, size_t n) = 0;
+  virtual bool finish(int fd) = 0;
+};
+
+struct plain_decoder : decoder
+{ virtual ssize_t read(raw_source& src, char* buf, size_t n)
+  { ssize_t r = src.read(buf, n);
+    return r > 0 ? r : 0;
+  }
+};
+
+// gzip or zlib streams, any number of members one after the other
+struct gzip_decoder : decoder
+{ z_stream z;
+  v_array<char> in;
+  bool member_ended;
+  bool done;
+
+  gzip_decoder()
+  { memset(&z, 0, sizeof(z));
+    inflateInit2(&z, 15 + 32); // 32: detect the gzip or zlib header
+    in = v_init<char>();
+    in.resize(comp_chunk);
+    member_ended = false;
+    done = false;
+  }
+
+  virtual ~gzip_decoder()
+  { inflateEnd(&z);
+    in.delete_v();
+  }
+
+  virtual ssize_t read(raw_source& src, char* buf, size_t n)
+  { z.next_out = (Bytef*)buf;
+    z.avail_out = (uInt)n;
+    while (!done && z.avail_out == n)
+    { if (z.avail_in == 0)
+      { ssize_t r = src.read(in.begin(), in.end_array - in.begin());
+        if (r <= 0)
+          break;
+        z.next_in = (Bytef*)in.begin();
+        z.avail_in = (uInt)r;
+      }
+      if (member_ended)
+      { // like gzread, ignore whatever follows the last member
+        if (z.next_in[0] != 0x1f)
+        { done = true;
+          break;
+        }
+        member_ended = false;
+      }
+      int ret = inflate(&z, Z_NO_FLUSH);
+      if (ret == Z_STREAM_END)
+      { inflateReset(&z);
+        member_ended = true;
+      }
+      else if (ret != Z_OK && ret != Z_BUF_ERROR)
+      { cerr << "error: gzip data is corrupt: " << (z.msg != nullptr ? z.msg : "") << endl;
+        done = true;
+      }
+    }
+    return n - z.avail_out;
+  }
+};
+
+/* BGZF files are gzip members of at most 64KB, each announcing its size in a header
+** field, so the members can be found without inflating them.  Members are read in
+** batches; while the caller copies out of one batch, workers inflate the next one.
+*/
+const size_t bgzf_header = 18;
+const size_t bgzf_max_block = 1 << 16;
+const size_t bgzf_batch_blocks = 32;
+
+struct bgzf_block
+{ v_array<char> raw; // the whole member
+  size_t data; // start of the deflated data in raw
+  v_array<char> out;
+  bool ok;
+};
+
+struct bgzf_batch
+{ bgzf_block blocks[bgzf_batch_blocks];
+  size_t count; // blocks read into the batch
+  size_t next; // next block to hand to a worker
+  size_t pending; // blocks not inflated yet
+  size_t block; // the block being copied out
+  size_t offset;
+};
+
+struct bgzf_worker
+{ struct bgzf_decoder* d;
+#ifndef _WIN32
+  pthread_t thread;
+#else
+  HANDLE thread;
+#endif
+};
+
+// read the header of a member; false if it is not a BGZF member
+bool bgzf_header_size(const unsigned char* h, size_t n, size_t& header, size_t& size)
+{ if (n < 12 || h[0] != 0x1f || h[1] != 0x8b || h[2] != 8 || !(h[3] & 4))
+    return false;
+  size_t xlen = h[10] | (h[11] << 8);
+  if (n < 12 + xlen)
+    return false;
+  for (size_t i = 12; i + 4 <= 12 + xlen; i += 4 + (h[i + 2] | (h[i + 3] << 8)))
+    if (h[i] == 'B' && h[i + 1] == 'C' && (h[i + 2] | (h[i + 3] << 8)) == 2 && i + 6 <= 12 + xlen)
+    { header = 12 + xlen;
+      size = (h[i + 4] | (h[i + 5] << 8)) + 1;
+      return size >= header + 8;
+    }
+  return false;
+}
+
+bool inflate_block(z_stream& z, bgzf_block& k)
+{ const unsigned char* trailer = (const unsigned char*)k.raw.end() - 8;
+  uint32_t crc = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((uint32_t)trailer[3] << 24);
+  uint32_t isize = trailer[4] | (trailer[5] << 8) | (trailer[6] << 16) | ((uint32_t)trailer[7] << 24);
+  if (isize > bgzf_max_block)
+    return false;
+  k.out.erase();
+  if ((size_t)(k.out.end_array - k.out.begin()) < isize + 1)
+    k.out.resize(isize + 1);
+  inflateReset(&z);
+  z.next_in = (Bytef*)k.raw.begin() + k.data;
+  z.avail_in = (uInt)(k.raw.size() - k.data - 8);
+  z.next_out = (Bytef*)k.out.begin();
+  z.avail_out = isize + 1; // one spare byte: the member must inflate to exactly isize
+  if (inflate(&z, Z_FINISH) != Z_STREAM_END || z.avail_out != 1)
+    return false;
+  k.out.end() = k.out.begin() + isize;
+  return crc32(0, (const Bytef*)k.out.begin(), isize) == crc;
+}
+
+#ifdef _WIN32
+DWORD WINAPI bgzf_worker_loop(LPVOID in);
+#else
+void *bgzf_worker_loop(void *in);
+#endif
+
+struct bgzf_decoder : decoder
+{ raw_source* src;
+  bgzf_batch batches[2];
+  size_t current; // the batch being copied out
+  bool foreign; // a member that is not BGZF follows; rest reads from there
+  gzip_decoder* rest;
+
+  MUTEX lock;
+  CV work_available;
+  CV work_done;
+  bool stop;
+  v_array<bgzf_worker> workers;
+
+  bgzf_decoder(raw_source& s) : src(&s), current(0), foreign(false), rest(nullptr), stop(false)
+  { memset(batches, 0, sizeof(batches)); // empty v_arrays
+    initialize_mutex(&lock);
+    initialize_condition_variable(&work_available);
+    initialize_condition_variable(&work_done);
+    size_t threads = max(1u, min(std::thread::hardware_concurrency(), 8u));
+    workers = v_init<bgzf_worker>();
+    workers.resize(threads);
+    for (size_t i = 0; i < threads; i++)
+    { bgzf_worker w;
+      w.d = this;
+      workers.push_back(w);
+    }
+    for (bgzf_worker& w : workers)
+    {
+#ifndef _WIN32
+      pthread_create(&w.thread, nullptr, bgzf_worker_loop, &w);
+#else
+      w.thread = ::CreateThread(nullptr, 0, static_cast<LPTHREAD_START_ROUTINE>(bgzf_worker_loop), &w, 0L, nullptr);
+#endif
+    }
+    refill(batches[0]);
+    refill(batches[1]);
+  }
+
+  virtual ~bgzf_decoder()
+  { mutex_lock(&lock);
+    stop = true;
+    condition_variable_signal_all(&work_available);
+    mutex_unlock(&lock);
+    for (bgzf_worker& w : workers)
+    {
+#ifndef _WIN32
+      pthread_join(w.thread, nullptr);
+#else
+      ::WaitForSingleObject(w.thread, INFINITE);
+      ::CloseHandle(w.thread);
+#endif
+    }
+    workers.delete_v();
+    for (bgzf_batch& b : batches)
+      for (bgzf_block& k : b.blocks)
+      { k.raw.delete_v();
+        k.out.delete_v();
+      }
+    delete_mutex(&lock);
+    delete rest;
+  }
+
+  // read the next member into k; false at the end of the BGZF members
+  bool read_block(bgzf_block& k)
+  { unsigned char h[bgzf_header + 256];
+    size_t got = src->read_fully((char*)h, 12);
+    size_t header, size;
+    if (got == 12 && h[3] & 4)
+    { size_t xlen = h[10] | (h[11] << 8);
+      if (xlen <= sizeof(h) - 12)
+        got += src->read_fully((char*)h + 12, xlen);
+    }
+    if (!bgzf_header_size(h, got, header, size))
+    { if (got > 0)
+      { src->unread((char*)h, got);
+        foreign = true;
+      }
+      return false;
+    }
+    k.raw.erase();
+    push_many(k.raw, (char*)h, header);
+    if ((size_t)(k.raw.end_array - k.raw.begin()) < size)
+      k.raw.resize(size);
+    k.raw.end() = k.raw.begin() + header + src->read_fully(k.raw.begin() + header, size - header);
+    k.data = header;
+    k.ok = k.raw.size() == size; // else truncated
+    return true;
+  }
+
+  // read the next members into b and have them inflated
+  void refill(bgzf_batch& b)
+  { size_t count = 0;
+    while (count < bgzf_batch_blocks && !foreign && read_block(b.blocks[count]))
+      count++;
+    mutex_lock(&lock);
+    b.count = count;
+    b.next = 0;
+    b.pending = count;
+    b.block = 0;
+    b.offset = 0;
+    condition_variable_signal_all(&work_available);
+    mutex_unlock(&lock);
+  }
+
+  virtual ssize_t read(raw_source& s, char* buf, size_t n)
+  { while (true)
+    { bgzf_batch& b = batches[current];
+      mutex_lock(&lock);
+      while (b.pending > 0)
+        condition_variable_wait(&work_done, &lock);
+      mutex_unlock(&lock);
+      for (; b.block < b.count; b.block++, b.offset = 0)
+      { bgzf_block& k = b.blocks[b.block];
+        if (!k.ok)
+        { cerr << "error: gzip data is corrupt" << endl;
+          b.count = 0;
+          foreign = false;
+          return 0;
+        }
+        if (b.offset < k.out.size())
+        { size_t m = min(n, k.out.size() - b.offset);
+          memcpy(buf, k.out.begin() + b.offset, m);
+          b.offset += m;
+          return m;
+        }
+      }
+      if (b.count == 0) // both batches are empty now
+      { if (!foreign)
+          return 0;
+        if (rest == nullptr)
+          rest = new gzip_decoder;
+        return rest->read(s, buf, n);
+      }
+      refill(b);
+      current = 1 - current;
+    }
+  }
+};
+
+#ifdef _WIN32
+DWORD WINAPI bgzf_worker_loop(LPVOID in)
+#else
+void *bgzf_worker_loop(void *in)
+#endif
+{ bgzf_decoder& d = *((bgzf_worker*)in)->d;
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+  inflateInit2(&z, -15);
+  mutex_lock(&d.lock);
+  while (true)
+  { bgzf_batch* b = nullptr;
+    for (size_t i = 0; i < 2 && b == nullptr; i++) // the batch being copied out first
+    { bgzf_batch& c = d.batches[(d.current + i) % 2];
+      if (c.next < c.count)
+        b = &c;
+    }
+    if (b == nullptr)
+    { if (d.stop)
+        break;
+      condition_variable_wait(&d.work_available, &d.lock);
+      continue;
+    }
+    bgzf_block& k = b->blocks[b->next++];
+    mutex_unlock(&d.lock);
+
+    if (k.ok)
+      k.ok = inflate_block(z, k);
+
+    mutex_lock(&d.lock);
+    if (--b->pending == 0)
+      condition_variable_signal(&d.work_done);
+  }
+  mutex_unlock(&d.lock);
+  inflateEnd(&z);
+  return 0L;
+}
+
+// gzip members in BGZF layout, one per 64KB (less a little) of input
+const size_t bgzf_input_block = 0xff00;
+
+struct bgzf_encoder : encoder
+{ z_stream z;
+  v_array<char> in;
+  v_array<char> out;
+
+  bgzf_encoder()
+  { memset(&z, 0, sizeof(z));
+    deflateInit2(&z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+    in = v_init<char>();
+    in.resize(bgzf_input_block);
+    out = v_init<char>();
+    out.resize(bgzf_max_block);
+  }
+
+  virtual ~bgzf_encoder()
+  { deflateEnd(&z);
+    in.delete_v();
+    out.delete_v();
+  }
+
+  static void put32(unsigned char* p, uint32_t v)
+  { for (size_t i = 0; i < 4; i++)
+      p[i] = (unsigned char)(v >> (8 * i));
+  }
+
+  bool write_block(int fd)
+  { static const unsigned char header[bgzf_header] =
+    { 0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0, 0, 0 };
+    unsigned char* o = (unsigned char*)out.begin();
+    memcpy(o, header, bgzf_header);
+    deflateReset(&z);
+    z.next_in = (Bytef*)in.begin();
+    z.avail_in = (uInt)in.size();
+    z.next_out = o + bgzf_header;
+    z.avail_out = (uInt)(bgzf_max_block - bgzf_header - 8);
+    if (deflate(&z, Z_FINISH) != Z_STREAM_END)
+      return false;
+    size_t size = bgzf_header + z.total_out + 8;
+    o[16] = (unsigned char)((size - 1) & 0xff);
+    o[17] = (unsigned char)((size - 1) >> 8);
+    put32(o + size - 8, crc32(0, (const Bytef*)in.begin(), (uInt)in.size()));
+    put32(o + size - 4, (uint32_t)in.size());
+    in.erase();
+    return write_fully(fd, (char*)o, size);
+  }
+
+  virtual bool write(int fd, const char* buf, size_t n)
+  { while (n > 0)
+    { size_t m = min(n, bgzf_input_block - in.size());
+      push_many(in, buf, m);
+      buf += m;
+      n -= m;
+      if (in.size() == bgzf_input_block && !write_block(fd))
+        return false;
+    }
+    return true;
+  }
+
+  virtual bool finish(int fd)
+  { if (in.size() > 0 && !write_block(fd))
+      return false;
+    return write_block(fd); // an empty member marks the end of a BGZF file
+  }
+};
+
+#ifdef HAVE_ZSTD
+struct zstd_decoder : decoder
+{ ZSTD_DCtx* z;
+  v_array<char> in;
+  ZSTD_inBuffer input;
+
+  zstd_decoder()
+  { z = ZSTD_createDCtx();
+    in = v_init<char>();
+    in.resize(ZSTD_DStreamInSize());
+    input.src = in.begin();
+    input.size = input.pos = 0;
+  }
+
+  virtual ~zstd_decoder()
+  { ZSTD_freeDCtx(z);
+    in.delete_v();
+  }
+
+  virtual ssize_t read(raw_source& src, char* buf, size_t n)
+  { ZSTD_outBuffer output = { buf, n, 0 };
+    while (output.pos == 0)
+    { if (input.pos == input.size)
+      { ssize_t r = src.read(in.begin(), in.end_array - in.begin());
+        if (r <= 0)
+          break;
+        input.size = r;
+        input.pos = 0;
+      }
+      size_t ret = ZSTD_decompressStream(z, &output, &input);
+      if (ZSTD_isError(ret))
+      { cerr << "error: zstd data is corrupt: " << ZSTD_getErrorName(ret) << endl;
+        input.size = input.pos = 0;
+        break;
+      }
+    }
+    return output.pos;
+  }
+};
+
+struct zstd_encoder : encoder
+{ ZSTD_CCtx* z;
+  v_array<char> out;
+
+  zstd_encoder()
+  { z = ZSTD_createCCtx();
+    out = v_init<char>();
+    out.resize(ZSTD_CStreamOutSize());
+  }
+
+  virtual ~zstd_encoder()
+  { ZSTD_freeCCtx(z);
+    out.delete_v();
+  }
+
+  bool compress(int fd, const char* buf, size_t n, ZSTD_EndDirective mode)
+  { ZSTD_inBuffer input = { buf, n, 0 };
+    while (true)
+    { ZSTD_outBuffer output = { out.begin(), (size_t)(out.end_array - out.begin()), 0 };
+      size_t left = ZSTD_compressStream2(z, &output, &input, mode);
+      if (ZSTD_isError(left) || !write_fully(fd, out.begin(), output.pos))
+        return false;
+      if (mode == ZSTD_e_end ? left == 0 : input.pos == input.size)
+        return true;
+    }
+  }
+
+  virtual bool write(int fd, const char* buf, size_t n) { return compress(fd, buf, n, ZSTD_e_continue); }
+
+  virtual bool finish(int fd) { return compress(fd, nullptr, 0, ZSTD_e_end); }
+};
+#endif
+
+#ifdef HAVE_LZ4
+struct lz4_decoder : decoder
+{ LZ4F_dctx* z;
+  v_array<char> in;
+  size_t in_pos;
+
+  lz4_decoder()
+  { LZ4F_createDecompressionContext(&z, LZ4F_VERSION);
+    in = v_init<char>();
+    in.resize(comp_chunk);
+    in_pos = 0;
+  }
+
+  virtual ~lz4_decoder()
+  { LZ4F_freeDecompressionContext(z);
+    in.delete_v();
+  }
+
+  virtual ssize_t read(raw_source& src, char* buf, size_t n)
+  { size_t produced = 0;
+    while (produced == 0)
+    { if (in_pos == in.size())
+      { ssize_t r = src.read(in.begin(), in.end_array - in.begin());
+        if (r <= 0)
+          break;
+        in.end() = in.begin() + r;
+        in_pos = 0;
+      }
+      size_t out_size = n;
+      size_t in_size = in.size() - in_pos;
+      size_t ret = LZ4F_decompress(z, buf, &out_size, in.begin() + in_pos, &in_size, nullptr);
+      if (LZ4F_isError(ret))
+      { cerr << "error: lz4 data is corrupt: " << LZ4F_getErrorName(ret) << endl;
+        in.erase();
+        in_pos = 0;
+        break;
+      }
+      in_pos += in_size;
+      produced += out_size;
+    }
+    return produced;
+  }
+};
+
+struct lz4_encoder : encoder
+{ LZ4F_cctx* z;
+  v_array<char> out;
+  bool started;
+
+  lz4_encoder()
+  { LZ4F_createCompressionContext(&z, LZ4F_VERSION);
+    out = v_init<char>();
+    out.resize(max(LZ4F_compressBound(comp_chunk, nullptr), (size_t)LZ4F_HEADER_SIZE_MAX));
+    started = false;
+  }
+
+  virtual ~lz4_encoder()
+  { LZ4F_freeCompressionContext(z);
+    out.delete_v();
+  }
+
+  bool start(int fd)
+  { if (started)
+      return true;
+    started = true;
+    size_t n = LZ4F_compressBegin(z, out.begin(), out.end_array - out.begin(), nullptr);
+    return !LZ4F_isError(n) && write_fully(fd, out.begin(), n);
+  }
+
+  virtual bool write(int fd, const char* buf, size_t n)
+  { if (!start(fd))
+      return false;
+    while (n > 0)
+    { size_t m = min(n, comp_chunk);
+      size_t c = LZ4F_compressUpdate(z, out.begin(), out.end_array - out.begin(), buf, m, nullptr);
+      if (LZ4F_isError(c) || !write_fully(fd, out.begin(), c))
+        return false;
+      buf += m;
+      n -= m;
+    }
+    return true;
+  }
+
+  virtual bool finish(int fd)
+  { if (!start(fd))
+      return false;
+    size_t c = LZ4F_compressEnd(z, out.begin(), out.end_array - out.begin(), nullptr);
+    return !LZ4F_isError(c) && write_fully(fd, out.begin(), c);
+  }
+};
+#endif
+
+struct comp_file
+{ raw_source src;
+  bool owned; // not stdin
+  decoder* dec; // chosen at the first read
+  encoder* enc;
+};
+
+void comp_io_buf::check_codec(codec c)
+{
+#ifndef HAVE_ZSTD
+  if (c == ZSTD)
+    THROW("vw was built without zstd support");
+#endif
+#ifndef HAVE_LZ4
+  if (c == LZ4)
+    THROW("vw was built without lz4 support");
+#endif
+}
+
+decoder* detect(raw_source& src)
+{ unsigned char h[bgzf_header + 256];
+  size_t got = src.read_fully((char*)h, 4);
+  decoder* ret;
+  if (got >= 2 && h[0] == 0x1f && h[1] == 0x8b)
+  { size_t header, size;
+    if (got == 4 && h[3] & 4)
+    { got += src.read_fully((char*)h + got, 8);
+      if (got == 12 && (size_t)(h[10] | (h[11] << 8)) <= sizeof(h) - 12)
+        got += src.read_fully((char*)h + got, h[10] | (h[11] << 8));
+    }
+    src.unread((char*)h, got);
+    if (bgzf_header_size(h, got, header, size))
+      return new bgzf_decoder(src);
+    return new gzip_decoder;
+  }
+  else if (got == 4 && h[0] == 0x28 && h[1] == 0xb5 && h[2] == 0x2f && h[3] == 0xfd)
+#ifdef HAVE_ZSTD
+    ret = new zstd_decoder;
+#else
+    throw VW::vw_codec_exception(__FILE__, __LINE__, "vw was built without zstd support, cannot read zstd input");
+#endif
+  else if (got == 4 && h[0] == 0x04 && h[1] == 0x22 && h[2] == 0x4d && h[3] == 0x18)
+#ifdef HAVE_LZ4
+    ret = new lz4_decoder;
+#else
+    throw VW::vw_codec_exception(__FILE__, __LINE__, "vw was built without lz4 support, cannot read lz4 input");
+#endif
+  else
+    ret = new plain_decoder;
+  src.unread((char*)h, got);
+  return ret;
+}
+
+comp_io_buf::comp_io_buf(codec c) : write_codec(c) {}
+
+comp_io_buf::~comp_io_buf()
+{ if (ahead != nullptr)
+    end_read_ahead(); // before comp_files goes away
+  while (close_file());
+}
 
 int comp_io_buf::open_file(const char* name, bool stdin_off, int flag)
-{ gzFile fil = nullptr;
-  int ret = -1;
+{ int fd = -1;
+  bool owned = true;
+  if (ahead != nullptr)
+    stop_read_ahead(); // the reader indexes comp_files
   switch (flag)
   { case READ:
       if (*name != '\0')
-        fil = gzopen(name, "rb");
+      {
+#ifdef _WIN32
+        _sopen_s(&fd, name, _O_RDONLY|_O_BINARY|_O_SEQUENTIAL, _SH_DENYWR, 0);
+#else
+        fd = open(name, O_RDONLY|O_LARGEFILE);
+#endif
+      }
       else if (!stdin_off)
+      {
 #ifdef _WIN32
-        fil = gzdopen(_fileno(stdin), "rb");
+        fd = _fileno(stdin);
 #else
-        fil = gzdopen(fileno(stdin), "rb");
+        fd = fileno(stdin);
 #endif
-      if (fil != nullptr)
-      { gz_files.push_back(fil);
-        ret = (int)gz_files.size() - 1;
-        files.push_back(ret);
+        owned = false;
       }
       break;
 
     case WRITE:
-      fil = gzopen(name, "wb");
-      if (fil != nullptr)
-      { gz_files.push_back(fil);
-        ret = (int)gz_files.size() - 1;
-        files.push_back(ret);
-      }
+#ifdef _WIN32
+      _sopen_s(&fd, name, _O_CREAT|_O_WRONLY|_O_BINARY|_O_TRUNC, _SH_DENYWR, _S_IREAD|_S_IWRITE);
+#else
+      fd = open(name, O_CREAT|O_WRONLY|O_LARGEFILE|O_TRUNC, 0666);
+#endif
       break;
 
     default:
       std::cerr << "Unknown file operation. Something other than READ/WRITE specified" << std::endl;
   }
+  if (fd == -1)
+    return -1;
+
+  comp_file* f = new comp_file;
+  f->src.fd = fd;
+  f->src.pending = v_init<char>();
+  f->src.used = 0;
+  f->owned = owned;
+  f->dec = nullptr;
+  f->enc = nullptr;
+  if (flag == WRITE)
+    switch (write_codec)
+    {
+#ifdef HAVE_ZSTD
+      case ZSTD:
+        f->enc = new zstd_encoder;
+        break;
+#endif
+#ifdef HAVE_LZ4
+      case LZ4:
+        f->enc = new lz4_encoder;
+        break;
+#endif
+      default:
+        f->enc = new bgzf_encoder;
+    }
+  if (flag == READ && *name != '\0')
+    // here rather than at the first read, which may be on the read ahead thread,
+    // so that a codec vw was built without is reported to the caller
+    try
+    { f->dec = detect(f->src);
+    }
+    catch (...)
+    { f->src.pending.delete_v();
+      close_file_or_socket(fd);
+      delete f;
+      throw;
+    }
+  comp_files.push_back(f);
+  int ret = (int)comp_files.size() - 1;
+  files.push_back(ret);
+  if (ahead != nullptr && flag == READ && *name != '\0')
+    read_ahead_file(ret);
   return ret;
 }
 
 void comp_io_buf::reset_file(int f)
-{ gzFile fil = gz_files[f];
-  gzseek(fil, 0, SEEK_SET);
+{ if (ahead != nullptr)
+    stop_read_ahead();
+  comp_file& c = *comp_files[f];
+#ifdef _WIN32
+  _lseek(c.src.fd, 0, SEEK_SET);
+#else
+  lseek(c.src.fd, 0, SEEK_SET);
+#endif
+  c.src.clear();
+  delete c.dec;
+  c.dec = nullptr;
   space.end() = space.begin();
   head = space.begin();
 }
 
 ssize_t comp_io_buf::read_file(int f, void* buf, size_t nbytes)
-{ gzFile fil = gz_files[f];
-  int num_read = gzread(fil, buf, (unsigned int)nbytes);
-  return (num_read > 0) ? num_read : 0;
+{ comp_file& c = *comp_files[f];
+  if (c.dec == nullptr)
+    c.dec = detect(c.src);
+  return c.dec->read(c.src, (char*)buf, nbytes);
 }
 
-size_t comp_io_buf::num_files() { return gz_files.size(); }
+size_t comp_io_buf::num_files() { return comp_files.size(); }
 
 ssize_t comp_io_buf::write_file(int file, const void* buf, size_t nbytes)
-{ int num_written = gzwrite(gz_files[file], buf, (unsigned int)nbytes);
-  return (num_written > 0) ? num_written : 0;
+{ comp_file& c = *comp_files[file];
+  return c.enc->write(c.src.fd, (const char*)buf, nbytes) ? nbytes : 0;
 }
 
 bool comp_io_buf::compressed() { return true; }
@@ -65,9 +811,19 @@ void comp_io_buf::flush()
 }
 
 bool comp_io_buf::close_file()
-{ if (gz_files.size()>0)
-  { gzclose(gz_files.back());
-    gz_files.pop_back();
+{ if (comp_files.size()>0)
+  { if (ahead != nullptr)
+      stop_read_ahead((int)comp_files.size() - 1);
+    comp_file* c = comp_files.back();
+    if (c->enc != nullptr && !c->enc->finish(c->src.fd))
+      std::cerr << "error, failed to write to cache\n";
+    delete c->enc;
+    delete c->dec;
+    c->src.pending.delete_v();
+    if (c->owned)
+      close_file_or_socket(c->src.fd);
+    delete c;
+    comp_files.pop_back();
     if (files.size() > 0)
       files.pop();
     return true;
@@ -9,17 +9,26 @@ license as described in the file LICENSE.
 #include <vector>
 #include <stdio.h>
 
-#if (ZLIB_VERNUM < 0x1252)
-typedef void* gzFile;
-#else
-struct gzFile_s;
-typedef struct gzFile_s *gzFile;
-#endif
+/* Reads gzip, zstd and lz4 files, and anything else as plain bytes; the format is
+** detected from the first bytes of each file.  gzip files made of BGZF blocks (as
+** written by bgzip, and by this class) are inflated on several threads.
+** Written files use the codec given to the constructor: gzip is written as BGZF,
+** which any gzip reader understands.  zstd and lz4 are available when vw is built
+** with HAVE_ZSTD and HAVE_LZ4.
+*/
+struct comp_file;
 
 class comp_io_buf : public io_buf
 {
 public:
-  std::vector<gzFile> gz_files;
+  enum codec { GZIP, ZSTD, LZ4 };
+
+  std::vector<comp_file*> comp_files;
+  codec write_codec;
+
+  comp_io_buf(codec c = GZIP);
+
+  virtual ~comp_io_buf();
 
   virtual int open_file(const char* name, bool stdin_off, int flag = READ);
 
@@ -33,7 +42,12 @@ public:
 
   virtual bool compressed();
 
+  virtual int64_t file_offset(bool) { return -1; }
+
   virtual void flush();
 
   virtual bool close_file();
+
+  // throws unless vw was built with support for writing c
+  static void check_codec(codec c);
 };
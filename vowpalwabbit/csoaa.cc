@@ -20,6 +20,9 @@ using namespace COST_SENSITIVE;
 struct csoaa
 { uint32_t num_classes;
   polyprediction* pred;
+  polyprediction* finalized; // for multiupdate
+  float* labels;
+  vw* all; // for set_minmax
 };
 
 template<bool is_learn>
@@ -45,28 +48,83 @@ inline void inner_loop(base_learner& base, example& ec, uint32_t i, float cost,
 
 #define DO_MULTIPREDICT true
 
+// the classes of the costs scored in one multipredict sweep over [lo, hi], and learned in one
+// multiupdate: the features and their interactions are expanded once or twice rather than
+// twice per class.  Only the classes with a cost are learned, as by inner_loop.
+template<bool is_learn>
+void sweep(csoaa& c, base_learner& base, example& ec, COST_SENSITIVE::label& ld, uint32_t lo, uint32_t hi,
+           polyprediction* pred, uint32_t& prediction, float& score)
+{ uint32_t count = hi - lo + 1;
+  ec.l.simple = { FLT_MAX, 0.f, 0.f };
+  base.multipredict(ec, lo-1, count, pred, false);
+  if (is_learn)
+    for (uint32_t i = 0; i < count; i++)
+      c.labels[i] = FLT_MAX;
+
+  for (auto& cl : ld.costs)
+  { float partial_prediction = pred[cl.class_index-lo].scalar;
+    if (is_learn && cl.x != FLT_MAX)
+    { // as base.learn would predict it, with the cost seen
+      c.all->set_minmax(c.all->sd, cl.x);
+      c.finalized[cl.class_index-lo].scalar = GD::finalize_prediction(c.all->sd, partial_prediction);
+      c.labels[cl.class_index-lo] = cl.x;
+    }
+    cl.partial_prediction = partial_prediction;
+    if (partial_prediction < score || (partial_prediction == score && cl.class_index < prediction))
+    { score = partial_prediction;
+      prediction = cl.class_index;
+    }
+    add_passthrough_feature(ec, cl.class_index, partial_prediction);
+  }
+
+  if (is_learn)
+  { ec.weight = 1.f;
+    base.multiupdate(ec, lo-1, count, c.finalized, c.labels);
+  }
+}
+
+// predictions may be made on several threads at once (--search_rollout_threads), so they are
+// scored in space of their own; learning is done on one thread, in c.pred
+const uint32_t stack_classes = 256;
+
 template <bool is_learn>
 void predict_or_learn(csoaa& c, base_learner& base, example& ec)
 { //cerr << "------------- passthrough" << endl;
+  polyprediction stack_pred[is_learn ? 1 : stack_classes];
+  polyprediction* pred = is_learn ? c.pred : c.num_classes <= stack_classes ? stack_pred
+                         : calloc_or_throw<polyprediction>(c.num_classes);
   COST_SENSITIVE::label ld = ec.l.cs;
   uint32_t prediction = 1;
   float score = FLT_MAX;
   size_t pt_start = ec.passthrough ? ec.passthrough->size() : 0;
   ec.l.simple = { 0., 0., 0. };
   if (ld.costs.size() > 0)
-  { for (auto& cl : ld.costs)
-      inner_loop<is_learn>(base, ec, cl.class_index, cl.x, prediction, score, cl.partial_prediction);
+  { uint32_t lo = c.num_classes, hi = 1;
+    for (auto& cl : ld.costs)
+    { lo = min(lo, cl.class_index);
+      hi = max(hi, cl.class_index);
+    }
+    // scoring a few classes without a cost is cheaper than expanding the features for each
+    // class.  Predicting all the classes before updating them is only the same as learning
+    // them one by one with a base that updates from the predictions it is given (gd, which
+    // has multiupdate) rather than, say, one that counts the features of each prediction (nn)
+    if (DO_MULTIPREDICT && base.has_multiupdate()
+        && lo >= 1 && hi <= c.num_classes && hi - lo < 4 * ld.costs.size())
+      sweep<is_learn>(c, base, ec, ld, lo, hi, pred, prediction, score);
+    else
+      for (auto& cl : ld.costs)
+        inner_loop<is_learn>(base, ec, cl.class_index, cl.x, prediction, score, cl.partial_prediction);
     ec.partial_prediction = score;
   }
   else if (DO_MULTIPREDICT && !is_learn)
   { ec.l.simple = { FLT_MAX, 0.f, 0.f };
-    base.multipredict(ec, 0, c.num_classes, c.pred, false);
+    base.multipredict(ec, 0, c.num_classes, pred, false);
     for (uint32_t i = 1; i <= c.num_classes; i++)
-    { add_passthrough_feature(ec, i, c.pred[i-1].scalar);
-      if (c.pred[i-1].scalar < c.pred[prediction-1].scalar)
+    { add_passthrough_feature(ec, i, pred[i-1].scalar);
+      if (pred[i-1].scalar < pred[prediction-1].scalar)
         prediction = i;
     }
-    ec.partial_prediction = c.pred[prediction-1].scalar;
+    ec.partial_prediction = pred[prediction-1].scalar;
   }
   else
   { float temp;
@@ -94,6 +152,8 @@ void predict_or_learn(csoaa& c, base_learner& base, example& ec)
 
   ec.pred.multiclass = prediction;
   ec.l.cs = ld;
+  if (pred != c.pred && pred != stack_pred)
+    free(pred);
 }
 
 void finish_example(vw& all, csoaa&, example& ec)
@@ -103,6 +163,8 @@ void finish_example(vw& all, csoaa&, example& ec)
 
 void finish(csoaa& c)
 { free(c.pred);
+  free(c.finalized);
+  free(c.labels);
 }
 
 
@@ -113,6 +175,9 @@ base_learner* csoaa_setup(vw& all)
   csoaa& c = calloc_or_throw<csoaa>();
   c.num_classes = (uint32_t)all.vm["csoaa"].as<size_t>();
   c.pred = calloc_or_throw<polyprediction>(c.num_classes);
+  c.finalized = calloc_or_throw<polyprediction>(c.num_classes);
+  c.labels = calloc_or_throw<float>(c.num_classes);
+  c.all = &all;
 
   learner<csoaa>& l = init_learner(&c, setup_base(all), predict_or_learn<true>,
                                    predict_or_learn<false>, c.num_classes);
@@ -145,6 +210,10 @@ struct ldf
 
   v_array<action_scores > stored_preds;
   base_learner* base;
+
+  bool share_header; // while the actions are predicted with the header expanded once
+  float header_partial;
+  v_array<v_string> action_interactions;
 };
 
 int cmp(size_t a, size_t b)
@@ -229,6 +298,101 @@ void unsubtract_example(example *ec)
   ec->indices.decr();
 }
 
+/* The header (shared) features of a sequence are copied into each of its actions, and the
+** actions predicted one by one expanded them again each time.  When no action has a
+** namespace of the header, an action's score is instead that of the header alone, expanded
+** once, plus that of the action's own features and of the interactions with one of its
+** namespaces, which the action is predicted on with the header's features lent to it.
+** Nothing is copied then: the actions learned with csoaa_ldf borrow the header's features
+** too, one at a time, and those only predicted just count them.
+*/
+bool can_share_header(ldf& data)
+{ vw& all = *data.all;
+  if (all.audit || all.hash_inv)
+    return false;
+  bool in_header[256] = {false};
+  bool any = false;
+  for (namespace_index ns : data.ec_seq[0]->indices)
+    if (ns != constant_namespace)
+      in_header[ns] = any = true;
+  if (!any || in_header[(unsigned char)'l']) // label features are added to the actions as 'l'
+    return false;
+  for (size_t k = 1; k < data.ec_seq.size(); k++)
+    for (namespace_index ns : data.ec_seq[k]->indices)
+      if (in_header[ns])
+        return false;
+
+  data.action_interactions.erase();
+  for (v_string& i : all.interactions)
+    for (unsigned char ns : i)
+      if (!in_header[ns])
+      { data.action_interactions.push_back(i);
+        break;
+      }
+  return true;
+}
+
+// the header's features to or from each action; ns of an action is empty while it is lent
+void lend_header_features(example& header, example& ec)
+{ for (namespace_index ns : header.indices)
+    if (ns != constant_namespace)
+      std::swap(header.feature_space[ns], ec.feature_space[ns]);
+}
+
+size_t header_feature_count(example& header)
+{ size_t count = 0;
+  for (namespace_index ns : header.indices)
+    if (ns != constant_namespace)
+      count += header.feature_space[ns].size();
+  return count;
+}
+
+// lend the header's features to ec to learn, as copying them would add them
+void attach_header(example& header, example& ec)
+{ for (namespace_index ns : header.indices)
+    if (ns != constant_namespace)
+    { ec.indices.push_back(ns);
+      std::swap(header.feature_space[ns], ec.feature_space[ns]);
+      ec.total_sum_feat_sq += ec.feature_space[ns].sum_feat_sq;
+    }
+}
+
+void detach_header(example& header, example& ec)
+{ for (namespace_index* ns = header.indices.end(); ns-- != header.indices.begin();)
+    if (*ns != constant_namespace)
+    { ec.total_sum_feat_sq -= ec.feature_space[*ns].sum_feat_sq;
+      std::swap(header.feature_space[*ns], ec.feature_space[*ns]);
+      ec.indices.pop();
+    }
+}
+
+void begin_sharing_header(ldf& data, base_learner& base)
+{ example& header = *data.ec_seq[0];
+  COST_SENSITIVE::label ld = header.l.cs;
+  polyprediction pred = header.pred;
+  float partial_prediction = header.partial_prediction;
+  features constant; // only the actions' own constant features count
+  std::swap(constant, header.feature_space[constant_namespace]);
+
+  header.l.simple = { FLT_MAX, 0.f, 0.f };
+  base.predict(header);
+  data.header_partial = header.partial_prediction;
+
+  std::swap(constant, header.feature_space[constant_namespace]);
+  header.l.cs = ld;
+  header.pred = pred;
+  header.partial_prediction = partial_prediction;
+  for (size_t k = 1; k < data.ec_seq.size(); k++)
+    data.ec_seq[k]->interactions = &data.action_interactions;
+  data.share_header = true;
+}
+
+void end_sharing_header(ldf& data)
+{ for (size_t k = 1; k < data.ec_seq.size(); k++)
+    data.ec_seq[k]->interactions = nullptr;
+  data.share_header = false;
+}
+
 void make_single_prediction(ldf& data, base_learner& base, example& ec)
 { COST_SENSITIVE::label ld = ec.l.cs;
   label_data simple_label;
@@ -238,7 +402,14 @@ void make_single_prediction(ldf& data, base_learner& base, example& ec)
   LabelDict::add_example_namespace_from_memory(data.label_features, ec, ld.costs[0].class_index);
 
   ec.l.simple = simple_label;
-  base.predict(ec); // make a prediction
+  if (data.share_header)
+  { lend_header_features(*data.ec_seq[0], ec);
+    base.predict(ec);
+    lend_header_features(*data.ec_seq[0], ec);
+    ec.partial_prediction += data.header_partial;
+  }
+  else
+    base.predict(ec); // make a prediction
   ld.costs[0].partial_prediction = ec.partial_prediction;
 
   LabelDict::del_example_namespace_from_memory(data.label_features, ec, ld.costs[0].class_index);
@@ -312,7 +483,8 @@ void do_actual_learning_wap(ldf& data, base_learner& base, size_t start_K)
   }
 }
 
-void do_actual_learning_oaa(ldf& data, base_learner& base, size_t start_K)
+// header is that of the sequence if its features are not in the actions
+void do_actual_learning_oaa(ldf& data, base_learner& base, size_t start_K, example* header)
 { size_t K = data.ec_seq.size();
   float  min_cost  = FLT_MAX;
   float  max_cost  = -FLT_MAX;
@@ -350,9 +522,13 @@ void do_actual_learning_oaa(ldf& data, base_learner& base, size_t start_K)
     ec->l.simple = simple_label;
 
     // learn
+    if (header != nullptr)
+      attach_header(*header, *ec);
     LabelDict::add_example_namespace_from_memory(data.label_features, *ec, costs[0].class_index);
     base.learn(*ec);
     LabelDict::del_example_namespace_from_memory(data.label_features, *ec, costs[0].class_index);
+    if (header != nullptr)
+      detach_header(*header, *ec);
     ec->weight = old_weight;
 
     // restore original cost-sensitive label, sum of importance weights and partial_prediction
@@ -382,13 +558,21 @@ void do_actual_learning(ldf& data, base_learner& base)
   /////////////////////// add headers
   uint32_t K = (uint32_t)data.ec_seq.size();
   uint32_t start_K = 0;
+  bool share_header = false;
 
   if (ec_is_example_header(*data.ec_seq[0]))
-  { start_K = 1;
-    for (uint32_t k=1; k<K; k++)
-      LabelDict::add_example_namespaces_from_example(*data.ec_seq[k], *data.ec_seq[0]);
-  }
+    start_K = 1;
   bool isTest = check_ldf_sequence(data, start_K);
+  bool learn = is_learn && !isTest;
+  if (start_K > 0)
+  { // wap learns on differences of actions, which need the header in each
+    share_header = !(learn && data.is_wap) && can_share_header(data);
+    if (!share_header)
+      for (uint32_t k=1; k<K; k++)
+        LabelDict::add_example_namespaces_from_example(*data.ec_seq[k], *data.ec_seq[0]);
+  }
+  if (share_header)
+    begin_sharing_header(data, base);
 
   /////////////////////// do prediction
   uint32_t predicted_K = start_K;
@@ -422,10 +606,17 @@ void do_actual_learning(ldf& data, base_learner& base)
     }
   }
 
+  if (share_header)
+  { end_sharing_header(data);
+    size_t header_features = header_feature_count(*data.ec_seq[0]);
+    for (uint32_t k=1; k<K; k++)
+      data.ec_seq[k]->num_features += header_features;
+  }
+
   /////////////////////// learn
-  if (is_learn && !isTest)
+  if (learn)
     {if (data.is_wap) do_actual_learning_wap(data, base, start_K);
-      else             do_actual_learning_oaa(data, base, start_K);
+      else             do_actual_learning_oaa(data, base, start_K, share_header ? data.ec_seq[0] : nullptr);
     }
 
   if(data.rank)
@@ -447,7 +638,7 @@ void do_actual_learning(ldf& data, base_learner& base)
         data.ec_seq[k]->pred.multiclass =  0;
   }
   /////////////////////// remove header
-  if (start_K > 0)
+  if (start_K > 0 && !share_header)
     for (size_t k=1; k<K; k++)
       LabelDict::del_example_namespaces_from_example(*data.ec_seq[k], *data.ec_seq[0]);
 
@@ -683,6 +874,7 @@ void end_examples(ldf& data)
 
 void finish(ldf& data)
 { data.ec_seq.delete_v();
+  data.action_interactions.delete_v();
   LabelDict::free_label_features(data.label_features);
   data.a_s.delete_v();
   data.stored_preds.delete_v();
@@ -0,0 +1,212 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#include "event_daemon.h"
+#include "global_data.h"
+#include "parser.h"
+#include "learner.h"
+#include "vw.h"
+#include "vw_exception.h"
+#include <errno.h>
+#include <string.h>
+#ifdef __linux__
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#ifndef EPOLLEXCLUSIVE
+#define EPOLLEXCLUSIVE (1u << 28)
+#endif
+
+using namespace std;
+
+namespace
+{
+const int max_events = 64;
+const size_t read_size = 1 << 16;
+const size_t max_unsent = 1 << 20; // a client with this much output unread is not read from
+
+struct connection
+{ int fd;
+  v_array<char> buffer; // received, not yet learned
+  v_array<char> output; // predictions, [sent, end) not yet written
+  size_t sent;
+  bool done;            // the client sent all it will; close once output is written
+  uint32_t events;      // what epoll waits on for this connection
+};
+
+// move what was written to scratch since it was last drained to the end of c's output
+void drain(int scratch, connection& c)
+{ off_t n = lseek(scratch, 0, SEEK_CUR);
+  if (n <= 0)
+    return;
+  size_t at = c.output.size();
+  if ((size_t)(c.output.end_array - c.output.end()) < (size_t)n)
+    c.output.resize(at + n);
+  ssize_t got = pread(scratch, c.output.begin() + at, n, 0);
+  if (got > 0)
+    c.output.end() += got;
+  lseek(scratch, 0, SEEK_SET);
+}
+
+// learn the complete lines in c's buffer, and with last the rest too.  Their predictions
+// are written to scratch, an in-memory file that never blocks, and then gathered in c's
+// output until its socket takes them.
+void learn_lines(vw& all, int scratch, connection& c, bool last)
+{ if (last && c.buffer.size() > 0 && c.buffer.last() != '\n')
+    c.buffer.push_back('\n');
+  char* line = c.buffer.begin();
+  char* end = c.buffer.end();
+  char* nl = (char*)memchr(line, '\n', end - line);
+  if (nl == nullptr)
+    return;
+
+  all.final_prediction_sink.push_back(scratch);
+  for (; nl != nullptr; line = nl + 1, nl = (char*)memchr(line, '\n', end - line))
+  { *nl = '\0';
+    LEARNER::process_example(all, VW::read_example(all, line));
+  }
+  all.final_prediction_sink.pop();
+  drain(scratch, c);
+
+  memmove(c.buffer.begin(), line, end - line);
+  c.buffer.end() = c.buffer.begin() + (end - line);
+}
+
+// read what c sent; false if it failed
+bool receive(vw& all, int scratch, connection& c)
+{ if ((size_t)(c.buffer.end_array - c.buffer.end()) < read_size)
+    c.buffer.resize(c.buffer.size() + read_size);
+  ssize_t n = read(c.fd, c.buffer.end(), c.buffer.end_array - c.buffer.end());
+  if (n < 0)
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+  c.buffer.end() += n;
+  c.done = n == 0;
+  learn_lines(all, scratch, c, c.done);
+  return true;
+}
+
+// write as much of c's output as the socket takes; false if it failed
+bool send_output(connection& c)
+{ while (c.sent < c.output.size())
+  { ssize_t n = write(c.fd, c.output.begin() + c.sent, c.output.size() - c.sent);
+    if (n < 0)
+    { if (errno == EINTR)
+        continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    c.sent += n;
+  }
+  c.output.erase();
+  c.sent = 0;
+  return true;
+}
+
+// wait for c to be readable unless it is done or too far behind reading its output, and
+// writable while it has output left
+bool update_events(int ep, connection& c)
+{ size_t unsent = c.output.size() - c.sent;
+  uint32_t events = (c.done || unsent >= max_unsent ? 0 : EPOLLIN) | (unsent > 0 ? EPOLLOUT : 0);
+  if (events == c.events)
+    return true;
+  epoll_event ev;
+  ev.events = events;
+  ev.data.ptr = &c;
+  c.events = events;
+  return epoll_ctl(ep, EPOLL_CTL_MOD, c.fd, &ev) == 0;
+}
+
+void accept_clients(vw& all, int ep)
+{ while (true)
+  { int f = accept(all.p->bound_sock, nullptr, nullptr);
+    if (f < 0)
+    { if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED && errno != EINTR)
+        cerr << "accept: " << strerror(errno) << endl;
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      return;
+    }
+    // a client that does not read its predictions must not hold up the others
+    fcntl(f, F_SETFL, fcntl(f, F_GETFL, 0) | O_NONBLOCK);
+    connection* c = calloc_or_throw<connection>(1);
+    c->fd = f;
+    c->events = EPOLLIN;
+    epoll_event ev;
+    ev.events = c->events;
+    ev.data.ptr = c;
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, f, &ev) < 0)
+    { cerr << "epoll_ctl: " << strerror(errno) << endl;
+      close(f);
+      free(c);
+    }
+  }
+}
+
+void close_connection(int ep, connection* c)
+{ epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, nullptr);
+  close(c->fd);
+  c->buffer.delete_v();
+  c->output.delete_v();
+  free(c);
+}
+
+// serve what epoll reported for c; false once it is to be closed
+bool serve(vw& all, int ep, int scratch, connection& c, uint32_t events)
+{ if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && !c.done && !receive(all, scratch, c))
+    return false;
+  if (!send_output(c))
+    return false;
+  if (c.done && c.output.size() == 0)
+    return false;
+  return update_events(ep, c);
+}
+}
+
+void serve_daemon_connections(vw& all)
+{ int listener = all.p->bound_sock;
+  signal(SIGPIPE, SIG_IGN); // a client leaving early is only a write error
+  fcntl(listener, F_SETFL, fcntl(listener, F_GETFL, 0) | O_NONBLOCK);
+  int ep = epoll_create1(0);
+  if (ep < 0)
+    THROWERRNO("epoll_create1");
+  // every child waits on the listening socket; exclusive, a client wakes only one
+  epoll_event ev;
+  ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+  ev.data.ptr = nullptr;
+  if (epoll_ctl(ep, EPOLL_CTL_ADD, listener, &ev) < 0)
+    THROWERRNO("epoll_ctl");
+  int scratch = memfd_create("vw-predictions", 0);
+  if (scratch < 0)
+    THROWERRNO("memfd_create");
+  if (!all.quiet)
+    cerr << "serving clients with epoll" << endl;
+
+  epoll_event events[max_events];
+  while (true)
+  { int n = epoll_wait(ep, events, max_events, -1);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      THROWERRNO("epoll_wait");
+    for (int i = 0; i < n; i++)
+    { connection* c = (connection*)events[i].data.ptr;
+      if (c == nullptr)
+        accept_clients(all, ep);
+      else if (!serve(all, ep, scratch, *c, events[i].events))
+        close_connection(ep, c);
+    }
+  }
+}
+#else
+void serve_daemon_connections(vw&)
+{ THROW("--epoll is only supported on Linux");
+}
+#endif
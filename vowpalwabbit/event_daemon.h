@@ -0,0 +1,22 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#pragma once
+
+struct vw;
+
+/* With --daemon --epoll each daemon child serves all the clients it accepts from
+** one epoll loop, rather than one client at a time: a client's text examples are
+** parsed out of its own buffer as they arrive, the complete lines of each read are
+** learned or predicted in order, and their predictions are gathered in the client's
+** own output buffer.  Client sockets are non-blocking: the output is written as the
+** socket takes it, and a client that falls far behind reading it is not read from
+** until it catches up, so it never stalls the others.  The children share the weights as with --daemon.  Multiline
+** examples must reach the daemon in one piece per client, and cached (binary)
+** input is not supported.  Linux only.
+*/
+
+// serve the clients of all.p->bound_sock; never returns
+void serve_daemon_connections(vw& all);
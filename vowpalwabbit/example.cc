@@ -178,6 +178,8 @@ void dealloc_example(void(*delete_label)(void*), example&ec, void(*delete_predic
   ec.tag.delete_v();
 
   ec.topic_predictions.delete_v();
+  ec.interaction_state.delete_v();
+  ec.interaction_sums.delete_v();
   if (ec.passthrough)
   { ec.passthrough->delete_v();
     delete ec.passthrough;
@@ -48,6 +48,10 @@ typedef union
 
 typedef unsigned char namespace_index;
 
+namespace INTERACTIONS
+{ struct feature_gen_data;
+}
+
 struct example // core example datatype.
 {
   class iterator
@@ -94,6 +98,11 @@ struct example // core example datatype.
   float total_sum_feat_sq;//precomputed, cause it's kind of fast & easy.
   float confidence;
   features* passthrough; // if a higher-up reduction wants access to internal state of lower-down reductions, they go here
+  v_array<v_string>* interactions; // if a reduction generates other interactions for this example than all.interactions, they go here
+
+  // scratch space of INTERACTIONS, kept so that generating interactions does not allocate
+  v_array<INTERACTIONS::feature_gen_data> interaction_state;
+  v_array<float> interaction_sums;
 
   bool test_only;
   bool end_pass;//special example indicating end of pass.
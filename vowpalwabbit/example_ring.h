@@ -0,0 +1,90 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+// Synchronization for the example ring shared by the parser and the learner.
+// Counters and in_use flags are read and written with atomic operations; a thread
+// that has to wait spins for a while and then parks on a condition variable.
+// Wakers only take the lock when somebody is actually parked, so in steady state
+// handing over an example costs a couple of atomic instructions and no syscalls.
+
+#pragma once
+#include <stdint.h>
+#include <thread>
+#include "parse_primitives.h"
+
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+
+void initialize_mutex(MUTEX* pm);
+void delete_mutex(MUTEX* pm);
+void initialize_condition_variable(CV* pcv);
+void delete_condition_variable(CV* pcv);
+void mutex_lock(MUTEX* pm);
+void mutex_unlock(MUTEX* pm);
+void condition_variable_wait(CV* pcv, MUTEX* pm);
+void condition_variable_signal(CV* pcv);
+void condition_variable_signal_all(CV* pcv);
+
+namespace RING
+{
+// all operations are sequentially consistent; that is needed by the
+// parked/ready handshake in spin_then_park and wake_parked below.
+#ifndef _WIN32
+inline uint64_t load(uint64_t* p) { return __atomic_load_n(p, __ATOMIC_SEQ_CST); }
+inline void store(uint64_t* p, uint64_t v) { __atomic_store_n(p, v, __ATOMIC_SEQ_CST); }
+inline uint64_t fetch_add(uint64_t* p, int64_t v) { return __atomic_fetch_add(p, (uint64_t)v, __ATOMIC_SEQ_CST); }
+inline bool compare_exchange(uint64_t* p, uint64_t expected, uint64_t desired)
+{ return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST); }
+inline bool load(bool* p) { return __atomic_load_n(p, __ATOMIC_SEQ_CST); }
+inline void store(bool* p, bool v) { __atomic_store_n(p, v, __ATOMIC_SEQ_CST); }
+inline void pause()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
+}
+#else
+inline uint64_t load(uint64_t* p) { return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)p, 0, 0); }
+inline void store(uint64_t* p, uint64_t v) { InterlockedExchange64((volatile LONG64*)p, (LONG64)v); }
+inline uint64_t fetch_add(uint64_t* p, int64_t v) { return (uint64_t)InterlockedExchangeAdd64((volatile LONG64*)p, (LONG64)v); }
+inline bool compare_exchange(uint64_t* p, uint64_t expected, uint64_t desired)
+{ return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)p, (LONG64)desired, (LONG64)expected) == expected; }
+inline bool load(bool* p) { return _InterlockedCompareExchange8((volatile char*)p, 0, 0) != 0; }
+inline void store(bool* p, bool v) { _InterlockedExchange8((volatile char*)p, (char)v); }
+inline void pause() { YieldProcessor(); }
+#endif
+
+// spinning only pays off when the thread we wait for can run at the same time
+inline size_t spin_count()
+{ static const size_t count = std::thread::hardware_concurrency() > 1 ? 1 << 10 : 0;
+  return count;
+}
+
+// Wait until ready() holds.  parked counts the threads sleeping on cv, so that
+// wake_parked can skip the lock when nobody is.
+template<class F> void spin_then_park(F ready, MUTEX* lock, CV* cv, uint64_t* parked)
+{ for (size_t i = 0, n = spin_count(); i < n; i++)
+  { if (ready())
+      return;
+    pause();
+  }
+  mutex_lock(lock);
+  fetch_add(parked, 1);
+  while (!ready())
+    condition_variable_wait(cv, lock);
+  fetch_add(parked, -1);
+  mutex_unlock(lock);
+}
+
+// call after making some waiter's ready() true.
+inline void wake_parked(MUTEX* lock, CV* cv, uint64_t* parked)
+{ if (load(parked) > 0)
+  { mutex_lock(lock);
+    condition_variable_signal_all(cv);
+    mutex_unlock(lock);
+  }
+}
+}
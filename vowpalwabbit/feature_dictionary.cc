@@ -0,0 +1,319 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#include "feature_dictionary.h"
+#include "global_data.h"
+#include "parse_example.h"
+#include "parse_args.h"
+#include "comp_io.h"
+#include "vw.h"
+#include <mutex>
+#include <vector>
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+const char dictionary_magic[8] = { 'V', 'W', 'D', 'I', 'C', 'T', '0', '1' };
+
+struct shared_dictionary
+{ feature_dict* dict;
+  size_t users;
+};
+
+mutex registry_lock;
+vector<shared_dictionary> registry;
+
+uint64_t hasher_probe(vw& all)
+{ char name[] = "12345"; // numbers and strings hash differently under --hash strings
+  substring ss = { name, name + strlen(name) };
+  return all.p->hasher(ss, hash_base);
+}
+
+// the other options that apply to the default namespace while a line is parsed;
+// 0 without them, as in files compiled before they were recorded
+uint64_t parse_settings(vw& all)
+{ uint64_t v = all.affix_features[(unsigned char)' '];
+  v = v * 341789041 + (all.spelling_features[(unsigned char)' '] ? 1 : 0);
+  return v;
+}
+
+unsigned long long hash_file_contents(io_buf *io, int f)
+{ unsigned long long v = 5289374183516789128;
+  unsigned char buf[1024];
+  while (true)
+  { ssize_t n = io->read_file(f, buf, 1024);
+    if (n <= 0) break;
+    for (ssize_t i=0; i<n; i++)
+    { v *= 341789041;
+      v += buf[i];
+    }
+  }
+  return v;
+}
+
+size_t padded(size_t bytes) { return (bytes + 7) & ~(size_t)7; }
+
+// where the arrays of a compiled dictionary start, relative to its header
+struct layout
+{ size_t table, entries, indices, values, words, end;
+  layout(const feature_dict::header& h)
+  { table = sizeof(feature_dict::header);
+    entries = table + padded(h.buckets * sizeof(uint32_t));
+    indices = entries + h.entries * sizeof(feature_dict::entry);
+    values = indices + h.features * sizeof(uint64_t);
+    words = values + padded(h.features * sizeof(float));
+    end = words + h.word_bytes;
+  }
+};
+
+void insert(uint32_t* table, uint64_t buckets, uint64_t hash, uint32_t entry)
+{ uint64_t i = hash & (buckets - 1);
+  while (table[i] != 0)
+    i = (i + 1) & (buckets - 1);
+  table[i] = entry + 1;
+}
+
+feature_dict* parse_text_dictionary(vw& all, io_buf& io)
+{ feature_dict* d = calloc_or_throw<feature_dict>(1);
+  d->head.buckets = 1024;
+  d->table = calloc_or_throw<uint32_t>(d->head.buckets);
+  v_array<feature_dict::entry> entries = v_init<feature_dict::entry>();
+  v_array<uint64_t> indices = v_init<uint64_t>();
+  v_array<float> values = v_init<float>();
+  v_array<char> words = v_init<char>();
+  example *ec = VW::alloc_examples(all.p->lp.label_size, 1);
+  features& fs = ec->feature_space[(size_t)' '];
+
+  substring line;
+  while (read_example_line(io, line) > 0)
+  { char* c = line.begin;
+    while (c < line.end && (*c == ' ' || *c == '\t')) ++c; // skip initial whitespace
+    char* e = c;
+    while (e < line.end && *e != ' ' && *e != '\t') ++e; // gobble up initial word
+    if (e == c || e == line.end) continue; // no word, or no features
+    substring word = { c, e };
+    uint64_t hash = uniform_hash(c, e - c, quadratic_constant);
+    d->entries = entries.begin();
+    d->words = words.begin();
+    if (d->find(word, hash) != nullptr) // don't overwrite old values!
+      continue;
+
+    feature_dict::entry en = { hash, words.size(), indices.size(), (uint32_t)(e - c), 0, 0.f, 0 };
+    push_many(words, c, e - c);
+    substring rest = { e - 1, line.end };
+    *rest.begin = '|'; // set up for the parser
+    substring_to_example(&all, all.p, ec, rest);
+    // now we just need to grab stuff from the default namespace of ec!
+    if (fs.size() > 0)
+    { en.count = (uint32_t)fs.size();
+      en.sum_feat_sq = fs.sum_feat_sq;
+      push_many(indices, fs.indicies.begin(), fs.size());
+      push_many(values, fs.values.begin(), fs.size());
+      entries.push_back(en);
+      if (2 * entries.size() > d->head.buckets)
+      { free(d->table);
+        d->head.buckets *= 2;
+        d->table = calloc_or_throw<uint32_t>(d->head.buckets);
+        for (size_t i = 0; i < entries.size(); i++)
+          insert(d->table, d->head.buckets, entries[i].hash, (uint32_t)i);
+      }
+      else
+        insert(d->table, d->head.buckets, hash, (uint32_t)(entries.size() - 1));
+    }
+    else
+      words.end() = words.begin() + en.word;
+
+    // clear up ec
+    ec->tag.erase(); ec->indices.erase();
+    for (size_t i=0; i<256; i++) { ec->feature_space[i].erase();}
+  }
+  VW::dealloc_example(all.p->lp.delete_label, *ec);
+  free(ec);
+
+  d->head.entries = entries.size();
+  d->head.features = indices.size();
+  d->head.word_bytes = words.size();
+  d->entries = entries.begin();
+  d->indices = indices.begin();
+  d->values = values.begin();
+  d->words = words.begin();
+  return d;
+}
+
+feature_dict* map_dictionary(vw& all, const string& fname, feature_dict::header& h)
+{ feature_dict* d = calloc_or_throw<feature_dict>(1);
+  d->head = h;
+  size_t length = layout(h).end;
+  char* block;
+#ifndef _WIN32
+  int f = open(fname.c_str(), O_RDONLY);
+  struct stat st;
+  if (f < 0 || fstat(f, &st) != 0)
+  { free(d);
+    THROWERRNO("error: cannot open dictionary '" << fname << "'");
+  }
+  if ((size_t)st.st_size != length)
+  { close(f);
+    free(d);
+    THROW("error: compiled dictionary '" << fname << "' is " << st.st_size << " bytes long instead of " << length);
+  }
+  // shared, read-only: every process mapping the file uses the same pages
+  void* p = mmap(nullptr, length, PROT_READ, MAP_SHARED, f, 0);
+  close(f);
+  if (p == MAP_FAILED)
+  { free(d);
+    THROWERRNO("error: cannot map dictionary '" << fname << "'");
+  }
+  block = (char*)p;
+  d->mapped = block;
+  d->mapped_length = length;
+#else
+  io_buf io;
+  int f = io.open_file(fname.c_str(), all.stdin_off, io_buf::READ);
+  block = calloc_or_throw<char>(length);
+  if (f < 0 || io.read_file(f, block, length) != (ssize_t)length)
+  { free(block);
+    free(d);
+    THROW("error: cannot read compiled dictionary '" << fname << "'");
+  }
+  io.close_file();
+  d->mapped = block;
+  d->mapped_length = length;
+#endif
+  layout l(h);
+  d->table = (uint32_t*)(block + l.table);
+  d->entries = (feature_dict::entry*)(block + l.entries);
+  d->indices = (uint64_t*)(block + l.indices);
+  d->values = (float*)(block + l.values);
+  d->words = block + l.words;
+  return d;
+}
+
+void free_dictionary(feature_dict* d)
+{ if (d->mapped != nullptr)
+  {
+#ifndef _WIN32
+    munmap(d->mapped, d->mapped_length);
+#else
+    free(d->mapped);
+#endif
+  }
+  else
+  { free(d->table);
+    free(d->entries);
+    free(d->indices);
+    free(d->values);
+    free(d->words);
+  }
+  free(d);
+}
+}
+
+feature_dict* load_dictionary(vw& all, const string& name, const string& fname, unsigned long long& content_hash)
+{ bool is_compressed = ends_with(fname, ".gz") || ends_with(fname, ".zst") || ends_with(fname, ".lz4");
+  io_buf* io = is_compressed ? new comp_io_buf : new io_buf;
+  int fd = io->open_file(fname.c_str(), all.stdin_off, io_buf::READ);
+  if (fd < 0)
+  { delete io;
+    THROW("error: cannot read dictionary from file '" << fname << "'" << ", opening failed");
+  }
+
+  feature_dict::header h;
+  bool compiled = io->read_file(fd, &h, sizeof(h)) == (ssize_t)sizeof(h) && memcmp(h.magic, dictionary_magic, sizeof(h.magic)) == 0;
+  if (compiled)
+  { io->close_file();
+    delete io;
+    if (is_compressed)
+      THROW("error: compiled dictionary '" << fname << "' cannot be compressed, it is used in place");
+    if (h.hasher_probe != hasher_probe(all))
+      THROW("error: dictionary '" << fname << "' was compiled with another --hash, compile it again");
+    if (h.parse_settings != parse_settings(all))
+      THROW("error: dictionary '" << fname << "' was compiled with other --affix or --spelling, compile it again");
+    content_hash = h.content_hash;
+  }
+  else
+  { io->reset_file(fd);
+    content_hash = hash_file_contents(io, fd);
+    io->close_file();
+  }
+
+  if (! all.quiet)
+    cerr << (compiled ? "mapped" : "scanned") << " dictionary '" << name << "' from '" << fname << "', hash=" << hex << content_hash << dec << endl;
+
+  lock_guard<mutex> lock(registry_lock);
+  uint64_t probe = hasher_probe(all);
+  uint64_t settings = parse_settings(all);
+  for (shared_dictionary& s : registry)
+    if (s.dict->head.content_hash == content_hash && s.dict->head.hasher_probe == probe
+        && s.dict->head.parse_settings == settings)
+    { s.users++;
+      delete io;
+      return s.dict;
+    }
+
+  feature_dict* d;
+  if (compiled)
+    d = map_dictionary(all, fname, h);
+  else
+  { fd = io->open_file(fname.c_str(), all.stdin_off, io_buf::READ);
+    if (fd < 0)
+    { delete io;
+      THROW("error: cannot re-read dictionary from file '" << fname << "'" << ", opening failed");
+    }
+    d = parse_text_dictionary(all, *io);
+    io->close_file();
+    delete io;
+    memcpy(d->head.magic, dictionary_magic, sizeof(d->head.magic));
+    d->head.hasher_probe = probe;
+    d->head.parse_settings = settings;
+    d->head.content_hash = content_hash;
+  }
+
+  if (! all.quiet)
+    cerr << "dictionary " << name << " contains " << d->head.entries << " item" << (d->head.entries == 1 ? "\n" : "s\n");
+
+  shared_dictionary s = { d, 1 };
+  registry.push_back(s);
+  return d;
+}
+
+void save_dictionary(feature_dict& d, const string& fname)
+{ io_buf io;
+  int f = io.open_file(fname.c_str(), false, io_buf::WRITE);
+  if (f < 0)
+    THROW("error: cannot write compiled dictionary '" << fname << "'");
+  layout l(d.head);
+  const char zeros[8] = { 0 };
+  bool ok = io.write_file(f, &d.head, sizeof(d.head)) == (ssize_t)sizeof(d.head)
+            && io.write_file(f, d.table, d.head.buckets * sizeof(uint32_t)) == (ssize_t)(d.head.buckets * sizeof(uint32_t))
+            && io.write_file(f, zeros, l.entries - l.table - d.head.buckets * sizeof(uint32_t)) >= 0
+            && io.write_file(f, d.entries, l.indices - l.entries) == (ssize_t)(l.indices - l.entries)
+            && io.write_file(f, d.indices, l.values - l.indices) == (ssize_t)(l.values - l.indices)
+            && io.write_file(f, d.values, d.head.features * sizeof(float)) == (ssize_t)(d.head.features * sizeof(float))
+            && io.write_file(f, zeros, l.words - l.values - d.head.features * sizeof(float)) >= 0
+            && io.write_file(f, d.words, d.head.word_bytes) == (ssize_t)d.head.word_bytes;
+  io.close_file();
+  if (!ok)
+    THROW("error: writing compiled dictionary '" << fname << "' failed");
+}
+
+void release_dictionary(feature_dict* d)
+{ lock_guard<mutex> lock(registry_lock);
+  for (size_t i = 0; i < registry.size(); i++)
+    if (registry[i].dict == d)
+    { if (--registry[i].users == 0)
+      { free_dictionary(d);
+        registry.erase(registry.begin() + i);
+      }
+      return;
+    }
+}
@@ -0,0 +1,79 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include "parse_primitives.h"
+
+struct vw;
+
+/* The dictionaries of --dictionary map words to lists of features.  All the
+** features of a dictionary are stored one after the other, and words are found
+** through an open-addressing table, in the layout of a compiled dictionary file:
+** compiled files (see --dictionary_compile) are mapped into memory and used in
+** place, so loading them takes no time and processes using the same file share
+** its pages.  Text dictionaries are parsed into the same layout.  vw instances of
+** a process that load the same dictionary with the same --hash, --affix and
+** --spelling share one copy.
+**
+** A compiled file is written in the byte order of the machine that compiled it:
+**   header, table (buckets uint32_t, padded to 8 bytes), entries,
+**   feature indices (uint64_t), feature values (float, padded to 8 bytes), words.
+*/
+struct feature_dict
+{ struct header
+  { char magic[8];
+    uint64_t hasher_probe; // hash of a probe name under the --hash the dictionary was parsed with
+    uint64_t content_hash; // of the text the dictionary was parsed from
+    uint64_t buckets; // size of the table, a power of 2
+    uint64_t entries;
+    uint64_t features;
+    uint64_t word_bytes;
+    uint64_t parse_settings; // of the --affix and --spelling of the default namespace, 0 without them
+  };
+
+  struct entry
+  { uint64_t hash; // uniform_hash of the word
+    uint64_t word; // offset of the word in words
+    uint64_t first; // offset of the word's first feature
+    uint32_t word_length;
+    uint32_t count; // number of features of the word
+    float sum_feat_sq;
+    uint32_t reserved;
+  };
+
+  header head;
+  uint32_t* table; // 1 + index in entries, 0 for an empty bucket
+  entry* entries;
+  uint64_t* indices;
+  float* values;
+  char* words;
+
+  char* mapped; // the mapped file, or nullptr if the arrays were allocated
+  size_t mapped_length;
+
+  const entry* find(substring word, uint64_t hash) const
+  { uint64_t mask = head.buckets - 1;
+    size_t length = word.end - word.begin;
+    for (uint64_t i = hash & mask; table[i] != 0; i = (i + 1) & mask)
+    { const entry& e = entries[table[i] - 1];
+      if (e.hash == hash && e.word_length == length && memcmp(words + e.word, word.begin, length) == 0)
+        return &e;
+    }
+    return nullptr;
+  }
+};
+
+// load a text or compiled dictionary, or share a copy already loaded; content_hash
+// identifies the dictionary's contents
+feature_dict* load_dictionary(vw& all, const std::string& name, const std::string& fname, unsigned long long& content_hash);
+
+// write d as a compiled dictionary
+void save_dictionary(feature_dict& d, const std::string& fname);
+
+// done with a dictionary returned by load_dictionary
+void release_dictionary(feature_dict* d);
@@ -10,6 +10,8 @@ license as described in the file LICENSE.
 #include <WinSock2.h>
 #else
 #include <netdb.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 
 #if !defined(VW_NO_INLINE_SIMD)
@@ -25,6 +27,8 @@ license as described in the file LICENSE.
 #include "reductions.h"
 #include "vw.h"
 #include "floatbits.h"
+#include "weight_blocks.h"
+#include "vw_versions.h"
 
 #define VERSION_SAVE_RESUME_FIX "7.10.1"
 
@@ -34,6 +38,8 @@ using namespace LEARNER;
 //4. Factor various state out of vw&
 namespace GD
 {
+struct norm_data;
+
 struct gd
 { //double normalized_sum_norm_x;
   double total_weight;
@@ -49,10 +55,15 @@ struct gd
   void (*update)(gd&, base_learner&, example&);
   float (*sensitivity)(gd&, base_learner&, example&);
   void (*multipredict)(gd&, base_learner&, example&, size_t, size_t, polyprediction*, bool);
+  void (*multiupdate)(gd&, base_learner&, example&, size_t, size_t, polyprediction*, const float*);
   bool normalized;
   bool adaptive;
 
   vw* all; //parallel, features, parameters
+
+  v_array<uint32_t> classes; // for multiupdate
+  v_array<float> class_updates;
+  v_array<norm_data> class_norms;
 };
 
 void sync_weights(vw& all);
@@ -105,6 +116,28 @@ inline void update_feature(float& update, float x, float& fw)
   }
 }
 
+// plain sgd updates (no adaptive, normalized or feature mask) of interaction features are vectorized
+struct plain_update_kernel
+{ static const bool available = true;
+  static void run(float& update, const feature_value* values, const feature_index* indices, size_t n, uint64_t offset,
+                  uint64_t weight_mask, weight* weight_vector, feature_value ft_value, feature_index halfhash)
+  { if (n < INTERACTIONS::simd_min_features)
+      for (size_t i = 0; i < n; i++)
+        weight_vector[((indices[i] ^ halfhash) + offset) & weight_mask] += update * INTERACTIONS::INTERACTION_VALUE(ft_value, values[i]);
+    else
+      INTERACTIONS::simd_update(update, values, indices, n, offset, weight_mask, weight_vector, ft_value, halfhash);
+  }
+};
+}
+
+namespace INTERACTIONS
+{
+template <> struct simd_kernel<float, float&, GD::update_feature<false, true, 0, 0, 0> > : GD::plain_update_kernel {};
+template <> struct simd_kernel<float, float&, GD::update_feature<true, true, 0, 0, 0> > : GD::plain_update_kernel {};
+}
+
+namespace GD
+{
 //this deals with few nonzero features vs. all nonzero features issues.
 template<bool sqrt_rate, size_t adaptive, size_t normalized>
 float average_update(gd& g)
@@ -129,6 +162,12 @@ void train(gd& g, example& ec, float update)
   foreach_feature<float, update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare> >(*g.all, ec, update);
 }
 
+void finish(gd& g)
+{ g.classes.delete_v();
+  g.class_updates.delete_v();
+  g.class_norms.delete_v();
+}
+
 void end_pass(gd& g)
 { vw& all = *g.all;
   sync_weights(all);
@@ -216,7 +255,7 @@ inline void audit_interaction(audit_results& dat, const audit_strings* f)
 
 inline void audit_feature(audit_results& dat, const float ft_weight, const uint64_t ft_idx)
 { uint64_t index = ft_idx & dat.all.reg.weight_mask;
-  weight* weights = dat.all.reg.weight_vector;
+  weight* w = dat.all.reg.sparse != nullptr ? &dat.all.reg.sparse->find(index) : &dat.all.reg.weight_vector[index];
   size_t stride_shift = dat.all.reg.stride_shift;
 
   string ns_pre;
@@ -225,13 +264,13 @@ inline void audit_feature(audit_results& dat, const float ft_weight, const uint6
   if(dat.all.audit)
   { ostringstream tempstream;
     tempstream << ':' << (index >> stride_shift) << ':' << ft_weight
-               << ':' << trunc_weight(weights[index], (float)dat.all.sd->gravity) * (float)dat.all.sd->contraction;
+               << ':' << trunc_weight(w[0], (float)dat.all.sd->gravity) * (float)dat.all.sd->contraction;
 
     if(dat.all.adaptive)
-      tempstream << '@' << weights[index+1];
+      tempstream << '@' << w[1];
 
 
-    string_value sv = {weights[index]*ft_weight, ns_pre+tempstream.str()};
+    string_value sv = {w[0]*ft_weight, ns_pre+tempstream.str()};
     dat.results.push_back(sv);
   }
 
@@ -353,7 +392,12 @@ void predict(gd& g, base_learner&, example& ec)
 }
 
 inline void vec_add_trunc_multipredict(multipredict_info& mp, const float fx, uint64_t fi)
-{ weight*w = mp.reg->weight_vector + (fi & mp.reg->weight_mask);
+{ if (mp.reg->sparse != nullptr)
+  { for (size_t c=0; c<mp.count; c++, fi += mp.step)
+      mp.pred[c].scalar += fx * trunc_weight(mp.reg->sparse->find(fi & mp.reg->weight_mask), mp.gravity);
+    return;
+  }
+  weight*w = mp.reg->weight_vector + (fi & mp.reg->weight_mask);
   for (size_t c=0; c<mp.count; c++)
   { mp.pred[c].scalar += fx * trunc_weight(*w, mp.gravity);
     w += mp.step;
@@ -564,17 +608,325 @@ void learn(gd& g, base_learner& base, example& ec)
   update<sparse_l2, invariant, sqrt_rate, feature_mask_off, adaptive, normalized, spare>(g,base,ec);
 }
 
+/* multiupdate: the updates of count weight vectors step apart (the classes of --oaa),
+** each with its own label (FLT_MAX for none) and prediction, in at most two passes over the features and
+** their interactions instead of one or two per class.  The classes to update are listed
+** first: usually only a few of many have a loss.  The first pass gathers what adaptive
+** and normalized updates need of them, the updates are then computed class by class as
+** update would, and the second pass applies them all.
+*/
+struct multiupdate_info
+{ size_t count; // of the classes listed
+  uint64_t step;
+  regressor* reg;
+  uint32_t* classes;
+  float* updates;
+  norm_data* norms;
+};
+
+// f(k, weight of the k-th class listed) with the loop's state in locals: the weights
+// written could otherwise be any of it
+template<class F>
+inline void foreach_class(multiupdate_info& mu, uint64_t fi, F f)
+{ const size_t count = mu.count;
+  const uint64_t step = mu.step;
+  const uint64_t mask = mu.reg->weight_mask;
+  const uint32_t* classes = mu.classes;
+  if (mu.reg->sparse != nullptr)
+  { sparse_weights& weights = *mu.reg->sparse;
+    for (size_t k = 0; k < count; k++)
+      f(k, weights[(fi + classes[k] * step) & mask]);
+    return;
+  }
+  weight* weights = mu.reg->weight_vector;
+  for (size_t k = 0; k < count; k++)
+    f(k, weights[(fi + classes[k] * step) & mask]);
+}
+
+template<bool sqrt_rate, bool feature_mask_off, size_t adaptive, size_t normalized, size_t spare>
+inline void pred_per_update_multi(multiupdate_info& mu, float x, uint64_t fi)
+{ norm_data* norms = mu.norms;
+  foreach_class(mu, fi, [=](size_t k, float& fw)
+  { if (norms[k].grad_squared != 0.)
+      pred_per_update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare, false>(norms[k], x, fw);
+  });
+}
+
+template<bool sqrt_rate, bool feature_mask_off, size_t adaptive, size_t normalized, size_t spare>
+inline void update_feature_multi(multiupdate_info& mu, float x, uint64_t fi)
+{ const float* updates = mu.updates;
+  foreach_class(mu, fi, [=](size_t k, float& fw)
+  { float update = updates[k];
+    update_feature<sqrt_rate, feature_mask_off, adaptive, normalized, spare>(update, x, fw);
+  });
+}
+
+template<bool sparse_l2, bool invariant, bool sqrt_rate, bool feature_mask_off, size_t adaptive, size_t normalized, size_t spare>
+void multiupdate(gd& g, base_learner&, example& ec, size_t count, size_t step, polyprediction* pred, const float* labels)
+{ vw& all = *g.all;
+  label_data& ld = ec.l.simple;
+  float label = ld.label;
+  float prediction = ec.pred.scalar;
+  if (g.class_updates.size() < count)
+  { g.classes.resize(count);
+    g.class_updates.resize(count);
+    g.class_norms.resize(count);
+    g.classes.end() = g.classes.begin() + count;
+    g.class_updates.end() = g.class_updates.begin() + count;
+    g.class_norms.end() = g.class_norms.begin() + count;
+  }
+  multiupdate_info mu = { 0, step, &all.reg, g.classes.begin(), g.class_updates.begin(), g.class_norms.begin() };
+
+  // the classes with a loss (all of them with sparse_l2), and for those with a gradient
+  // what the first pass gathers
+  bool gather = false;
+  for (uint32_t c = 0; c < count; c++)
+  { if (labels[c] == FLT_MAX)
+      continue;
+    bool loss = all.loss->getLoss(all.sd, pred[c].scalar, labels[c]) > 0.;
+    if (!loss && !sparse_l2)
+      continue;
+    size_t k = mu.count++;
+    mu.classes[k] = c;
+    mu.updates[k] = loss ? 1.f : 0.f;
+    if ((adaptive || normalized) && loss)
+    { norm_data nd = {all.loss->getSquareGrad(pred[c].scalar, labels[c]) * ec.weight, 0., 0., {g.neg_power_t, g.neg_norm_power}};
+      mu.norms[k] = nd;
+      gather = gather || nd.grad_squared != 0.;
+    }
+    else
+      mu.norms[k].grad_squared = 0.;
+  }
+  if (gather)
+    foreach_feature<multiupdate_info, uint64_t, pred_per_update_multi<sqrt_rate, feature_mask_off, adaptive, normalized, spare> >(all, ec, mu);
+
+  size_t updated = 0;
+  for (size_t k = 0; k < mu.count; k++)
+  { uint32_t c = mu.classes[k];
+    ec.pred.scalar = pred[c].scalar;
+    ld.label = labels[c];
+    float update = 0.;
+    if (mu.updates[k] != 0.)
+    { float pred_per_update;
+      if (!(adaptive || normalized))
+        pred_per_update = ec.total_sum_feat_sq;
+      else if (mu.norms[k].grad_squared == 0.)
+        pred_per_update = 1.; // as get_pred_per_update has it
+      else
+      { norm_data& nd = mu.norms[k];
+        if (normalized)
+        { all.normalized_sum_norm_x += ec.weight * nd.norm_x;
+          g.total_weight += ec.weight;
+          g.update_multiplier = average_update<sqrt_rate, adaptive, normalized>(g);
+          nd.pred_per_update *= g.update_multiplier;
+        }
+        pred_per_update = nd.pred_per_update;
+      }
+      float update_scale = get_scale<adaptive>(g, ec, ec.weight);
+      if (invariant)
+        update = all.loss->getUpdate(ec.pred.scalar, ld.label, update_scale, pred_per_update);
+      else
+        update = all.loss->getUnsafeUpdate(ec.pred.scalar, ld.label, update_scale);
+
+      if (all.reg_mode && fabs(update) > 1e-8)
+      { double dev1 = all.loss->first_derivative(all.sd, ec.pred.scalar, ld.label);
+        double eta_bar = (fabs(dev1) > 1e-8) ? (-update / dev1) : 0.0;
+        if (fabs(dev1) > 1e-8)
+          all.sd->contraction *= (1. - all.l2_lambda * eta_bar);
+        update /= (float)all.sd->contraction;
+        all.sd->gravity += eta_bar * all.l1_lambda;
+      }
+    }
+    if (sparse_l2)
+      update -= g.sparse_l2 * ec.pred.scalar;
+    if (update == 0.)
+      continue;
+    if (normalized)
+      update *= g.update_multiplier;
+    mu.classes[updated] = c;
+    mu.updates[updated++] = update;
+  }
+  mu.count = updated;
+
+  if (updated > 0)
+    foreach_feature<multiupdate_info, uint64_t, update_feature_multi<sqrt_rate, feature_mask_off, adaptive, normalized, spare> >(all, ec, mu);
+  if (all.sd->contraction < 1e-10)
+    sync_weights(all);
+  ld.label = label;
+  ec.pred.scalar = prediction;
+}
+
 void sync_weights(vw& all)
 { if (all.sd->gravity == 0. && all.sd->contraction == 1.)  // to avoid unnecessary weight synchronization
     return;
   uint64_t length = (uint64_t)1 << all.num_bits;
   uint64_t stride = (uint64_t)1 << all.reg.stride_shift;
-  for(uint64_t i = 0; i < length && all.reg_mode; i++)
+  sparse_weights* sparse = all.reg.sparse;
+  if (sparse != nullptr && all.reg_mode)
+  { for (uint64_t i = 0; i < sparse->buckets; i++)
+      if (sparse->table[i].key != 0)
+        sparse->table[i].block[0] = trunc_weight(sparse->table[i].block[0], (float)all.sd->gravity) * (float)all.sd->contraction;
+    sparse->initial[0] = trunc_weight(sparse->initial[0], (float)all.sd->gravity) * (float)all.sd->contraction;
+  }
+  for(uint64_t i = 0; i < length && all.reg_mode && sparse == nullptr; i++)
     all.reg.weight_vector[stride*i] = trunc_weight(all.reg.weight_vector[stride*i], (float)all.sd->gravity) * (float)all.sd->contraction;
   all.sd->gravity = 0.;
   all.sd->contraction = 1.;
 }
 
+/* With --dense_model the regressor is saved as an index no weight has, followed by
+**   uint32_t padding, padding zero bytes, 1 << num_bits floats: the weights.
+** The padding puts the weights at a multiple of dense_alignment in the file.  Only
+** predicting, a weight vector is just the weights, so it is mapped rather than read:
+** every process (and daemon child) loading the model shares the pages of the file.
+*/
+const uint64_t dense_alignment = 1 << 16; // a multiple of the page size of every system
+
+uint64_t dense_marker(vw& all)
+{ return all.num_bits < 31 ? (uint32_t)-1 : (uint64_t)-1;
+}
+
+// whether the regressor about to be read is dense, reading nothing
+bool dense_regressor_next(vw& all, io_buf& model_file)
+{ size_t n = all.num_bits < 31 ? sizeof(uint32_t) : sizeof(uint64_t);
+  char* p;
+  size_t current = model_file.current;
+  size_t got = buf_read(model_file, p, n);
+  model_file.head -= got;
+  model_file.current = current;
+  uint32_t old_i = 0;
+  uint64_t i = 0;
+  if (got < n)
+    return false;
+  if (n == sizeof(old_i))
+  { memcpy(&old_i, p, n);
+    i = old_i;
+  }
+  else
+    memcpy(&i, p, n);
+  return i == dense_marker(all);
+}
+
+void save_dense_regressor(vw& all, io_buf& model_file)
+{ uint64_t marker = dense_marker(all);
+  uint32_t old_marker = (uint32_t)marker;
+  if (all.num_bits < 31)
+    bin_write_fixed(model_file, (char*)&old_marker, sizeof(old_marker));
+  else
+    bin_write_fixed(model_file, (char*)&marker, sizeof(marker));
+
+  uint32_t padding = 0;
+  int64_t at = model_file.file_offset(false);
+  if (at >= 0) // else the file cannot be mapped anyway
+    padding = (uint32_t)((dense_alignment - (at + sizeof(padding)) % dense_alignment) % dense_alignment);
+  bin_write_fixed(model_file, (char*)&padding, sizeof(padding));
+  char zeros[4096] = { 0 };
+  for (uint32_t done = 0; done < padding; done += sizeof(zeros))
+    bin_write_fixed(model_file, zeros, min((size_t)(padding - done), sizeof(zeros)));
+
+  const uint64_t chunk = 1 << 16;
+  uint64_t length = (uint64_t)1 << all.num_bits;
+  vector<weight> block(min(chunk, length));
+  for (uint64_t i = 0; i < length; i += chunk)
+  { uint64_t n = min(chunk, length - i);
+    for (uint64_t j = 0; j < n; j++)
+      block[j] = all.reg.weight_vector[(i + j) << all.reg.stride_shift];
+    bin_write_fixed(model_file, (char*)block.data(), n * sizeof(weight));
+  }
+}
+
+#ifndef _WIN32
+// map the weights of a dense regressor in place of any allocated ones
+bool map_dense_regressor(vw& all, io_buf& model_file)
+{ int64_t at = model_file.file_offset(true);
+  if (at < 0 || at % dense_alignment != 0)
+    return false;
+  int f = model_file.files[model_file.current];
+  struct stat st;
+  if (fstat(f, &st) != 0 || !S_ISREG(st.st_mode))
+    return false;
+  size_t bytes = all.length() * sizeof(weight);
+  if ((uint64_t)st.st_size < at + bytes)
+    THROW("Model content is corrupted, the file ends within the dense weight vector");
+
+  // private: until a process writes to a page (say with --feature_mask), the page
+  // cache is all there is
+  void* p = mmap(nullptr, bytes, PROT_READ|PROT_WRITE, MAP_PRIVATE, f, at);
+  if (p == MAP_FAILED)
+    return false;
+  free_regressor(all.reg);
+  all.reg.weight_vector = (weight*)p;
+  all.reg.weight_mask = all.length() - 1;
+  all.reg.mapped_length = bytes;
+
+  // carry on reading after the weights
+  lseek(f, at + bytes, SEEK_SET);
+  model_file.space.end() = model_file.space.begin();
+  model_file.head = model_file.space.begin();
+  return true;
+}
+#endif
+
+// the floats of weight i; with --sparse_weights it is given a block only if add
+weight* weight_floats(vw& all, uint64_t i, bool add)
+{ uint64_t index = i << all.reg.stride_shift;
+  if (all.reg.sparse == nullptr)
+    return &all.reg.weight_vector[index];
+  return add ? &(*all.reg.sparse)[index] : &all.reg.sparse->find(index);
+}
+
+/* Binary regressors and online states are otherwise saved as another index no
+** weight has, followed by blocks of weights (see weight_blocks.h).  Only models
+** of VERSION_FILE_WITH_WEIGHT_BLOCKS or later are read this way.
+*/
+uint64_t blocks_marker(bool wide)
+{ return wide ? (uint64_t)-2 : (uint32_t)-2;
+}
+
+void save_weight_blocks(vw& all, io_buf& model_file, bool wide, size_t floats)
+{ uint64_t marker = blocks_marker(wide);
+  uint32_t old_marker = (uint32_t)marker;
+  if (wide)
+    bin_write_fixed(model_file, (char*)&marker, sizeof(marker));
+  else
+    bin_write_fixed(model_file, (char*)&old_marker, sizeof(old_marker));
+  if (all.reg.sparse != nullptr)
+    write_weight_blocks(model_file, *all.reg.sparse, all.length(), floats);
+  // with --save_in_background another thread writes a copy of the weights
+  else if (!defer_weights(all, floats))
+    write_weight_blocks(model_file, all.reg.weight_vector, all.length(), (uint64_t)1 << all.reg.stride_shift, floats);
+}
+
+// the rest of a dense regressor, after the marker
+void load_dense_regressor(vw& all, io_buf& model_file)
+{ uint32_t padding = 0;
+  if (bin_read_fixed(model_file, (char*)&padding, sizeof(padding), "") < sizeof(padding) || padding >= dense_alignment)
+    THROW("Model content is corrupted, bad dense weight vector header");
+  char zeros[4096];
+  for (uint32_t done = 0; done < padding; done += sizeof(zeros))
+    bin_read_fixed(model_file, zeros, min((size_t)(padding - done), sizeof(zeros)), "");
+
+#ifndef _WIN32
+  if (!all.training && all.reg.stride_shift == 0 && all.reg.sparse == nullptr && map_dense_regressor(all, model_file))
+    return;
+#endif
+  initialize_regressor(all); // unless gd::save_load did, knowing nothing of the mapping
+
+  // only the nonzero weights, as if they had been read sparsely
+  const uint64_t chunk = 1 << 16;
+  uint64_t length = (uint64_t)1 << all.num_bits;
+  vector<weight> block(min(chunk, length));
+  for (uint64_t i = 0; i < length; i += chunk)
+  { uint64_t n = min(chunk, length - i);
+    size_t bytes = n * sizeof(weight);
+    if (bin_read_fixed(model_file, (char*)block.data(), bytes, "") < bytes)
+      THROW("Model content is corrupted, the file ends within the dense weight vector");
+    for (uint64_t j = 0; j < n; j++)
+      if (block[j] != 0.)
+        *weight_floats(all, i + j, true) = block[j];
+  }
+}
+
 void save_load_regressor(vw& all, io_buf& model_file, bool read, bool text)
 { uint64_t length = (uint64_t)1 << all.num_bits;
   uint64_t stride = (uint64_t)1 << all.reg.stride_shift;
@@ -588,7 +940,7 @@ void save_load_regressor(vw& all, io_buf& model_file, bool read, bool text)
     typedef std::map< std::string, size_t> str_int_map;
 
     for(str_int_map::iterator it = all.name_index_map.begin(); it != all.name_index_map.end(); ++it)
-    { v = &(all.reg.weight_vector[stride*it->second]);
+    { v = weight_floats(all, it->second, false);
       if(*v != 0.)
       {
         msg << it->first;
@@ -602,6 +954,22 @@ void save_load_regressor(vw& all, io_buf& model_file, bool read, bool text)
     return;
   }
 
+  if (!read && !text)
+  { if (all.dense_model)
+      save_dense_regressor(all, model_file);
+    else
+      save_weight_blocks(all, model_file, all.num_bits >= 31, 1);
+    return;
+  }
+
+  vector<uint64_t> numbers; // of the weights to write, with --sparse_weights
+  size_t next = 0;
+  if (!read && all.reg.sparse != nullptr)
+  { numbers = all.reg.sparse->weight_numbers();
+    numbers.push_back(length);
+    i = numbers[next++];
+  }
+
   do
   { brw = 1;
     weight* v;
@@ -612,18 +980,29 @@ void save_load_regressor(vw& all, io_buf& model_file, bool read, bool text)
 	  }
 	else
 	  brw = bin_read_fixed(model_file, (char*)&i, sizeof(i), "");
+      if (brw > 0 && i == dense_marker(all))
+      { load_dense_regressor(all, model_file);
+        return;
+      }
+      if (brw > 0 && all.model_file_ver >= VERSION_FILE_WITH_WEIGHT_BLOCKS && i == blocks_marker(all.num_bits >= 31))
+      { if (all.reg.sparse != nullptr)
+          read_weight_blocks(model_file, *all.reg.sparse, length, 1);
+        else
+          read_weight_blocks(model_file, all.reg.weight_vector, length, stride, 1);
+        return;
+      }
       if (brw > 0)
       { if (i >= length)
         { THROW("Model content is corrupted, weight vector index " << i << " must be less than total vector length " << length);
         }
-        v = &(all.reg.weight_vector[stride*i]);
+        v = weight_floats(all, i, true);
         brw += bin_read_fixed(model_file, (char*)v, sizeof(*v), "");
       }
     }
     else// write binary or text
     {
 
-      v = &(all.reg.weight_vector[stride*i]);
+      v = weight_floats(all, i, false);
       if (*v != 0.)
         { stringstream msg;
           msg << i;
@@ -642,7 +1021,7 @@ void save_load_regressor(vw& all, io_buf& model_file, bool read, bool text)
     }
 
     if (!read)
-      i++;
+      i = all.reg.sparse != nullptr ? numbers[next++] : i + 1;
   }
   while ((!read && i < length) || (read && brw >0));
 }
@@ -738,22 +1117,45 @@ void save_load_online_state(vw& all, io_buf& model_file, bool read, bool text, g
 
   uint64_t length = (uint64_t)1 << all.num_bits;
   uint64_t stride = (uint64_t)1 << all.reg.stride_shift;
+  size_t floats = 1; // of each weight, as many as its update rule keeps
+  if (g != nullptr && g->adaptive && g->normalized)
+    floats = 3;
+  else if (g != nullptr && (g->adaptive || g->normalized))
+    floats = 2;
+  if (!read && !text)
+  { save_weight_blocks(all, model_file, true, floats);
+    return;
+  }
 
   int c = 0;
   uint64_t i = 0;
   size_t brw = 1;
+  vector<uint64_t> numbers; // of the weights to write, with --sparse_weights
+  size_t next = 0;
+  if (!read && all.reg.sparse != nullptr)
+  { numbers = all.reg.sparse->weight_numbers();
+    numbers.push_back(length);
+    i = numbers[next++];
+  }
   do
   { brw = 1;
     weight* v;
     if (read)
     { c++;
       brw = bin_read_fixed(model_file, (char*)&i, sizeof(i), "");
+      if (brw > 0 && all.model_file_ver >= VERSION_FILE_WITH_WEIGHT_BLOCKS && i == blocks_marker(true))
+      { if (all.reg.sparse != nullptr)
+          read_weight_blocks(model_file, *all.reg.sparse, length, floats);
+        else
+          read_weight_blocks(model_file, all.reg.weight_vector, length, stride, floats);
+        return;
+      }
       if (brw > 0)
       { if (i >= length)
         { THROW("Model content is corrupted, weight vector index " << i << " must be less than total vector length " << length);
         }
 
-        v = &(all.reg.weight_vector[stride*i]);
+        v = weight_floats(all, i, true);
         if (g == NULL || (! g->adaptive && ! g->normalized))
           brw += bin_read_fixed(model_file, (char*)v, sizeof(*v), "");
         else if ((g->adaptive && !g->normalized) || (!g->adaptive && g->normalized))
@@ -765,7 +1167,7 @@ void save_load_online_state(vw& all, io_buf& model_file, bool read, bool text, g
       }
     }
     else // write binary or text
-    { v = &(all.reg.weight_vector[stride*i]);
+    { v = weight_floats(all, i, false);
       if (*v != 0.)
       { c++;
 
@@ -792,17 +1194,33 @@ void save_load_online_state(vw& all, io_buf& model_file, bool read, bool text, g
       }
     }
     if (!read)
-      i++;
+      i = all.reg.sparse != nullptr ? numbers[next++] : i + 1;
   }
   while ((!read && i < length) || (read && brw >0));
 }
 
 void save_load(gd& g, io_buf& model_file, bool read, bool text)
 { vw& all = *g.all;
-  if(read)
+  bool resume = all.save_resume;
+  if (model_file.files.size() > 0)
+  { stringstream msg;
+    msg << ":"<< resume << "\n";
+    bin_text_read_write_fixed(model_file,(char *)&resume, sizeof (resume),
+                              "", read,
+                              msg, text);
+  }
+
+  // when predicting from a dense regressor the weights are mapped, so they are
+  // initialized only if that fails (see load_dense_regressor)
+  bool dense = read && !all.training && !resume && all.reg.weight_vector == nullptr && !all.use_sparse_weights
+               && model_file.files.size() > 0 && dense_regressor_next(all, model_file);
+
+  if(read && !all.seeded && !dense) // a seeded instance uses weights already initialized
   { initialize_regressor(all);
 
-    if(all.adaptive && all.initial_t > 0)
+    if(all.adaptive && all.initial_t > 0 && all.reg.sparse != nullptr)
+      all.reg.sparse->initial[1] = all.initial_t;
+    else if(all.adaptive && all.initial_t > 0)
       { uint64_t length = (uint64_t)1 << all.num_bits;
 	uint64_t stride = (uint64_t)1 << all.reg.stride_shift;
       for (uint64_t j = 1; j < stride*length; j+=stride)
@@ -818,20 +1236,18 @@ void save_load(gd& g, io_buf& model_file, bool read, bool text)
   }
 
   if (model_file.files.size() > 0)
-  { bool resume = all.save_resume;
-    stringstream msg;
-    msg << ":"<< resume << "\n";
-    bin_text_read_write_fixed(model_file,(char *)&resume, sizeof (resume),
-                              "", read,
-                              msg, text);
-    if (resume)
+  { if (resume)
     { if (read && all.model_file_ver < VERSION_SAVE_RESUME_FIX)
         cerr << endl << "WARNING: --save_resume functionality is known to have inaccuracy in model files version less than " << VERSION_SAVE_RESUME_FIX << endl << endl;
       // save_load_online_state(g, model_file, read, text);
       save_load_online_state(all, model_file, read, text, &g);
     }
     else
-      save_load_regressor(all, model_file, read, text);
+    { save_load_regressor(all, model_file, read, text);
+      // the constant is 0 only if the model had none, as when read sparsely
+      if (dense && g.initial_constant != 0.0 && VW::get_weight(all, constant, 0) == 0.)
+        VW::set_weight(all, constant, 0, g.initial_constant);
+    }
   }
 }
 
@@ -841,12 +1257,14 @@ uint64_t set_learn(vw& all, bool feature_mask_off, gd& g)
   if (feature_mask_off)
   { g.learn = learn<sparse_l2, invariant, sqrt_rate, true, adaptive, normalized, spare>;
     g.update = update<sparse_l2, invariant, sqrt_rate, true, adaptive, normalized, spare>;
+    g.multiupdate = multiupdate<sparse_l2, invariant, sqrt_rate, true, adaptive, normalized, spare>;
     g.sensitivity = sensitivity<sqrt_rate, true, adaptive, normalized, spare>;
     return next;
   }
   else
   { g.learn = learn<sparse_l2, invariant, sqrt_rate, false, adaptive, normalized, spare>;
     g.update = update<sparse_l2, invariant, sqrt_rate, false, adaptive, normalized, spare>;
+    g.multiupdate = multiupdate<sparse_l2, invariant, sqrt_rate, false, adaptive, normalized, spare>;
     g.sensitivity = sensitivity<sqrt_rate, false, adaptive, normalized, spare>;
     return next;
   }
@@ -986,7 +1404,9 @@ base_learner* setup(vw& all)
   ret.set_sensitivity(g.sensitivity);
   ret.set_multipredict(g.multipredict);
   ret.set_update(g.update);
+  ret.set_multiupdate(g.multiupdate);
   ret.set_save_load(save_load);
+  ret.set_finish(finish);
   ret.set_end_pass(end_pass);
   return make_base(ret);
 }
@@ -31,6 +31,12 @@ inline void vec_add_multipredict(multipredict_info& mp, const float fx, uint64_t
   uint64_t mask = mp.reg->weight_mask;
   polyprediction* p = mp.pred;
 
+  if (mp.reg->sparse != nullptr)
+  { for (size_t c=0; c<mp.count; ++c, fi += (uint64_t)mp.step, ++p)
+      p->scalar += fx * mp.reg->sparse->find(fi & mask);
+    return;
+  }
+
   fi &= mask;
   uint64_t top = fi + (uint64_t)((mp.count-1) * mp.step);
   if (top <= mask)
@@ -47,14 +53,29 @@ inline void vec_add_multipredict(multipredict_info& mp, const float fx, uint64_t
 }
 
 // iterate through one namespace (or its part), callback function T(some_data_R, feature_value_x, feature_weight)
-template <class R, void (*T)(R&, const float, float&)>
-inline void foreach_feature(weight* weight_vector, uint64_t weight_mask, features& fs, R& dat, uint64_t offset=0, float mult=1.)
+// W is dense_weights or sparse_weights_view (see sparse_weights.h)
+template <class R, void (*T)(R&, const float, float&), class W>
+inline void foreach_feature(W& weights, features& fs, R& dat, uint64_t offset=0, float mult=1.)
 {
   for (features::iterator& f : fs)
-    T(dat, mult*f.value(), weight_vector[(f.index() + offset) & weight_mask]);
+    T(dat, mult*f.value(), weights[f.index() + offset]);
 }
 
 // iterate through one namespace (or its part), callback function T(some_data_R, feature_value_x, feature_index)
+template <class R, void (*T)(R&, float, uint64_t), class W>
+void foreach_feature(W& /*weights*/, features& fs, R&dat, uint64_t offset=0, float mult=1.)
+{
+  for (features::iterator& f : fs)
+    T(dat, mult*f.value(), f.index() + offset);
+}
+
+// the same on a weight vector
+template <class R, void (*T)(R&, const float, float&)>
+inline void foreach_feature(weight* weight_vector, uint64_t weight_mask, features& fs, R& dat, uint64_t offset=0, float mult=1.)
+{ dense_weights weights = { weight_vector, weight_mask };
+  foreach_feature<R,T>(weights, fs, dat, offset, mult);
+}
+
 template <class R, void (*T)(R&, float, uint64_t)>
 void foreach_feature(weight* /*weight_vector*/, uint64_t /*weight_mask*/, features& fs, R&dat, uint64_t offset=0, float mult=1.)
 {
@@ -62,16 +83,28 @@ void foreach_feature(weight* /*weight_vector*/, uint64_t /*weight_mask*/, featur
     T(dat, mult*f.value(), f.index() + offset);
 }
 
-// iterate through all namespaces and quadratic&cubic features, callback function T(some_data_R, feature_value_x, S)
-// where S is EITHER float& feature_weight OR uint64_t feature_index
-template <class R, class S, void (*T)(R&, float, S)>
-inline void foreach_feature(vw& all, example& ec, R& dat)
+template <class R, class S, void (*T)(R&, float, S), class W>
+inline void foreach_feature(W& weights, vw& all, example& ec, R& dat)
 { uint64_t offset = ec.ft_offset;
 
 for (features& f : ec)
-    foreach_feature<R,T>(all.reg.weight_vector, all.reg.weight_mask, f, dat, offset);
+    foreach_feature<R,T>(weights, f, dat, offset);
 
-  INTERACTIONS::generate_interactions<R,S,T>(all, ec, dat);
+  INTERACTIONS::generate_interactions<R,S,T,false,INTERACTIONS::dummy_func<R> >(all, ec, dat, weights);
+}
+
+// iterate through all namespaces and quadratic&cubic features, callback function T(some_data_R, feature_value_x, S)
+// where S is EITHER float& feature_weight OR uint64_t feature_index
+template <class R, class S, void (*T)(R&, float, S)>
+inline void foreach_feature(vw& all, example& ec, R& dat)
+{ if (all.reg.sparse != nullptr)
+  { sparse_weights_view weights = { all.reg.sparse, all.reg.weight_mask, all.training };
+    foreach_feature<R,S,T>(weights, all, ec, dat);
+  }
+  else
+  { dense_weights weights = { all.reg.weight_vector, all.reg.weight_mask };
+    foreach_feature<R,S,T>(weights, all, ec, dat);
+  }
 }
 
 // iterate through all namespaces and quadratic&cubic features, callback function T(some_data_R, feature_value_x, feature_weight)
@@ -81,6 +114,25 @@ inline void foreach_feature(vw& all, example& ec, R& dat)
 }
 
 inline void vec_add(float& p, const float fx, float& fw) { p += fw * fx; }
+}
+
+namespace INTERACTIONS
+{
+template <> struct simd_kernel<float, float&, GD::vec_add>
+{ static const bool available = true;
+  static void run(float& p, const feature_value* values, const feature_index* indices, size_t n, uint64_t offset,
+                  uint64_t weight_mask, weight* weight_vector, feature_value ft_value, feature_index halfhash)
+  { if (n < simd_min_features)
+      for (size_t i = 0; i < n; i++)
+        GD::vec_add(p, INTERACTION_VALUE(ft_value, values[i]), weight_vector[((indices[i] ^ halfhash) + offset) & weight_mask]);
+    else
+      simd_dot(p, values, indices, n, offset, weight_mask, weight_vector, ft_value, halfhash);
+  }
+};
+}
+
+namespace GD
+{
 
 inline float inline_predict(vw& all, example& ec)
 { float temp = ec.l.simple.initial;
@@ -195,7 +195,7 @@ void save_load(gdmf& d, io_buf& model_file, bool read, bool text)
   uint64_t length = (uint64_t)1 << all->num_bits;
   uint64_t stride_shift = all->reg.stride_shift;
 
-  if(read)
+  if(read && !all->seeded)
   { initialize_regressor(*all);
     if(all->random_weights)
       for (size_t j = 0; j < (length << stride_shift); j++)
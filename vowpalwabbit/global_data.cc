@@ -250,6 +250,7 @@ vw::vw()
   reg_mode = 0;
   current_pass = 0;
   reduction_stack=v_init<LEARNER::base_learner* (*)(vw&)>();
+  enabled_reductions=v_init<LEARNER::base_learner* (*)(vw&)>();
 
   data_filename = "";
   delete_prediction = nullptr;
@@ -263,8 +264,13 @@ vw::vw()
   num_bits = 18;
   default_bits = true;
   daemon = false;
+  daemon_epoll = false;
   num_children = 10;
   save_resume = false;
+  dense_model = false;
+  save_in_background = false;
+  use_sparse_weights = false;
+  pending_save = nullptr;
 
   random_positive_weights = false;
 
@@ -273,6 +279,7 @@ vw::vw()
   power_t = 0.5;
   eta = 0.5; //default learning rate for normalized adaptive updates, this is switched to 10 by default for the other updates (see parse_args.cc)
   numpasses = 1;
+  learner_threads = 1;
 
   final_prediction_sink.begin() = final_prediction_sink.end() = final_prediction_sink.end_array = nullptr;
   raw_prediction = -1;
@@ -323,6 +330,8 @@ vw::vw()
   add_constant = true;
   audit = false;
   reg.weight_vector = nullptr;
+  reg.mapped_length = 0;
+  reg.sparse = nullptr;
   pass_length = (size_t)-1;
   passes_complete = 0;
 
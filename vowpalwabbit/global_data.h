@@ -118,13 +118,18 @@ const version_struct version(PACKAGE_VERSION);
 
 typedef float weight;
 
+struct sparse_weights;
+
 struct regressor
 { weight* weight_vector;
   uint64_t weight_mask; // (stride*(1 << num_bits) -1)
   uint32_t stride_shift;
+  size_t mapped_length; // of the model file weight_vector maps, 0 if it was allocated
+  sparse_weights* sparse; // the weights with --sparse_weights, weight_vector is then nullptr
 };
 
-typedef v_hashmap< substring, features* > feature_dict;
+struct feature_dict;
+struct background_save;
 
 struct dictionary_info
 { char* name;
@@ -180,9 +185,10 @@ public:
 
   uint32_t getK() { return K; }
 
+  // only reads name2id, so the workers of --parse_threads may look labels up at once
   uint64_t get(substring& s)
   { uint64_t hash = uniform_hash((unsigned char*)s.begin, s.end-s.begin, 378401);
-    uint64_t v  =  name2id.get(s, hash);
+    uint64_t v  =  name2id.lookup(s, hash);
     if (v == 0)
       { std::cerr << "warning: missing named label '";
 	for (char*c = s.begin; c != s.end; c++) std::cerr << *c;
@@ -270,6 +276,29 @@ struct shared_data
     }
   }
 
+  // add the example counts and losses accumulated in local (by a learner thread), and clear them there
+  void add_counts(shared_data& local)
+  { t += local.t;
+    weighted_examples += local.weighted_examples;
+    weighted_unlabeled_examples += local.weighted_unlabeled_examples;
+    weighted_labels += local.weighted_labels;
+    sum_loss += local.sum_loss;
+    sum_loss_since_last_dump += local.sum_loss_since_last_dump;
+    total_features += local.total_features;
+    example_number += local.example_number;
+    weighted_holdout_examples += local.weighted_holdout_examples;
+    weighted_holdout_examples_since_last_dump += local.weighted_holdout_examples_since_last_dump;
+    weighted_holdout_examples_since_last_pass += local.weighted_holdout_examples_since_last_pass;
+    holdout_sum_loss += local.holdout_sum_loss;
+    holdout_sum_loss_since_last_dump += local.holdout_sum_loss_since_last_dump;
+    holdout_sum_loss_since_last_pass += local.holdout_sum_loss_since_last_pass;
+    local.t = local.weighted_examples = local.weighted_unlabeled_examples = local.weighted_labels = 0.;
+    local.sum_loss = local.sum_loss_since_last_dump = 0.;
+    local.total_features = local.example_number = 0;
+    local.weighted_holdout_examples = local.weighted_holdout_examples_since_last_dump = local.weighted_holdout_examples_since_last_pass = 0.;
+    local.holdout_sum_loss = local.holdout_sum_loss_since_last_dump = local.holdout_sum_loss_since_last_pass = 0.;
+  }
+
   inline void update_dump_interval(bool progress_add, float progress_arg)
   { sum_loss_since_last_dump = 0.0;
     old_weighted_examples = weighted_examples;
@@ -405,6 +434,7 @@ struct vw
 #else
   HANDLE parse_thread;
 #endif
+  size_t learner_threads; // threads learning from the parser at once, without locking the weights (--learner_threads)
   AllReduceType all_reduce_type;
   AllReduce* all_reduce;
 
@@ -424,6 +454,7 @@ struct vw
   std::string data_filename; // was vm["data"]
 
   bool daemon;
+  bool daemon_epoll; // serve all of a child's clients from one epoll loop, see event_daemon.h
   size_t num_children;
 
   bool save_per_pass;
@@ -434,6 +465,10 @@ struct vw
   bool hessian_on;
 
   bool save_resume;
+  bool dense_model; // save the weights as one array -t can map into memory
+  bool save_in_background;
+  bool use_sparse_weights; // keep the weights in a table, see sparse_weights.h
+  background_save* pending_save; // the model being saved in the background, if any
   std::string id;
 
   version_struct model_file_ver;
@@ -517,6 +552,7 @@ struct vw
   size_t length () { return ((size_t)1) << num_bits; };
 
   v_array<LEARNER::base_learner* (*)(vw&)> reduction_stack;
+  v_array<LEARNER::base_learner* (*)(vw&)> enabled_reductions; // the setups of reduction_stack that made a learner
 
   //Prediction output
   v_array<int> final_prediction_sink; // set to send global predictions to.
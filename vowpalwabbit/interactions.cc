@@ -303,7 +303,7 @@ void eval_count_of_generated_ft(vw& all, example& ec, size_t& new_features_cnt,
 { new_features_cnt = 0;
   new_features_value = 0.;
 
-  v_array<float> results = v_init<float>();
+  v_array<float>& results = ec.interaction_sums;
 
   if (all.permutations)
   { // just multiply precomputed values for all namespaces
@@ -451,8 +451,6 @@ void eval_count_of_generated_ft(vw& all, example& ec, size_t& new_features_cnt,
 #endif
 
   }
-
-  results.delete_v();
 }
 
 
@@ -2,6 +2,7 @@
 
 #include "global_data.h"
 #include "constant.h"
+#include "sparse_weights.h"
 
 /*
  *  Interactions preprocessing and feature combinations generation
@@ -53,14 +54,14 @@ void eval_count_of_generated_ft(vw& all, example& ec, size_t& new_features_cnt,
 
 // 3 template functions to pass T() proper argument (feature idx in regressor, or its coefficient)
 
-template <class R, void (*T)(R&, const float, float&)>
-  inline void call_T( R& dat, weight* weight_vector, const uint64_t weight_mask, const float ft_value, const uint64_t ft_idx)
+template <class R, void (*T)(R&, const float, float&), class W>
+  inline void call_T( R& dat, W& weights, const float ft_value, const uint64_t ft_idx)
 {
-  T(dat, ft_value, weight_vector[ft_idx & weight_mask]);
+  T(dat, ft_value, weights[ft_idx]);
 }
 
-template <class R, void (*T)(R&, float, uint64_t)>
-  inline void call_T( R& dat, weight* /*weight_vector*/, const uint64_t /*weight_mask*/, const float ft_value, const uint64_t ft_idx)
+template <class R, void (*T)(R&, float, uint64_t), class W>
+  inline void call_T( R& dat, W& /*weights*/, const float ft_value, const uint64_t ft_idx)
 {
     T(dat, ft_value, ft_idx);
 }
@@ -89,22 +90,64 @@ inline float INTERACTION_VALUE(float value1, float value2) { return value1*value
 
 // #define GEN_INTER_LOOP
 
-template <class R, class S, void(*T)(R&, float, S), bool audit, void(*audit_func)(R&, const audit_strings*)>
-inline void inner_kernel(R& dat, features::iterator_all& begin, features::iterator_all& end, const uint64_t offset, const uint64_t weight_mask, weight* weight_vector, feature_value ft_value, feature_index halfhash)
+// Vectorized inner loops for particular T.  A specialization sets available and
+// implements run() with the same effect as calling T on each feature in order;
+// see gd.h and gd.cc.
+template <class R, class S, void(*T)(R&, float, S)>
+struct simd_kernel
+{ static const bool available = false;
+  static void run(R&, const feature_value*, const feature_index*, size_t, uint64_t, uint64_t, weight*, feature_value, feature_index) {}
+};
+
+// below this many features the plain loop is faster than calling a kernel
+const size_t simd_min_features = 8;
+
+// AVX-512, AVX2 or scalar versions picked at startup by what the cpu supports
+// (build with -DVW_NO_SIMD for the scalar ones only).
+// p += w[i]*x and w[i] += update*x for each feature, where x = ft_value*value and
+// i = ((index ^ halfhash) + offset) & weight_mask, in the order of the features.
+typedef void (*simd_dot_kernel)(float& p, const feature_value* values, const feature_index* indices, size_t n,
+                                uint64_t offset, uint64_t weight_mask, const weight* weight_vector,
+                                feature_value ft_value, feature_index halfhash);
+typedef void (*simd_update_kernel)(float update, const feature_value* values, const feature_index* indices, size_t n,
+                                   uint64_t offset, uint64_t weight_mask, weight* weight_vector,
+                                   feature_value ft_value, feature_index halfhash);
+extern simd_dot_kernel simd_dot;
+extern simd_update_kernel simd_update;
+
+// runs simd_kernel<R, S, T> on the features if it is available: on a weight vector
+// only, the kernels cannot look weights up in a sparse_weights table
+template <class R, class S, void(*T)(R&, float, S), class W>
+inline bool run_simd_kernel(R&, const feature_value*, const feature_index*, size_t, uint64_t, W&, feature_value, feature_index)
+{ return false;
+}
+
+template <class R, class S, void(*T)(R&, float, S)>
+inline bool run_simd_kernel(R& dat, const feature_value* values, const feature_index* indices, size_t n, uint64_t offset, dense_weights& weights, feature_value ft_value, feature_index halfhash)
+{ if (!simd_kernel<R, S, T>::available)
+    return false;
+  simd_kernel<R, S, T>::run(dat, values, indices, n, offset, weights.mask, weights.vector, ft_value, halfhash);
+  return true;
+}
+
+template <class R, class S, void(*T)(R&, float, S), bool audit, void(*audit_func)(R&, const audit_strings*), class W>
+inline void inner_kernel(R& dat, features::iterator_all& begin, features::iterator_all& end, const uint64_t offset, W& weights, feature_value ft_value, feature_index halfhash)
 {
+  if (!audit && run_simd_kernel<R, S, T>(dat, &begin.value(), &begin.index(), &end.value() - &begin.value(), offset, weights, ft_value, halfhash))
+    return;
   if (audit)
   {
     for (; begin != end; ++begin)
     {
       audit_func(dat, begin.audit().get());
-      call_T<R, T>(dat, weight_vector, weight_mask, INTERACTION_VALUE(ft_value, begin.value()), (begin.index() ^ halfhash) + offset);
+      call_T<R, T>(dat, weights, INTERACTION_VALUE(ft_value, begin.value()), (begin.index() ^ halfhash) + offset);
       audit_func(dat, nullptr);
     }
   }
   else
   {
     for (; begin != end; ++begin)
-      call_T<R, T>(dat, weight_vector, weight_mask, INTERACTION_VALUE(ft_value, begin.value()), (begin.index() ^ halfhash) + offset);
+      call_T<R, T>(dat, weights, INTERACTION_VALUE(ft_value, begin.value()), (begin.index() ^ halfhash) + offset);
   }
 }
 
@@ -113,19 +156,17 @@ inline void inner_kernel(R& dat, features::iterator_all& begin, features::iterat
 // and passes each of them to given function T()
 // it must be in header file to avoid compilation problems
 
- template <class R, class S, void (*T)(R&, float, S), bool audit, void (*audit_func)(R&, const audit_strings*)> // nullptr func can't be used as template param in old compilers
-   inline void generate_interactions(vw& all, example& ec, R& dat) // default value removed to eliminate ambiguity in old complers
+ template <class R, class S, void (*T)(R&, float, S), bool audit, void (*audit_func)(R&, const audit_strings*), class W> // nullptr func can't be used as template param in old compilers
+   inline void generate_interactions(vw& all, example& ec, R& dat, W& weights) // default value removed to eliminate ambiguity in old complers
  {
    features* features_data = ec.feature_space;
 
   // often used values
   const uint64_t offset = ec.ft_offset;
 //    const uint64_t stride_shift = all.reg.stride_shift; // it seems we don't need stride shift in FTRL-like hash
-  const uint64_t  weight_mask   = all.reg.weight_mask;
-  weight* weight_vector = all.reg.weight_vector;
 
   // statedata for generic non-recursive iteration
-  v_array<feature_gen_data > state_data = v_init<feature_gen_data >();
+  v_array<feature_gen_data >& state_data = ec.interaction_state;
 
   feature_gen_data empty_ns_data;  // micro-optimization. don't want to call its constructor each time in loop.
   empty_ns_data.loop_idx = 0;
@@ -134,7 +175,7 @@ inline void inner_kernel(R& dat, features::iterator_all& begin, features::iterat
   empty_ns_data.self_interaction = false;
 
   // loop throw the set of possible interactions
-  for (v_string& ns : all.interactions)
+  for (v_string& ns : ec.interactions ? *ec.interactions : all.interactions)
   { // current list of namespaces to interact.
 
 #ifndef GEN_INTER_LOOP
@@ -166,7 +207,7 @@ inline void inner_kernel(R& dat, features::iterator_all& begin, features::iterat
                       begin += (PROCESS_SELF_INTERACTIONS(ft_value)) ? i : i + 1;
 
                     features::iterator_all end = range.end();
-                    inner_kernel<R, S, T, audit, audit_func>(dat, begin, end, offset, weight_mask, weight_vector, ft_value, halfhash);
+                    inner_kernel<R, S, T, audit, audit_func>(dat, begin, end, offset, weights, ft_value, halfhash);
 
 	            if (audit) audit_func(dat, nullptr);
                   } // end for(fst)
@@ -209,7 +250,7 @@ inline void inner_kernel(R& dat, features::iterator_all& begin, features::iterat
                     begin += (PROCESS_SELF_INTERACTIONS(ft_value)) ? j : j + 1;
 
                   features::iterator_all end = range.end();
-                  inner_kernel<R, S, T, audit, audit_func>(dat, begin, end, offset, weight_mask, weight_vector, ft_value, halfhash);
+                  inner_kernel<R, S, T, audit, audit_func>(dat, begin, end, offset, weights, ft_value, halfhash);
                 } // end for (snd)
                 if(audit) audit_func(dat, nullptr);
               } // end for (fst)
@@ -226,6 +267,7 @@ inline void inner_kernel(R& dat, features::iterator_all& begin, features::iterat
 
         bool must_skip_interaction = false;
         // preparing state data
+        state_data.end() = state_data.begin(); // keeps the space of previous interactions and examples
         feature_gen_data* fgd = state_data.begin();
         feature_gen_data* fgd2; // for further use
         for (namespace_index n : ns)
@@ -345,7 +387,7 @@ inline void inner_kernel(R& dat, features::iterator_all& begin, features::iterat
             begin += start_i;
             features::iterator_all end = range.begin();
             end += fgd2->loop_end + 1;
-            inner_kernel<R, S, T, audit, audit_func>(dat, begin, end, offset, weight_mask, weight_vector, ft_value, halfhash);
+            inner_kernel<R, S, T, audit, audit_func>(dat, begin, end, offset, weights, ft_value, halfhash);
 
             // trying to go back increasing loop_idx of each namespace by the way
 
@@ -364,8 +406,19 @@ inline void inner_kernel(R& dat, features::iterator_all& begin, features::iterat
         } // while do_it
       }
   } // foreach interaction in all.interactions
+}
 
-  state_data.delete_v();
+// the same, on the weight vector or with --sparse_weights on the table
+template <class R, class S, void (*T)(R&, float, S), bool audit, void (*audit_func)(R&, const audit_strings*)>
+inline void generate_interactions(vw& all, example& ec, R& dat)
+{ if (all.reg.sparse != nullptr)
+  { sparse_weights_view weights = { all.reg.sparse, all.reg.weight_mask, all.training };
+    generate_interactions<R, S, T, audit, audit_func>(all, ec, dat, weights);
+  }
+  else
+  { dense_weights weights = { all.reg.weight_vector, all.reg.weight_mask };
+    generate_interactions<R, S, T, audit, audit_func>(all, ec, dat, weights);
+  }
 }
 
 template <class R>
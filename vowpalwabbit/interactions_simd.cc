@@ -0,0 +1,169 @@
+#include "interactions.h"
+
+#if !defined(VW_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define VW_SIMD_X86
+#include <immintrin.h>
+#endif
+
+// The kernels must give exactly the results of the scalar loops they replace:
+// products are formed as there, no multiply-add is fused, and the prediction is
+// summed in feature order.  Only index arithmetic and weight loads are done in
+// parallel.
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#endif
+
+namespace INTERACTIONS
+{
+
+inline uint64_t weight_index(feature_index index, uint64_t offset, uint64_t weight_mask, feature_index halfhash)
+{ return ((index ^ halfhash) + offset) & weight_mask;
+}
+
+void dot_scalar(float& p, const feature_value* values, const feature_index* indices, size_t n,
+                uint64_t offset, uint64_t weight_mask, const weight* weight_vector,
+                feature_value ft_value, feature_index halfhash)
+{ for (size_t i = 0; i < n; i++)
+    p += weight_vector[weight_index(indices[i], offset, weight_mask, halfhash)] * INTERACTION_VALUE(ft_value, values[i]);
+}
+
+void update_scalar(float update, const feature_value* values, const feature_index* indices, size_t n,
+                   uint64_t offset, uint64_t weight_mask, weight* weight_vector,
+                   feature_value ft_value, feature_index halfhash)
+{ for (size_t i = 0; i < n; i++)
+    weight_vector[weight_index(indices[i], offset, weight_mask, halfhash)] += update * INTERACTION_VALUE(ft_value, values[i]);
+}
+
+#ifdef VW_SIMD_X86
+
+__attribute__((target("avx2")))
+void dot_avx2(float& p, const feature_value* values, const feature_index* indices, size_t n,
+              uint64_t offset, uint64_t weight_mask, const weight* weight_vector,
+              feature_value ft_value, feature_index halfhash)
+{ const __m256i vhalfhash = _mm256_set1_epi64x((long long)halfhash);
+  const __m256i voffset = _mm256_set1_epi64x((long long)offset);
+  const __m256i vmask = _mm256_set1_epi64x((long long)weight_mask);
+  const __m128 vft_value = _mm_set1_ps(ft_value);
+  float products[4];
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  { __m256i idx = _mm256_loadu_si256((const __m256i*)(indices + i));
+    idx = _mm256_and_si256(_mm256_add_epi64(_mm256_xor_si256(idx, vhalfhash), voffset), vmask);
+    __m128 w = _mm256_i64gather_ps(weight_vector, idx, sizeof(weight));
+    __m128 x = _mm_mul_ps(vft_value, _mm_loadu_ps(values + i));
+    _mm_storeu_ps(products, _mm_mul_ps(w, x));
+    for (size_t k = 0; k < 4; k++)
+      p += products[k];
+  }
+  dot_scalar(p, values + i, indices + i, n - i, offset, weight_mask, weight_vector, ft_value, halfhash);
+}
+
+// AVX2 has no scatter: compute the updates four at a time, apply them in order
+__attribute__((target("avx2")))
+void update_avx2(float update, const feature_value* values, const feature_index* indices, size_t n,
+                 uint64_t offset, uint64_t weight_mask, weight* weight_vector,
+                 feature_value ft_value, feature_index halfhash)
+{ const __m256i vhalfhash = _mm256_set1_epi64x((long long)halfhash);
+  const __m256i voffset = _mm256_set1_epi64x((long long)offset);
+  const __m256i vmask = _mm256_set1_epi64x((long long)weight_mask);
+  const __m128 vft_value = _mm_set1_ps(ft_value);
+  const __m128 vupdate = _mm_set1_ps(update);
+  uint64_t idx[4];
+  float updates[4];
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+  { __m256i v = _mm256_loadu_si256((const __m256i*)(indices + i));
+    _mm256_storeu_si256((__m256i*)idx, _mm256_and_si256(_mm256_add_epi64(_mm256_xor_si256(v, vhalfhash), voffset), vmask));
+    _mm_storeu_ps(updates, _mm_mul_ps(vupdate, _mm_mul_ps(vft_value, _mm_loadu_ps(values + i))));
+    for (size_t k = 0; k < 4; k++)
+      weight_vector[idx[k]] += updates[k];
+  }
+  update_scalar(update, values + i, indices + i, n - i, offset, weight_mask, weight_vector, ft_value, halfhash);
+}
+
+__attribute__((target("avx512f")))
+void dot_avx512(float& p, const feature_value* values, const feature_index* indices, size_t n,
+                uint64_t offset, uint64_t weight_mask, const weight* weight_vector,
+                feature_value ft_value, feature_index halfhash)
+{ const __m512i vhalfhash = _mm512_set1_epi64((long long)halfhash);
+  const __m512i voffset = _mm512_set1_epi64((long long)offset);
+  const __m512i vmask = _mm512_set1_epi64((long long)weight_mask);
+  const __m256 vft_value = _mm256_set1_ps(ft_value);
+  float products[8];
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+  { __m512i idx = _mm512_loadu_si512((const void*)(indices + i));
+    idx = _mm512_and_si512(_mm512_add_epi64(_mm512_xor_si512(idx, vhalfhash), voffset), vmask);
+    __m256 w = _mm512_mask_i64gather_ps(_mm256_setzero_ps(), 0xff, idx, weight_vector, sizeof(weight));
+    __m256 x = _mm256_mul_ps(vft_value, _mm256_loadu_ps(values + i));
+    _mm256_storeu_ps(products, _mm256_mul_ps(w, x));
+    for (size_t k = 0; k < 8; k++)
+      p += products[k];
+  }
+  dot_scalar(p, values + i, indices + i, n - i, offset, weight_mask, weight_vector, ft_value, halfhash);
+}
+
+// gather, add and scatter eight weights at once unless two features of the batch
+// hit the same weight; then the updates are applied one after the other.
+__attribute__((target("avx512f,avx512cd")))
+void update_avx512(float update, const feature_value* values, const feature_index* indices, size_t n,
+                   uint64_t offset, uint64_t weight_mask, weight* weight_vector,
+                   feature_value ft_value, feature_index halfhash)
+{ const __m512i vhalfhash = _mm512_set1_epi64((long long)halfhash);
+  const __m512i voffset = _mm512_set1_epi64((long long)offset);
+  const __m512i vmask = _mm512_set1_epi64((long long)weight_mask);
+  const __m256 vft_value = _mm256_set1_ps(ft_value);
+  const __m256 vupdate = _mm256_set1_ps(update);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+  { __m512i idx = _mm512_loadu_si512((const void*)(indices + i));
+    idx = _mm512_and_si512(_mm512_add_epi64(_mm512_xor_si512(idx, vhalfhash), voffset), vmask);
+    __m256 u = _mm256_mul_ps(vupdate, _mm256_mul_ps(vft_value, _mm256_loadu_ps(values + i)));
+    __m512i conflicts = _mm512_conflict_epi64(idx);
+    if (_mm512_test_epi64_mask(conflicts, conflicts) == 0)
+    { __m256 w = _mm512_mask_i64gather_ps(_mm256_setzero_ps(), 0xff, idx, weight_vector, sizeof(weight));
+      _mm512_i64scatter_ps(weight_vector, idx, _mm256_add_ps(w, u), sizeof(weight));
+    }
+    else
+    { uint64_t at[8];
+      float updates[8];
+      _mm512_storeu_si512((void*)at, idx);
+      _mm256_storeu_ps(updates, u);
+      for (size_t k = 0; k < 8; k++)
+        weight_vector[at[k]] += updates[k];
+    }
+  }
+  update_scalar(update, values + i, indices + i, n - i, offset, weight_mask, weight_vector, ft_value, halfhash);
+}
+
+#endif
+
+simd_dot_kernel pick_dot()
+{
+#ifdef VW_SIMD_X86
+  __builtin_cpu_init(); // we run before main
+  if (__builtin_cpu_supports("avx512f"))
+    return dot_avx512;
+  if (__builtin_cpu_supports("avx2"))
+    return dot_avx2;
+#endif
+  return dot_scalar;
+}
+
+simd_update_kernel pick_update()
+{
+#ifdef VW_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd"))
+    return update_avx512;
+  if (__builtin_cpu_supports("avx2"))
+    return update_avx2;
+#endif
+  return update_scalar;
+}
+
+simd_dot_kernel simd_dot = pick_dot();
+simd_update_kernel simd_update = pick_update();
+}
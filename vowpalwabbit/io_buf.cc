@@ -4,6 +4,7 @@ individual contributors. All rights reserved.  Released under a BSD (revised)
 license as described in the file LICENSE.
  */
 #include "io_buf.h"
+#include "example_ring.h"
 #ifdef WIN32
 #include <winsock2.h>
 #endif
@@ -17,12 +18,7 @@ size_t buf_read(io_buf &i, char* &pointer, size_t n)
   }
   else // out of bytes, so refill.
   { if (i.head != i.space.begin()) //There exists room to shift.
-    { // Out of buffer so swap to beginning.
-      size_t left = i.space.end() - i.head;
-      memmove(i.space.begin(), i.head, left);
-      i.head = i.space.begin();
-      i.space.end() = i.space.begin() + left;
-    }
+      i.shift(); // Out of buffer so swap to beginning.
     if (i.fill(i.files[i.current]) > 0) // read more bytes from current file if present
       return buf_read(i, pointer, n);// more bytes are read.
     else if (++i.current < i.files.size())
@@ -36,6 +32,20 @@ size_t buf_read(io_buf &i, char* &pointer, size_t n)
   }
 }
 
+int64_t io_buf::file_offset(bool reading)
+{ if (ahead != nullptr || current >= files.size())
+    return -1;
+  int f = reading ? files[current] : files[0]; // flush writes to files[0]
+#ifdef _WIN32
+  int64_t at = _lseeki64(f, 0, SEEK_CUR);
+#else
+  int64_t at = lseek(f, 0, SEEK_CUR);
+#endif
+  if (at < 0) // a pipe or socket
+    return -1;
+  return reading ? at - (space.end() - head) : at + (head - space.begin());
+}
+
 bool isbinary(io_buf &i)
 { if (i.space.end() == i.head)
     if (i.fill(i.files[i.current]) <= 0)
@@ -61,10 +71,7 @@ size_t readto(io_buf &i, char* &pointer, char terminal)
   }
   else
   { if (i.space.end() == i.space.end_array)
-    { size_t left = i.space.end() - i.head;
-      memmove(i.space.begin(), i.head, left);
-      i.head = i.space.begin();
-      i.space.end() = i.space.begin()+left;
+    { i.shift();
       pointer = i.space.end();
     }
     if (i.current < i.files.size() && i.fill(i.files[i.current]) > 0)// more bytes are read.
@@ -139,3 +146,168 @@ void io_buf::close_file_or_socket(int f)
   close(f);
 #endif
 }
+
+/* Read ahead keeps two chunks per io_buf: fill copies from the ready chunk while the
+** reader thread reads the next chunk of the same file.  When the ready chunk runs dry
+** the chunks are swapped and the reader is sent off again, so the parser waits only
+** if it is faster than the disk, the network or zlib.
+*/
+struct read_ahead
+{ io_buf* buf;
+  v_array<int> files; // the named input files
+  MUTEX lock;
+  CV requested;
+  CV done;
+#ifndef _WIN32
+  pthread_t thread;
+#else
+  HANDLE thread;
+#endif
+  bool stop;
+
+  int file; // file being read ahead, or -1
+  bool reading; // the reader owns next
+  bool eof; // file has no more bytes
+  v_array<char> ready;
+  size_t used; // bytes of ready copied out
+  v_array<char> next;
+};
+
+const size_t read_ahead_chunk = 1 << 20;
+
+#ifdef _WIN32
+DWORD WINAPI read_ahead_loop(LPVOID in)
+#else
+void *read_ahead_loop(void *in)
+#endif
+{ read_ahead& r = *(read_ahead*)in;
+  mutex_lock(&r.lock);
+  while (true)
+  { while (!r.reading && !r.stop)
+      condition_variable_wait(&r.requested, &r.lock);
+    if (r.stop)
+      break;
+    int f = r.file;
+    mutex_unlock(&r.lock);
+
+    ssize_t num_read = r.buf->read_file(f, r.next.begin(), r.next.end_array - r.next.begin());
+
+    mutex_lock(&r.lock);
+    r.next.end() = r.next.begin() + (num_read > 0 ? num_read : 0);
+    r.reading = false;
+    condition_variable_signal(&r.done);
+  }
+  mutex_unlock(&r.lock);
+  return 0L;
+}
+
+// call with r.lock held
+void wait_for_reader(read_ahead& r)
+{ while (r.reading)
+    condition_variable_wait(&r.done, &r.lock);
+}
+
+void start_reader(read_ahead& r)
+{ r.reading = true;
+  condition_variable_signal(&r.requested);
+}
+
+void io_buf::enable_read_ahead()
+{ if (ahead != nullptr)
+    return;
+  read_ahead& r = calloc_or_throw<read_ahead>();
+  r.buf = this;
+  r.file = -1;
+  r.ready.resize(read_ahead_chunk);
+  r.next.resize(read_ahead_chunk);
+  initialize_mutex(&r.lock);
+  initialize_condition_variable(&r.requested);
+  initialize_condition_variable(&r.done);
+#ifndef _WIN32
+  pthread_create(&r.thread, nullptr, read_ahead_loop, &r);
+#else
+  r.thread = ::CreateThread(nullptr, 0, static_cast<LPTHREAD_START_ROUTINE>(read_ahead_loop), &r, 0L, nullptr);
+#endif
+  ahead = &r;
+}
+
+void io_buf::read_ahead_file(int f)
+{ mutex_lock(&ahead->lock);
+  ahead->files.push_back(f);
+  mutex_unlock(&ahead->lock);
+}
+
+void io_buf::stop_read_ahead(int f)
+{ read_ahead& r = *ahead;
+  mutex_lock(&r.lock);
+  wait_for_reader(r);
+  r.file = -1;
+  if (f != -1)
+    for (size_t i = 0; i < r.files.size(); i++)
+      if (r.files[i] == f)
+      { r.files[i] = r.files.last();
+        r.files.pop();
+        break;
+      }
+  mutex_unlock(&r.lock);
+}
+
+ssize_t io_buf::fill_ahead(int f)
+{ read_ahead& r = *ahead;
+  mutex_lock(&r.lock);
+  bool named = false;
+  for (int g : r.files)
+    named |= g == f;
+  if (!named)
+  { mutex_unlock(&r.lock);
+    ssize_t num_read = read_file(f, space.end(), space.end_array - space.end());
+    if (num_read < 0)
+      return 0;
+    space.end() += num_read;
+    return num_read;
+  }
+
+  if (r.file != f)
+  { wait_for_reader(r);
+    r.file = f;
+    r.eof = false;
+    r.ready.end() = r.ready.begin();
+    r.used = 0;
+    start_reader(r);
+  }
+  if (r.used == r.ready.size() && !r.eof)
+  { wait_for_reader(r);
+    std::swap(r.ready, r.next);
+    r.used = 0;
+    r.eof = r.ready.size() == 0;
+    if (!r.eof)
+      start_reader(r);
+  }
+  size_t n = std::min(r.ready.size() - r.used, (size_t)(space.end_array - space.end()));
+  memcpy(space.end(), r.ready.begin() + r.used, n);
+  r.used += n;
+  space.end() += n;
+  mutex_unlock(&r.lock);
+  return n;
+}
+
+void io_buf::end_read_ahead()
+{ read_ahead& r = *ahead;
+  mutex_lock(&r.lock);
+  wait_for_reader(r);
+  r.stop = true;
+  condition_variable_signal(&r.requested);
+  mutex_unlock(&r.lock);
+#ifndef _WIN32
+  pthread_join(r.thread, nullptr);
+#else
+  ::WaitForSingleObject(r.thread, INFINITE);
+  ::CloseHandle(r.thread);
+#endif
+  r.files.delete_v();
+  r.ready.delete_v();
+  r.next.delete_v();
+  delete_mutex(&r.lock);
+  free(&r);
+  ahead = nullptr;
+}
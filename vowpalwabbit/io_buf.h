@@ -50,6 +50,8 @@ license as described in the file LICENSE.
 ** This is done to avoid reallocating arrays as much as possible.
 */
 
+struct read_ahead;
+
 class io_buf
 {
 public:
@@ -65,6 +67,9 @@ public:
   bool verify_hash;
   uint32_t hash;
 
+  // background reader of input files, see enable_read_ahead
+  read_ahead* ahead;
+
   static const int READ = 1;
   static const int WRITE = 2;
 
@@ -80,8 +85,25 @@ public:
     head = space.begin();
     verify_hash = false;
     hash = 0;
+    ahead = nullptr;
   }
 
+  // Read the named input files opened from now on in a background thread: while the
+  // parser works through the bytes of one chunk the next one is being read (and
+  // decompressed by comp_io_buf).  Sockets and stdin are still read on demand.
+  void enable_read_ahead();
+
+  // f is a named input file and may be read ahead
+  void read_ahead_file(int f);
+
+  // Wait for any read in flight and drop what was read ahead, before the position of
+  // a file changes or a file goes away.  If f != -1 it is no longer read ahead.
+  void stop_read_ahead(int f = -1);
+
+  ssize_t fill_ahead(int f);
+
+  void end_read_ahead();
+
   virtual int open_file(const char* name, bool stdin_off, int flag=READ)
   { int ret = -1;
     switch(flag)
@@ -102,7 +124,10 @@ public:
           ret = fileno(stdin);
 #endif
         if(ret!=-1)
-          files.push_back(ret);
+        { files.push_back(ret);
+          if (ahead != nullptr && *name != '\0')
+            read_ahead_file(ret);
+        }
         break;
 
       case WRITE:
@@ -125,7 +150,8 @@ public:
   }
 
   virtual void reset_file(int f)
-  {
+  { if (ahead != nullptr)
+      stop_read_ahead();
 #ifdef _WIN32
     _lseek(f, 0, SEEK_SET);
 #else
@@ -140,7 +166,9 @@ public:
   }
 
   virtual ~io_buf()
-  { files.delete_v();
+  { if (ahead != nullptr)
+      end_read_ahead();
+    files.delete_v();
     space.delete_v();
   }
 
@@ -154,7 +182,7 @@ public:
 
   static ssize_t read_file_or_socket(int f, void* buf, size_t nbytes);
 
-  ssize_t fill(int f)
+  virtual ssize_t fill(int f)
   { // if the loaded values have reached the allocated space
     if (space.end_array - space.end() == 0)
     { // reallocate to twice as much space
@@ -162,6 +190,8 @@ public:
       space.resize(2 * (space.end_array - space.begin()));
       head = space.begin()+head_loc;
     }
+    if (ahead != nullptr)
+      return fill_ahead(f);
     // read more bytes from file up to the remaining allocated space
     ssize_t num_read = read_file(f, space.end(), space.end_array - space.end());
      if (num_read >= 0)
@@ -173,6 +203,14 @@ public:
       return 0;
   }
 
+  // move the unread values [head, space.end) to space.begin to make room for fill
+  virtual void shift()
+  { size_t left = space.end() - head;
+    memmove(space.begin(), head, left);
+    head = space.begin();
+    space.end() = space.begin() + left;
+  }
+
   virtual ssize_t write_file(int f, const void* buf, size_t nbytes)
   { return write_file_or_socket(f, buf, nbytes); }
 
@@ -188,14 +226,26 @@ public:
 
   virtual bool close_file()
   { if(files.size()>0)
-    { close_file_or_socket(files.pop());
+    { close_file_or_socket(detach_file());
       return true;
     }
     return false;
   }
 
+  // Take the last file off files, once nothing reads it ahead any more, and return it
+  // still open.
+  virtual int detach_file()
+  { if (ahead != nullptr)
+      stop_read_ahead(files.last());
+    return files.pop();
+  }
+
   virtual bool compressed() { return false; }
 
+  // The offset in the file of the next byte read (reading) or written, or -1 unless
+  // bytes go straight between the buffer and a seekable file.
+  virtual int64_t file_offset(bool reading);
+
   static void close_file_or_socket(int f);
 
   void close_files()
@@ -28,12 +28,9 @@ license as described in the file LICENSE.
 #include "gd.h"
 #include "rand48.h"
 #include "reductions.h"
+#include "parallel.h"
+#include "lda_simd.h"
 
-#include <boost/version.hpp>
-
-#if BOOST_VERSION >= 105600
-#include <boost/align/is_aligned.hpp>
-#endif
 using namespace std;
 
 enum lda_math_mode { USE_SIMD, USE_PRECISE, USE_FAST_APPROX };
@@ -46,6 +43,29 @@ public:
   bool operator<(const index_feature b) const { return f.weight_index < b.f.weight_index; }
 };
 
+// The words of a minibatch are split into shards by their weights, so that a word's
+// weights are only ever touched by one thread; its contributions to total_new are
+// summed per shard, and the shards in order, whatever the number of threads.
+const size_t lda_shards = 64;
+
+// With --lda_sparse k a word's weights keep, where u_for_w would be, a scale of its
+// lambda and its k most likely topics: their u_for_w and then the topics themselves.
+// The scale is 0 until the word is first seen.  A token only updates and reads its
+// word's k topics, and a minibatch only scales the lambda of its words; each time a
+// word is seen, its topics are chosen again among the k it has and k others, which
+// take turns.
+
+// what lda_loop and a word's topics are worked out in, one for each thread
+struct lda_scratch
+{ v_array<float> Elogtheta;
+  v_array<float> new_gamma;
+  v_array<float> old_gamma;
+  v_array<size_t> candidates; // topics
+  v_array<float> candidate_u;
+  v_array<float> candidate_norm;
+  v_array<size_t> order; // of the candidates
+};
+
 struct lda
 { size_t topics;
   float lda_alpha;
@@ -54,8 +74,11 @@ struct lda
   float lda_epsilon;
   size_t minibatch;
   lda_math_mode mmode;
+  size_t threads;
+  size_t u_offset; // of a word's u_for_w among its weights
+  size_t sparse_topics; // --lda_sparse, 0 for all
 
-  v_array<float> Elogtheta;
+  v_array<lda_scratch> scratch;
   v_array<float> decay_levels;
   v_array<float> total_new;
   v_array<example *> examples;
@@ -64,6 +87,9 @@ struct lda
   v_array<float> digammas;
   v_array<float> v;
   std::vector<index_feature> sorted_features;
+  v_array<size_t> shard_words[lda_shards]; // the first of each word's sorted_features
+  v_array<float> shard_new; // total_new of each shard
+  v_array<float> scores; // of the minibatch's documents
 
   bool total_lambda_init;
 
@@ -80,23 +106,9 @@ struct lda
   inline float lgamma(float x);
   inline float powf(float x, float p);
   inline void expdigammify(vw &all, float *gamma);
-  inline void expdigammify_2(vw &all, float *gamma, float *norm);
+  inline void expdigammify_2(float *gamma, float *norm, size_t n);
 };
 
-// #define VW_NO_INLINE_SIMD
-
-namespace
-{
-inline bool is_aligned16(void *ptr)
-{
-#if BOOST_VERSION >= 105600
-  return boost::alignment::is_aligned(16, ptr);
-#else
-  return ((reinterpret_cast<uintptr_t>(ptr) & 0x0f) == 0);
-#endif
-}
-}
-
 namespace ldamath
 {
 inline float fastlog2(float x)
@@ -148,192 +160,6 @@ inline float fastdigamma(float x)
   return -(1.0f + 2.0f * x) / (x * (1.0f + x)) - (13.0f + 6.0f * x) / (12.0f * twopx * twopx) + logterm;
 }
 
-#if !defined(VW_NO_INLINE_SIMD)
-
-#if defined(__SSE2__) || defined(__SSE3__) || defined(__SSE4_1__)
-
-// Include headers for the various SSE versions:
-#if defined(__SSE2__)
-#include <emmintrin.h>
-#endif
-#if defined(__SSE3__)
-#include <tmmintrin.h>
-#endif
-#if defined(__SSE4_1__)
-#include <smmintrin.h>
-#endif
-
-#define HAVE_SIMD_MATHMODE
-
-typedef __m128 v4sf;
-typedef __m128i v4si;
-
-inline v4sf v4si_to_v4sf(v4si x) { return _mm_cvtepi32_ps(x); }
-
-inline v4si v4sf_to_v4si(v4sf x) { return _mm_cvttps_epi32(x); }
-
-// Extract v[idx]
-template <const int idx> float v4sf_index(const v4sf x)
-{
-#if defined(__SSE4_1__)
-  float ret;
-  uint32_t val;
-
-  val = _mm_extract_ps(x, idx);
-  // Portably convert uint32_t bit pattern to float. Optimizers will generally
-  // make this disappear.
-  memcpy(&ret, &val, sizeof(uint32_t));
-  return ret;
-#else
-  return _mm_cvtss_f32(_mm_shuffle_ps(x, x, _MM_SHUFFLE(idx, idx, idx, idx)));
-#endif
-}
-
-// Specialization for the 0'th element
-template <> float v4sf_index<0>(const v4sf x) { return _mm_cvtss_f32(x); }
-
-inline const v4sf v4sfl(const float x) { return _mm_set1_ps(x); }
-
-inline const v4si v4sil(const uint32_t x) { return _mm_set1_epi32(x); }
-
-inline v4sf vfastpow2(const v4sf p)
-{ v4sf ltzero = _mm_cmplt_ps(p, v4sfl(0.0f));
-  v4sf offset = _mm_and_ps(ltzero, v4sfl(1.0f));
-  v4sf lt126 = _mm_cmplt_ps(p, v4sfl(-126.0f));
-  v4sf clipp = _mm_andnot_ps(lt126, p) + _mm_and_ps(lt126, v4sfl(-126.0f));
-  v4si w = v4sf_to_v4si(clipp);
-  v4sf z = clipp - v4si_to_v4sf(w) + offset;
-
-  const v4sf c_121_2740838 = v4sfl(121.2740838f);
-  const v4sf c_27_7280233 = v4sfl(27.7280233f);
-  const v4sf c_4_84252568 = v4sfl(4.84252568f);
-  const v4sf c_1_49012907 = v4sfl(1.49012907f);
-
-  v4sf v = v4sfl(1 << 23) * (clipp + c_121_2740838 + c_27_7280233 / (c_4_84252568 - z) - c_1_49012907 * z);
-
-  return _mm_castsi128_ps(v4sf_to_v4si(v));
-}
-
-inline v4sf vfastexp(const v4sf p)
-{ const v4sf c_invlog_2 = v4sfl(1.442695040f);
-
-  return vfastpow2(c_invlog_2 * p);
-}
-
-inline v4sf vfastlog2(v4sf x)
-{ v4si vx_i = _mm_castps_si128(x);
-  v4sf mx_f = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(vx_i, v4sil(0x007FFFFF)), v4sil(0x3f000000)));
-  v4sf y = v4si_to_v4sf(vx_i) * v4sfl(1.1920928955078125e-7f);
-
-  const v4sf c_124_22551499 = v4sfl(124.22551499f);
-  const v4sf c_1_498030302 = v4sfl(1.498030302f);
-  const v4sf c_1_725877999 = v4sfl(1.72587999f);
-  const v4sf c_0_3520087068 = v4sfl(0.3520887068f);
-
-  return y - c_124_22551499 - c_1_498030302 * mx_f - c_1_725877999 / (c_0_3520087068 + mx_f);
-}
-
-inline v4sf vfastlog(v4sf x)
-{ const v4sf c_0_69314718 = v4sfl(0.69314718f);
-
-  return c_0_69314718 * vfastlog2(x);
-}
-
-inline v4sf vfastdigamma(v4sf x)
-{ v4sf twopx = v4sfl(2.0f) + x;
-  v4sf logterm = vfastlog(twopx);
-
-  return (v4sfl(-48.0f) + x * (v4sfl(-157.0f) + x * (v4sfl(-127.0f) - v4sfl(30.0f) * x))) /
-         (v4sfl(12.0f) * x * (v4sfl(1.0f) + x) * twopx * twopx) +
-         logterm;
-}
-
-void vexpdigammify(vw &all, float *gamma, const float underflow_threshold)
-{ float extra_sum = 0.0f;
-  v4sf sum = v4sfl(0.0f);
-  float *fp;
-  const float *fpend = gamma + all.lda;
-
-  // Iterate through the initial part of the array that isn't 128-bit SIMD
-  // aligned.
-  for (fp = gamma; fp < fpend && !is_aligned16(fp); ++fp)
-  { extra_sum += *fp;
-    *fp = fastdigamma(*fp);
-  }
-
-  // Rip through the aligned portion...
-  for (; is_aligned16(fp) && fp + 4 < fpend; fp += 4)
-  { v4sf arg = _mm_load_ps(fp);
-    sum += arg;
-    arg = vfastdigamma(arg);
-    _mm_store_ps(fp, arg);
-  }
-
-  for (; fp < fpend; ++fp)
-  { extra_sum += *fp;
-    *fp = fastdigamma(*fp);
-  }
-
-#if defined(__SSE3__) || defined(__SSE4_1__)
-  // Do two horizontal adds on sum, extract the total from the 0 element:
-  sum = _mm_hadd_ps(sum, sum);
-  sum = _mm_hadd_ps(sum, sum);
-  extra_sum += v4sf_index<0>(sum);
-#else
-  extra_sum += v4sf_index<0>(sum) + v4sf_index<1>(sum) + v4sf_index<2>(sum) + v4sf_index<3>(sum);
-#endif
-
-  extra_sum = fastdigamma(extra_sum);
-  sum = v4sfl(extra_sum);
-
-  for (fp = gamma; fp < fpend && !is_aligned16(fp); ++fp)
-  { *fp = fmax(underflow_threshold, fastexp(*fp - extra_sum));
-  }
-
-  for (; is_aligned16(fp) && fp + 4 < fpend; fp += 4)
-  { v4sf arg = _mm_load_ps(fp);
-    arg -= sum;
-    arg = vfastexp(arg);
-    arg = _mm_max_ps(v4sfl(underflow_threshold), arg);
-    _mm_store_ps(fp, arg);
-  }
-
-  for (; fp < fpend; ++fp)
-  { *fp = fmax(underflow_threshold, fastexp(*fp - extra_sum));
-  }
-}
-
-void vexpdigammify_2(vw &all, float *gamma, const float *norm, const float underflow_threshold)
-{ float *fp;
-  const float *np;
-  const float *fpend = gamma + all.lda;
-
-  for (fp = gamma, np = norm; fp < fpend && !is_aligned16(fp); ++fp, ++np)
-  { *fp = fmax(underflow_threshold, fastexp(fastdigamma(*fp) - *np));
-  }
-
-  for (; is_aligned16(fp) && fp + 4 < fpend; fp += 4, np += 4)
-  { v4sf arg = _mm_load_ps(fp);
-    arg = vfastdigamma(arg);
-    v4sf vnorm = _mm_loadu_ps(np);
-    arg -= vnorm;
-    arg = vfastexp(arg);
-    arg = _mm_max_ps(v4sfl(underflow_threshold), arg);
-    _mm_store_ps(fp, arg);
-  }
-
-  for (; fp < fpend; ++fp, ++np)
-  { *fp = fmax(underflow_threshold, fastexp(fastdigamma(*fp) - *np));
-  }
-}
-
-#else
-// PLACEHOLDER for future ARM NEON code
-// Also remember to define HAVE_SIMD_MATHMODE
-#endif
-
-#endif // !VW_NO_INLINE_SIMD
-
 // Templates for common code shared between the three math modes (SIMD, fast approximations
 // and accurate).
 //
@@ -341,7 +167,7 @@ void vexpdigammify_2(vw &all, float *gamma, const float *norm, const float under
 //
 // mtype == USE_PRECISE: Use the accurate computation for lgamma, digamma.
 // mtype == USE_FAST_APPROX: Use the fast approximations for lgamma, digamma.
-// mtype == USE_SIMD: Use CPU SIMD instruction
+// mtype == USE_SIMD: Use the fast approximations, with LDA_SIMD's widest kernels for the loops over topics
 //
 // The generic template is specialized for the particular accuracy setting.
 
@@ -394,29 +220,17 @@ template <typename T, const lda_math_mode mtype> inline void expdigammify(vw &al
   });
 }
 template <> inline void expdigammify<float, USE_SIMD>(vw &all, float *gamma, float threshold, float)
-{
-#if defined(HAVE_SIMD_MATHMODE)
-  vexpdigammify(all, gamma, threshold);
-#else
-  // Do something sensible if SIMD math isn't available:
-  expdigammify<float, USE_FAST_APPROX>(all, gamma, threshold, 0.0);
-#endif
+{ LDA_SIMD::best->expdigammify(gamma, all.lda, threshold);
 }
 
 template <typename T, const lda_math_mode mtype>
-inline void expdigammify_2(vw &all, T *gamma, T *norm, const T threshold)
-{ std::transform(gamma, gamma + all.lda, norm, gamma, [threshold](float g, float n)
+inline void expdigammify_2(size_t n, T *gamma, T *norm, const T threshold)
+{ std::transform(gamma, gamma + n, norm, gamma, [threshold](float g, float n)
   { return fmax(threshold, exponential<T, mtype>(digamma<T, mtype>(g) - n));
   });
 }
-template <> inline void expdigammify_2<float, USE_SIMD>(vw &all, float *gamma, float *norm, const float threshold)
-{
-#if defined(HAVE_SIMD_MATHMODE)
-  vexpdigammify_2(all, gamma, norm, threshold);
-#else
-  // Do something sensible if SIMD math isn't available:
-  expdigammify_2<float, USE_FAST_APPROX>(all, gamma, norm, threshold);
-#endif
+template <> inline void expdigammify_2<float, USE_SIMD>(size_t n, float *gamma, float *norm, const float threshold)
+{ LDA_SIMD::best->expdigammify_2(gamma, norm, n, threshold);
 }
 } // namespace ldamath
 
@@ -492,16 +306,16 @@ void lda::expdigammify(vw &all, float *gamma)
   }
 }
 
-void lda::expdigammify_2(vw &all, float *gamma, float *norm)
+void lda::expdigammify_2(float *gamma, float *norm, size_t n)
 { switch (mmode)
   { case USE_FAST_APPROX:
-      ldamath::expdigammify_2<float, USE_FAST_APPROX>(all, gamma, norm, underflow_threshold());
+      ldamath::expdigammify_2<float, USE_FAST_APPROX>(n, gamma, norm, underflow_threshold());
       break;
     case USE_PRECISE:
-      ldamath::expdigammify_2<float, USE_PRECISE>(all, gamma, norm, underflow_threshold());
+      ldamath::expdigammify_2<float, USE_PRECISE>(n, gamma, norm, underflow_threshold());
       break;
     case USE_SIMD:
-      ldamath::expdigammify_2<float, USE_SIMD>(all, gamma, norm, underflow_threshold());
+      ldamath::expdigammify_2<float, USE_SIMD>(n, gamma, norm, underflow_threshold());
       break;
     default:
       std::cerr << "lda::expdigammify_2: Trampled or invalid math mode, aborting" << std::endl;
@@ -546,14 +360,85 @@ float theta_kl(lda &l, v_array<float> &Elogtheta, float *gamma)
 }
 
 static inline float find_cw(lda &l, float *u_for_w, float *v)
-{ return 1.0f / std::inner_product(u_for_w, u_for_w + l.topics, v, 0.0f);
+{ if (l.mmode == USE_SIMD)
+    return 1.0f / LDA_SIMD::best->dot(u_for_w, v, l.topics);
+  return 1.0f / std::inner_product(u_for_w, u_for_w + l.topics, v, 0.0f);
 }
 
-namespace
-{
-// Effectively, these are static and not visible outside the compilation unit.
-v_array<float> new_gamma = v_init<float>();
-v_array<float> old_gamma = v_init<float>();
+inline float &word_scale(lda &l, weight *weights_for_w) { return weights_for_w[l.u_offset]; }
+inline float *sparse_u(lda &l, weight *weights_for_w) { return weights_for_w + l.u_offset + 1; }
+inline float *sparse_topic(lda &l, weight *weights_for_w) { return weights_for_w + l.u_offset + 1 + l.sparse_topics; }
+
+static inline float find_cw_sparse(lda &l, weight *weights_for_w, float *v)
+{ float *u = sparse_u(l, weights_for_w);
+  float *topic = sparse_topic(l, weights_for_w);
+  float sum = 0.f;
+  for (size_t j = 0; j < l.sparse_topics; j++)
+    sum += u[j] * v[(size_t)topic[j]];
+  return 1.0f / sum;
+}
+
+// multiplies the word's scale in the weights
+void fold_scale(lda &l, weight *weights_for_w)
+{ float &scale = word_scale(l, weights_for_w);
+  if (scale == 0.f || scale == 1.f)
+    return;
+  for (size_t k = 0; k < l.topics; k++)
+    weights_for_w[k] *= scale;
+  scale = 1.f;
+}
+
+void scale_word(lda &l, weight *weights_for_w, float factor)
+{ float &scale = word_scale(l, weights_for_w);
+  scale = (scale == 0.f ? 1.f : scale) * factor;
+  if (scale < 1e-10f) // before it underflows, and 0 would read as a word not seen yet
+  { for (size_t k = 0; k < l.topics; k++)
+      weights_for_w[k] *= scale;
+    scale = 1.f;
+  }
+}
+
+// the k topics of largest u_for_w, among the word's topics and k others (all topics
+// the first time), ordered by topic
+void choose_topics(lda &l, lda_scratch &scratch, weight *weights_for_w, uint64_t slot, bool first)
+{ size_t k = l.sparse_topics;
+  float *u = sparse_u(l, weights_for_w);
+  float *topic = sparse_topic(l, weights_for_w);
+  v_array<size_t> &candidates = scratch.candidates;
+  candidates.erase();
+  if (first)
+    for (size_t t = 0; t < l.topics; t++)
+      candidates.push_back(t);
+  else
+  { size_t next = (size_t)(slot + (uint64_t)l.example_t * k);
+    for (size_t j = 0; j < k; j++)
+    { candidates.push_back((size_t)topic[j]);
+      candidates.push_back((next + j) % l.topics);
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.end() = std::unique(candidates.begin(), candidates.end());
+  }
+
+  float scale = word_scale(l, weights_for_w);
+  scratch.candidate_u.erase();
+  scratch.candidate_norm.erase();
+  scratch.order.erase();
+  for (size_t i = 0; i < candidates.size(); i++)
+  { scratch.candidate_u.push_back(scale * weights_for_w[candidates[i]] + l.lda_rho);
+    scratch.candidate_norm.push_back(l.digammas[candidates[i]]);
+    scratch.order.push_back(i);
+  }
+  l.expdigammify_2(scratch.candidate_u.begin(), scratch.candidate_norm.begin(), candidates.size());
+
+  float *candidate_u = scratch.candidate_u.begin();
+  std::nth_element(scratch.order.begin(), scratch.order.begin() + k, scratch.order.end(), [candidate_u](size_t a, size_t b)
+  { return candidate_u[a] > candidate_u[b] || (candidate_u[a] == candidate_u[b] && a < b);
+  });
+  std::sort(scratch.order.begin(), scratch.order.begin() + k);
+  for (size_t j = 0; j < k; j++)
+  { u[j] = candidate_u[scratch.order[j]];
+    topic[j] = (float)candidates[scratch.order[j]];
+  }
 }
 
 // Returns an estimate of the part of the variational bound that
@@ -561,8 +446,10 @@ v_array<float> old_gamma = v_init<float>();
 // setting of lambda based on the document passed in. The value is
 // divided by the total number of words in the document This can be
 // used as a (possibly very noisy) estimate of held-out likelihood.
-float lda_loop(lda &l, v_array<float> &Elogtheta, float *v, weight *weights, example *ec, float)
-{ new_gamma.erase();
+float lda_loop(lda &l, lda_scratch &scratch, float *v, weight *weights, example *ec, float)
+{ v_array<float> &new_gamma = scratch.new_gamma;
+  v_array<float> &old_gamma = scratch.old_gamma;
+  new_gamma.erase();
   old_gamma.erase();
 
   for (size_t i = 0; i < l.topics; i++)
@@ -588,13 +475,23 @@ float lda_loop(lda &l, v_array<float> &Elogtheta, float *v, weight *weights, exa
     doc_length = 0;
     for (features& fs : *ec)
       { for (features::iterator& f : fs)
-          { float *u_for_w = &weights[(f.index() & l.all->reg.weight_mask) + l.topics + 1];
-            float c_w = find_cw(l, u_for_w, v);
-            xc_w = c_w * f.value();
+          { weight *weights_for_w = &weights[f.index() & l.all->reg.weight_mask];
+            float c_w;
+            if (l.sparse_topics > 0)
+            { c_w = find_cw_sparse(l, weights_for_w, v);
+              xc_w = c_w * f.value();
+              float *u = sparse_u(l, weights_for_w);
+              float *topic = sparse_topic(l, weights_for_w);
+              for (size_t j = 0; j < l.sparse_topics; j++)
+                new_gamma[(size_t)topic[j]] += xc_w * u[j];
+            }
+            else
+            { float *u_for_w = weights_for_w + l.u_offset;
+              c_w = find_cw(l, u_for_w, v);
+              xc_w = c_w * f.value();
+              LDA_SIMD::best->axpy(new_gamma.begin(), xc_w, u_for_w, l.topics);
+            }
             score += -f.value() * log(c_w);
-            size_t max_k = l.topics;
-            for (size_t k = 0; k < max_k; k++)
-              new_gamma[k] += xc_w * u_for_w[k];
             word_count++;
             doc_length += f.value();
           }
@@ -609,7 +506,7 @@ float lda_loop(lda &l, v_array<float> &Elogtheta, float *v, weight *weights, exa
   memcpy(ec->topic_predictions.begin(), new_gamma.begin(), l.topics * sizeof(float));
   ec->topic_predictions.end() = ec->topic_predictions.begin() + l.topics;
 
-  score += theta_kl(l, Elogtheta, new_gamma.begin());
+  score += theta_kl(l, scratch.Elogtheta, new_gamma.begin());
 
   return score / doc_length;
 }
@@ -629,7 +526,7 @@ void save_load(lda &l, io_buf &model_file, bool read, bool text)
   uint64_t length = (uint64_t)1 << all->num_bits;
   uint64_t stride = (uint64_t)1 << all->reg.stride_shift;
 
-  if (read)
+  if (read && !all->seeded)
   { initialize_regressor(*all);
     for (uint64_t j = 0; j < stride * length; j += stride)
     { for (size_t k = 0; k < all->lda; k++)
@@ -642,6 +539,10 @@ void save_load(lda &l, io_buf &model_file, bool read, bool text)
     }
   }
 
+  if (!read && l.sparse_topics > 0)
+    for (uint64_t j = 0; j < stride * length; j += stride)
+      fold_scale(l, &all->reg.weight_vector[j]);
+
   if (model_file.files.size() > 0)
   { uint64_t i = 0;
     stringstream msg;
@@ -729,28 +630,57 @@ void learn_batch(lda &l)
   }
 
   weight *weights = l.all->reg.weight_vector;
+  size_t threads = min(l.threads, batch_size);
 
+  for (size_t shard = 0; shard < lda_shards; shard++)
+    l.shard_words[shard].erase();
   uint64_t last_weight_index = -1;
-  for (index_feature *s = &l.sorted_features[0]; s <= &l.sorted_features.back(); s++)
-  { if (last_weight_index == s->f.weight_index)
+  for (size_t i = 0; i < l.sorted_features.size(); i++)
+  { uint64_t weight_index = l.sorted_features[i].f.weight_index;
+    if (last_weight_index == weight_index)
       continue;
-    last_weight_index = s->f.weight_index;
-    float *weights_for_w = &(weights[s->f.weight_index & l.all->reg.weight_mask]);
-    float decay_component =
-      l.decay_levels.end()[-2] - l.decay_levels.end()[(int)(-1 - l.example_t + weights_for_w[l.all->lda])];
-    float decay = fmin(1.0f, correctedExp(decay_component));
-    float *u_for_w = weights_for_w + l.all->lda + 1;
+    last_weight_index = weight_index;
+    uint64_t slot = (weight_index & l.all->reg.weight_mask) >> l.all->reg.stride_shift;
+    l.shard_words[slot % lda_shards].push_back(i);
+  }
+
+  auto decay_words = [&](size_t t)
+  { for (size_t shard = t; shard < lda_shards; shard += threads)
+      for (size_t i : l.shard_words[shard])
+      { index_feature *s = &l.sorted_features[i];
+        float *weights_for_w = &(weights[s->f.weight_index & l.all->reg.weight_mask]);
+        float decay_component =
+          l.decay_levels.end()[-2] - l.decay_levels.end()[(int)(-1 - l.example_t + weights_for_w[l.all->lda])];
+        float decay = fmin(1.0f, correctedExp(decay_component));
+        float *u_for_w = weights_for_w + l.u_offset;
+
+        weights_for_w[l.all->lda] = (float)l.example_t;
+        if (l.sparse_topics > 0)
+        { bool first = word_scale(l, weights_for_w) == 0.f;
+          scale_word(l, weights_for_w, decay);
+          choose_topics(l, l.scratch[t], weights_for_w,
+                        (s->f.weight_index & l.all->reg.weight_mask) >> l.all->reg.stride_shift, first);
+          continue;
+        }
+        for (size_t k = 0; k < l.all->lda; k++)
+        { weights_for_w[k] *= decay;
+          u_for_w[k] = weights_for_w[k] + l.lda_rho;
+        }
+        l.expdigammify_2(u_for_w, l.digammas.begin(), l.topics);
+      }
+  };
+  PARALLEL::in_parallel(threads, decay_words);
 
-    weights_for_w[l.all->lda] = (float)l.example_t;
-    for (size_t k = 0; k < l.all->lda; k++)
-    { weights_for_w[k] *= decay;
-      u_for_w[k] = weights_for_w[k] + l.lda_rho;
-    }
-    l.expdigammify_2(*l.all, u_for_w, l.digammas.begin());
-  }
+  // the documents are independent given u_for_w
+  l.scores.resize(batch_size);
+  auto infer = [&](size_t t)
+  { for (size_t d = t; d < batch_size; d += threads)
+      l.scores[d] = lda_loop(l, l.scratch[t], &(l.v[d * l.all->lda]), weights, l.examples[d], l.all->power_t);
+  };
+  PARALLEL::in_parallel(threads, infer);
 
   for (size_t d = 0; d < batch_size; d++)
-  { float score = lda_loop(l, l.Elogtheta, &(l.v[d * l.all->lda]), weights, l.examples[d], l.all->power_t);
+  { float score = l.scores[d];
     if (l.all->audit)
       GD::print_audit_features(*l.all, *l.examples[d]);
     // If the doc is empty, give it loss of 0.
@@ -761,28 +691,57 @@ void learn_batch(lda &l)
     return_simple_example(*l.all, nullptr, *l.examples[d]);
   }
 
-  for (index_feature *s = &l.sorted_features[0]; s <= &l.sorted_features.back();)
-  { index_feature *next = s + 1;
-    while (next <= &l.sorted_features.back() && next->f.weight_index == s->f.weight_index)
-      next++;
-
-    float *word_weights = &(weights[s->f.weight_index & l.all->reg.weight_mask]);
-    for (size_t k = 0; k < l.all->lda; k++)
-    { float new_value = minuseta * word_weights[k];
-      word_weights[k] = new_value;
-    }
+  auto update_words = [&](size_t t)
+  { for (size_t shard = t; shard < lda_shards; shard += threads)
+    { float *total_new = &l.shard_new[shard * l.all->lda];
+      memset(total_new, 0, sizeof(float) * l.all->lda);
+      for (size_t i : l.shard_words[shard])
+      { index_feature *s = &l.sorted_features[i];
+        index_feature *next = s + 1;
+        while (next <= &l.sorted_features.back() && next->f.weight_index == s->f.weight_index)
+          next++;
+
+        float *word_weights = &(weights[s->f.weight_index & l.all->reg.weight_mask]);
+        if (l.sparse_topics > 0)
+        { scale_word(l, word_weights, minuseta);
+          float scale = word_scale(l, word_weights);
+          float *u = sparse_u(l, word_weights);
+          float *topic = sparse_topic(l, word_weights);
+          for (; s != next; s++)
+          { float *v_s = &(l.v[s->document * l.all->lda]);
+            float c_w = eta * find_cw_sparse(l, word_weights, v_s) * s->f.x;
+            for (size_t j = 0; j < l.sparse_topics; j++)
+            { size_t k = (size_t)topic[j];
+              float new_value = u[j] * v_s[k] * c_w;
+              total_new[k] += new_value;
+              word_weights[k] += new_value / scale;
+            }
+          }
+          continue;
+        }
+        for (size_t k = 0; k < l.all->lda; k++)
+        { float new_value = minuseta * word_weights[k];
+          word_weights[k] = new_value;
+        }
 
-    for (; s != next; s++)
-    { float *v_s = &(l.v[s->document * l.all->lda]);
-      float *u_for_w = &weights[(s->f.weight_index & l.all->reg.weight_mask) + l.all->lda + 1];
-      float c_w = eta * find_cw(l, u_for_w, v_s) * s->f.x;
-      for (size_t k = 0; k < l.all->lda; k++)
-      { float new_value = u_for_w[k] * v_s[k] * c_w;
-        l.total_new[k] += new_value;
-        word_weights[k] += new_value;
+        for (; s != next; s++)
+        { float *v_s = &(l.v[s->document * l.all->lda]);
+          float *u_for_w = &weights[(s->f.weight_index & l.all->reg.weight_mask) + l.u_offset];
+          float c_w = eta * find_cw(l, u_for_w, v_s) * s->f.x;
+          for (size_t k = 0; k < l.all->lda; k++)
+          { float new_value = u_for_w[k] * v_s[k] * c_w;
+            total_new[k] += new_value;
+            word_weights[k] += new_value;
+          }
+        }
       }
     }
-  }
+  };
+  PARALLEL::in_parallel(threads, update_words);
+
+  for (size_t shard = 0; shard < lda_shards; shard++)
+    for (size_t k = 0; k < l.all->lda; k++)
+      l.total_new[k] += l.shard_new[shard * l.all->lda + k];
   for (size_t k = 0; k < l.all->lda; k++)
   { l.total_lambda[k] *= minuseta;
     l.total_lambda[k] += l.total_new[k];
@@ -823,6 +782,8 @@ void end_examples(lda &l)
     float decay_component =
       l.decay_levels.last() - l.decay_levels.end()[(int)(-1 - l.example_t + weights_for_w[l.all->lda])];
     float decay = fmin(1.f, correctedExp(decay_component));
+    if (l.sparse_topics > 0)
+      fold_scale(l, weights_for_w);
     for (size_t k = 0; k < l.all->lda; k++)
       weights_for_w[k] *= decay;
   }
@@ -832,7 +793,20 @@ void finish_example(vw&, lda&, example &) {}
 
 void finish(lda &ld)
 { ld.sorted_features.~vector<index_feature>();
-  ld.Elogtheta.delete_v();
+  for (size_t t = 0; t < ld.threads; t++)
+  { ld.scratch[t].Elogtheta.delete_v();
+    ld.scratch[t].new_gamma.delete_v();
+    ld.scratch[t].old_gamma.delete_v();
+    ld.scratch[t].candidates.delete_v();
+    ld.scratch[t].candidate_u.delete_v();
+    ld.scratch[t].candidate_norm.delete_v();
+    ld.scratch[t].order.delete_v();
+  }
+  ld.scratch.delete_v();
+  for (size_t shard = 0; shard < lda_shards; shard++)
+    ld.shard_words[shard].delete_v();
+  ld.shard_new.delete_v();
+  ld.scores.delete_v();
   ld.decay_levels.delete_v();
   ld.total_new.delete_v();
   ld.examples.delete_v();
@@ -867,7 +841,9 @@ LEARNER::base_learner *lda_setup(vw &all)
     ("lda_D", po::value<float>()->default_value(10000.), "Number of documents")
     ("lda_epsilon", po::value<float>()->default_value(0.001f), "Loop convergence threshold")
     ("minibatch", po::value<size_t>()->default_value(1), "Minibatch size, for LDA")
-    ("math-mode", po::value<lda_math_mode>()->default_value(USE_SIMD), "Math mode: simd, accuracy, fast-approx");
+    ("math-mode", po::value<lda_math_mode>()->default_value(USE_SIMD), "Math mode: simd, accuracy, fast-approx")
+    ("lda_threads", po::value<size_t>()->default_value(1), "Threads sharing the documents and words of a minibatch; results do not depend on the number")
+    ("lda_sparse", po::value<size_t>()->default_value(0), "Keep only the <arg> most likely topics of each word, so a token costs <arg> rather than --lda; 0 keeps all");
   add_options(all);
   po::variables_map &vm = all.vm;
 
@@ -886,8 +862,15 @@ LEARNER::base_learner *lda_setup(vw &all)
   ld.all = &all;
   ld.example_t = all.initial_t;
   ld.mmode = vm["math-mode"].as<lda_math_mode>();
-
-  float temp = ceilf(logf((float)(all.lda * 2 + 1)) / logf(2.f));
+  ld.threads = max(vm["lda_threads"].as<size_t>(), (size_t)1);
+  ld.sparse_topics = vm["lda_sparse"].as<size_t>();
+  if (2 * ld.sparse_topics >= all.lda)
+    THROW("--lda_sparse must be less than half of --lda");
+
+  // a word's weights are its topics, the time of its last update, and then u_for_w,
+  // which starts a 64 byte line from 16 topics on (the weights are page aligned)
+  ld.u_offset = all.lda >= 16 ? (all.lda + 16) & ~(size_t)15 : all.lda + 1;
+  float temp = ceilf(logf((float)(ld.u_offset + all.lda)) / logf(2.f));
   all.reg.stride_shift = (size_t)temp;
   all.random_weights = true;
   all.add_constant = false;
@@ -906,6 +889,8 @@ LEARNER::base_learner *lda_setup(vw &all)
   *all.file_options << " --lda_rho " << ld.lda_rho;
 
   ld.v.resize(all.lda * ld.minibatch);
+  ld.scratch.resize(ld.threads); // zeroed, i.e. empty v_arrays
+  ld.shard_new.resize(all.lda * lda_shards);
 
   ld.decay_levels.push_back(0.f);
 
@@ -0,0 +1,247 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#include <stdint.h>
+#include <string.h>
+#include "lda_simd.h"
+
+// GCC vector extensions give the formulas once for every width; each width is compiled
+// for its instruction set by inlining them into a function with that target.
+#if !defined(VW_NO_SIMD) && defined(__GNUC__) && (defined(__clang__) || __GNUC__ >= 9) && (defined(__x86_64__) || defined(__i386__))
+#define VW_LDA_SIMD
+#endif
+
+// the same floats at every width: no multiply-add is fused
+#if defined(__clang__)
+#pragma STDC FP_CONTRACT OFF
+#elif defined(__GNUC__)
+#pragma GCC optimize ("fp-contract=off")
+#pragma GCC diagnostic ignored "-Wpsabi" // vectors are only passed among inlined functions
+#endif
+
+#if defined(_MSC_VER)
+#define LDA_INLINE __forceinline
+#else
+#define LDA_INLINE inline __attribute__((always_inline))
+#endif
+
+namespace LDA_SIMD
+{
+LDA_INLINE int32_t truncate(float x) { return (int32_t)x; }
+LDA_INLINE float to_float(int32_t x) { return (float)x; }
+LDA_INLINE int32_t bits(float x)
+{ int32_t i;
+  memcpy(&i, &x, sizeof(i));
+  return i;
+}
+LDA_INLINE float from_bits(int32_t i)
+{ float x;
+  memcpy(&x, &i, sizeof(x));
+  return x;
+}
+
+#ifdef VW_LDA_SIMD
+#define LDA_VECTOR(F, I, N) \
+  typedef float F __attribute__((vector_size(N * sizeof(float)))); \
+  typedef int32_t I __attribute__((vector_size(N * sizeof(float)))); \
+  LDA_INLINE I truncate(const F& x) { return __builtin_convertvector(x, I); } \
+  LDA_INLINE F to_float(const I& x) { return __builtin_convertvector(x, F); } \
+  LDA_INLINE I bits(const F& x) { return (I)x; } \
+  LDA_INLINE F from_bits(const I& x) { return (F)x; }
+
+LDA_VECTOR(f4, i4, 4)
+LDA_VECTOR(f8, i8, 8)
+LDA_VECTOR(f16, i16, 16)
+#endif
+
+template<class F> LDA_INLINE F splat(float x) { return F{} + x; }
+
+template<class F> LDA_INLINE F load(const float* p)
+{ F x;
+  memcpy(&x, p, sizeof(F));
+  return x;
+}
+
+template<class F> LDA_INLINE void store(float* p, const F& x) { memcpy(p, &x, sizeof(F)); }
+
+template<class F> LDA_INLINE F max(const F& a, const F& b) { return a > b ? a : b; }
+
+// the approximations of ldamath's fastpow2, fastlog2 and fastdigamma, as in its
+// former SSE version
+template<class F> LDA_INLINE F fastpow2(const F& p)
+{ F offset = p < splat<F>(0.f) ? splat<F>(1.f) : splat<F>(0.f);
+  F clipp = p < splat<F>(-126.f) ? splat<F>(-126.f) : p;
+  F z = clipp - to_float(truncate(clipp)) + offset;
+  F v = (float)(1 << 23) * (clipp + 121.2740838f + 27.7280233f / (4.84252568f - z) - 1.49012907f * z);
+  return from_bits(truncate(v));
+}
+
+template<class F> LDA_INLINE F fastexp(const F& p) { return fastpow2<F>(1.442695040f * p); }
+
+template<class F> LDA_INLINE F fastlog2(const F& x)
+{ F mx_f = from_bits((bits(x) & 0x007FFFFF) | 0x3f000000);
+  F y = to_float(bits(x)) * 1.1920928955078125e-7f;
+  return y - 124.22551499f - 1.498030302f * mx_f - 1.72587999f / (0.3520887068f + mx_f);
+}
+
+template<class F> LDA_INLINE F fastlog(const F& x) { return 0.69314718f * fastlog2<F>(x); }
+
+template<class F> LDA_INLINE F fastdigamma(const F& x)
+{ F twopx = 2.0f + x;
+  F logterm = fastlog<F>(twopx);
+  return (-48.0f + x * (-157.0f + x * (-127.0f - 30.0f * x))) / (12.0f * x * (1.0f + x) * twopx * twopx) + logterm;
+}
+
+// floats summed in separate lanes, as many vectors of F as it takes
+const size_t block = 16;
+
+LDA_INLINE float combine(float* lanes)
+{ for (size_t l = 0; l < 8; l++)
+    lanes[l] += lanes[l + 8];
+  for (size_t l = 0; l < 4; l++)
+    lanes[l] += lanes[l + 4];
+  for (size_t l = 0; l < 2; l++)
+    lanes[l] += lanes[l + 2];
+  return lanes[0] + lanes[1];
+}
+
+template<class F> LDA_INLINE float sum_lanes(const F* acc)
+{ float lanes[block];
+  memcpy(lanes, acc, sizeof(lanes));
+  return combine(lanes);
+}
+
+// the rest of n after its whole blocks is done in a copy, padded with pad
+LDA_INLINE size_t copy_tail(float* tail, const float* x, size_t n, float pad)
+{ size_t rest = n % block;
+  memcpy(tail, x + n - rest, rest * sizeof(float));
+  for (size_t k = rest; k < block; k++)
+    tail[k] = pad;
+  return rest;
+}
+
+template<class F> LDA_INLINE void expdigammify(float* gamma, size_t n, float threshold)
+{ const size_t W = sizeof(F) / sizeof(float);
+  F acc[block / W];
+  for (size_t j = 0; j < block / W; j++)
+    acc[j] = splat<F>(0.f);
+  size_t whole = n - n % block;
+  for (size_t i = 0; i < whole; i += block)
+    for (size_t j = 0; j < block / W; j++)
+    { F g = load<F>(gamma + i + j * W);
+      acc[j] += g;
+      store(gamma + i + j * W, fastdigamma<F>(g));
+    }
+  float tail[block];
+  size_t rest = copy_tail(tail, gamma, n, 0.f);
+  for (size_t j = 0; j < block / W; j++)
+    acc[j] += load<F>(tail + j * W);
+  for (size_t k = rest; k < block; k++)
+    tail[k] = 1.f; // keeps the unused lanes finite
+  for (size_t j = 0; j < block / W; j++)
+    store(tail + j * W, fastdigamma<F>(load<F>(tail + j * W)));
+
+  F sum = splat<F>(fastdigamma<float>(sum_lanes(acc)));
+  F vthreshold = splat<F>(threshold);
+  for (size_t i = 0; i < whole; i += W)
+    store(gamma + i, max(vthreshold, fastexp<F>(load<F>(gamma + i) - sum)));
+  for (size_t j = 0; j < block / W; j++)
+    store(tail + j * W, max(vthreshold, fastexp<F>(load<F>(tail + j * W) - sum)));
+  memcpy(gamma + whole, tail, rest * sizeof(float));
+}
+
+template<class F> LDA_INLINE void expdigammify_2(float* gamma, const float* norm, size_t n, float threshold)
+{ const size_t W = sizeof(F) / sizeof(float);
+  F vthreshold = splat<F>(threshold);
+  size_t whole = n - n % block;
+  for (size_t i = 0; i < whole; i += W)
+    store(gamma + i, max(vthreshold, fastexp<F>(fastdigamma<F>(load<F>(gamma + i)) - load<F>(norm + i))));
+  float tail[block];
+  float tail_norm[block];
+  size_t rest = copy_tail(tail, gamma, n, 1.f);
+  copy_tail(tail_norm, norm, n, 0.f);
+  for (size_t j = 0; j < block / W; j++)
+    store(tail + j * W, max(vthreshold, fastexp<F>(fastdigamma<F>(load<F>(tail + j * W)) - load<F>(tail_norm + j * W))));
+  memcpy(gamma + whole, tail, rest * sizeof(float));
+}
+
+template<class F> LDA_INLINE float dot(const float* a, const float* b, size_t n)
+{ const size_t W = sizeof(F) / sizeof(float);
+  F acc[block / W];
+  for (size_t j = 0; j < block / W; j++)
+    acc[j] = splat<F>(0.f);
+  size_t whole = n - n % block;
+  for (size_t i = 0; i < whole; i += block)
+    for (size_t j = 0; j < block / W; j++)
+      acc[j] += load<F>(a + i + j * W) * load<F>(b + i + j * W);
+  float tail_a[block];
+  float tail_b[block];
+  copy_tail(tail_a, a, n, 0.f);
+  copy_tail(tail_b, b, n, 0.f);
+  for (size_t j = 0; j < block / W; j++)
+    acc[j] += load<F>(tail_a + j * W) * load<F>(tail_b + j * W);
+  return sum_lanes(acc);
+}
+
+template<class F> LDA_INLINE void axpy(float* y, float a, const float* x, size_t n)
+{ const size_t W = sizeof(F) / sizeof(float);
+  F va = splat<F>(a);
+  size_t i = 0;
+  for (; i + W <= n; i += W)
+    store(y + i, load<F>(y + i) + va * load<F>(x + i));
+  for (; i < n; i++)
+    y[i] += a * x[i];
+}
+
+#define LDA_KERNELS(suffix, F, target) \
+  target void expdigammify_##suffix(float* gamma, size_t n, float threshold) { expdigammify<F>(gamma, n, threshold); } \
+  target void expdigammify_2_##suffix(float* gamma, const float* norm, size_t n, float threshold) \
+  { expdigammify_2<F>(gamma, norm, n, threshold); } \
+  target float dot_##suffix(const float* a, const float* b, size_t n) { return dot<F>(a, b, n); } \
+  target void axpy_##suffix(float* y, float a, const float* x, size_t n) { axpy<F>(y, a, x, n); }
+
+LDA_KERNELS(scalar, float, )
+const kernels scalar = { "scalar", expdigammify_scalar, expdigammify_2_scalar, dot_scalar, axpy_scalar };
+
+#ifdef VW_LDA_SIMD
+LDA_KERNELS(sse, f4, )
+LDA_KERNELS(avx2, f8, __attribute__((target("avx2"))))
+LDA_KERNELS(avx512, f16, __attribute__((target("avx512f"))))
+const kernels sse = { "sse", expdigammify_sse, expdigammify_2_sse, dot_sse, axpy_sse };
+const kernels avx2 = { "avx2", expdigammify_avx2, expdigammify_2_avx2, dot_avx2, axpy_avx2 };
+const kernels avx512 = { "avx512", expdigammify_avx512, expdigammify_2_avx512, dot_avx512, axpy_avx512 };
+#else
+const kernels sse = { "sse", expdigammify_scalar, expdigammify_2_scalar, dot_scalar, axpy_scalar };
+const kernels avx2 = { "avx2", expdigammify_scalar, expdigammify_2_scalar, dot_scalar, axpy_scalar };
+const kernels avx512 = { "avx512", expdigammify_scalar, expdigammify_2_scalar, dot_scalar, axpy_scalar };
+#endif
+
+bool supported(const kernels& k)
+{ if (&k == &scalar)
+    return true;
+#ifdef VW_LDA_SIMD
+  __builtin_cpu_init(); // we may run before main
+  if (&k == &sse)
+    return true;
+  if (&k == &avx2)
+    return __builtin_cpu_supports("avx2");
+  if (&k == &avx512)
+    return __builtin_cpu_supports("avx512f");
+#endif
+  return false;
+}
+
+const kernels* pick()
+{ if (supported(avx512))
+    return &avx512;
+  if (supported(avx2))
+    return &avx2;
+  if (supported(sse))
+    return &sse;
+  return &scalar;
+}
+
+const kernels* const best = pick();
+}
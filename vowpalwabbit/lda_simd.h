@@ -0,0 +1,35 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stddef.h>
+
+// The loops over the topics of --lda's default math mode, with the fast approximations
+// of digamma and exp, in 1, 4, 8 and 16 float wide versions.  All of them compute the
+// same floats: sums are kept in 16 lanes and combined in a fixed order, whatever the
+// width, and the elementwise work does not depend on it.
+namespace LDA_SIMD
+{
+struct kernels
+{ const char* name;
+  // gamma[k] = max(threshold, exp(digamma(gamma[k]) - digamma(sum of gamma)))
+  void (*expdigammify)(float* gamma, size_t n, float threshold);
+  // gamma[k] = max(threshold, exp(digamma(gamma[k]) - norm[k]))
+  void (*expdigammify_2)(float* gamma, const float* norm, size_t n, float threshold);
+  float (*dot)(const float* a, const float* b, size_t n);
+  // y[k] += a * x[k]
+  void (*axpy)(float* y, float a, const float* x, size_t n);
+};
+
+extern const kernels scalar;
+extern const kernels sse;
+extern const kernels avx2;
+extern const kernels avx512;
+
+bool supported(const kernels& k);
+
+// the widest the cpu supports (scalar ones only when built with -DVW_NO_SIMD)
+extern const kernels* const best;
+}
@@ -1,6 +1,11 @@
 #include "parser.h"
 #include "vw.h"
 #include "parse_regressor.h"
+#include "example_ring.h"
+#include "gd.h"
+#ifdef _WIN32
+#include <xmmintrin.h>
+#endif
 using namespace std;
 
 void dispatch_example(vw& all, example& ec)
@@ -11,6 +16,143 @@ void dispatch_example(vw& all, example& ec)
   all.l->finish_example(all, ec);
 }
 
+namespace
+{
+// ask for the cache lines of the weights of ec's features, not waiting for them
+void prefetch_weights(vw& all, example& ec)
+{ weight* weights = all.reg.weight_vector;
+  uint64_t mask = all.reg.weight_mask;
+  for (features& fs : ec)
+    for (feature_index i : fs.indicies)
+    {
+#ifdef _WIN32
+      _mm_prefetch((const char*)(weights + ((i + ec.ft_offset) & mask)), _MM_HINT_T0);
+#else
+      __builtin_prefetch(weights + ((i + ec.ft_offset) & mask));
+#endif
+    }
+}
+
+// The terms that are the same in every example of a batch: the linear terms of the
+// namespaces whose features are the same in every example (the query's, the constant)
+// and the interactions among those namespaces.
+struct common_terms
+{ bool common[256]; // by namespace
+  v_array<v_string> interactions; // among common namespaces
+  v_array<v_string> rest; // the other interactions, generated for each example
+  float sum; // of the common terms
+  v_array<namespace_index> saved; // the namespaces of the example being predicted
+};
+
+bool same_features(features& a, features& b)
+{ return a.size() == b.size()
+         && memcmp(a.indicies.begin(), b.indicies.begin(), a.size() * sizeof(feature_index)) == 0
+         && memcmp(a.values.begin(), b.values.begin(), a.size() * sizeof(feature_value)) == 0;
+}
+
+// leave in ec.indices the namespaces that are common (or not), and the old ones in c.saved
+void keep_namespaces(example& ec, common_terms& c, bool common)
+{ c.saved.erase();
+  for (namespace_index ns : ec.indices)
+    c.saved.push_back(ns);
+  ec.indices.erase();
+  for (namespace_index ns : c.saved)
+    if (c.common[ns] == common)
+      ec.indices.push_back(ns);
+}
+
+void restore_namespaces(example& ec, common_terms& c)
+{ ec.indices.erase();
+  for (namespace_index ns : c.saved)
+    ec.indices.push_back(ns);
+}
+
+// false if the examples have no namespace in common
+bool find_common_terms(vw& all, example* examples, size_t count, common_terms& c)
+{ example& first = examples[0];
+  for (size_t i = 1; i < count; i++)
+    if (examples[i].ft_offset != first.ft_offset || examples[i].interactions != first.interactions)
+      return false;
+
+  memset(c.common, 0, sizeof(c.common));
+  bool any = false;
+  for (namespace_index ns : first.indices)
+  { size_t i = 1;
+    while (i < count && same_features(first.feature_space[ns], examples[i].feature_space[ns]))
+      i++;
+    c.common[ns] = i == count;
+    any |= c.common[ns];
+  }
+  if (!any)
+    return false;
+
+  for (v_string& inter : first.interactions ? *first.interactions : all.interactions)
+  { bool common = true;
+    for (namespace_index ns : inter)
+      common &= c.common[ns];
+    if (common)
+      c.interactions.push_back(inter);
+    else
+      c.rest.push_back(inter);
+  }
+
+  // the first example with only its common terms
+  keep_namespaces(first, c, true);
+  v_array<v_string>* interactions = first.interactions;
+  first.interactions = &c.interactions;
+  float initial = first.l.simple.initial;
+  first.l.simple.initial = 0.;
+  c.sum = GD::inline_predict(all, first);
+  first.l.simple.initial = initial;
+  first.interactions = interactions;
+  restore_namespaces(first, c);
+  return true;
+}
+
+// predict ec from its other terms, starting from the sum of the common ones
+void predict_rest(vw& all, example& ec, common_terms& c)
+{ keep_namespaces(ec, c, false);
+  v_array<v_string>* interactions = ec.interactions;
+  ec.interactions = &c.rest;
+  float initial = ec.l.simple.initial;
+  ec.l.simple.initial += c.sum;
+  all.l->predict(ec);
+  ec.l.simple.initial = initial;
+  ec.interactions = interactions;
+  restore_namespaces(ec, c);
+}
+}
+
+namespace VW
+{
+void predict_batch(vw& all, example* examples, size_t count, bool share_common_terms)
+{ if (share_common_terms && all.p->lp.parse_label != simple_label.parse_label)
+    THROW("predict_batch shares the common terms of examples with simple labels only");
+  common_terms c;
+  c.interactions = v_init<v_string>();
+  c.rest = v_init<v_string>();
+  c.saved = v_init<namespace_index>();
+  // a truncated prediction is not the sum of its parts, and an audit should show every term
+  bool share = share_common_terms && count > 1 && all.sd->gravity == 0. && !all.audit
+               && find_common_terms(all, examples, count, c);
+  // a table's weights are found by probing it, there are no lines to fetch ahead
+  bool prefetch = all.reg.sparse == nullptr;
+  if (prefetch && count > 0)
+    prefetch_weights(all, examples[0]);
+  for (size_t i = 0; i < count; i++)
+  { if (prefetch && i + 1 < count)
+      prefetch_weights(all, examples[i + 1]);
+    if (share)
+      predict_rest(all, examples[i], c);
+    else
+      all.l->predict(examples[i]);
+  }
+  c.interactions.delete_v();
+  c.rest.delete_v();
+  c.saved.delete_v();
+}
+}
+
 namespace LEARNER
 {
 void process_example(vw& all, example* ec)
@@ -68,6 +210,117 @@ void generic_driver(vector<vw*> alls)
     (*it)->l->end_examples();
 }
 
+/* --learner_threads: several learner threads take examples from the parser in any order and
+** update the shared weights without locking (Hogwild!).  Each thread accounts the
+** examples it learns in its own shared_data and adds it to all.sd now and then, and
+** before passes end.  Only learners that keep no state between predicting and
+** updating an example are allowed (see parse_reductions).
+*/
+const size_t examples_between_flushes = 64;
+
+struct learner_thread
+{ vw* all;
+  MUTEX* lock; // guards all.sd and the prediction outputs
+  shared_data sd; // counts of the examples learned since the last flush
+  size_t unflushed;
+  uint64_t barriers_passed;
+#ifndef _WIN32
+  pthread_t thread;
+#else
+  HANDLE thread;
+#endif
+};
+
+void flush_counts(learner_thread& t, example* ec)
+{ vw& all = *t.all;
+  mutex_lock(t.lock);
+  all.sd->add_counts(t.sd);
+  if (ec != nullptr)
+    print_update(all, *ec);
+  mutex_unlock(t.lock);
+  t.unflushed = 0;
+}
+
+void flush_at_barrier(void* t)
+{ flush_counts(*(learner_thread*)t, nullptr);
+}
+
+void learn_shared(learner_thread& t, example* ec)
+{ vw& all = *t.all;
+  if (ec->test_only || !all.training)
+    all.l->predict(*ec);
+  else
+    all.l->learn(*ec);
+
+  account_simple_example(t.sd, *ec);
+  if (all.raw_prediction > 0 || all.final_prediction_sink.size() > 0)
+  { mutex_lock(t.lock);
+    output_simple_example(all, *ec);
+    mutex_unlock(t.lock);
+  }
+  if (++t.unflushed >= examples_between_flushes)
+    flush_counts(t, ec);
+  VW::finish_example(all, ec);
+}
+
+#ifdef _WIN32
+DWORD WINAPI learner_thread_loop(LPVOID in)
+#else
+void* learner_thread_loop(void* in)
+#endif
+{ learner_thread& t = *(learner_thread*)in;
+  vw& all = *t.all;
+  example* ec;
+  while ((ec = get_shared_example(all.p, all.learner_threads, t.barriers_passed, flush_at_barrier, &t)) != nullptr)
+    if (all.early_terminate) // drain the examples left by the parser
+      VW::finish_example(all, ec);
+    else if (is_barrier_example(ec))
+      process_example(all, ec);
+    else
+      learn_shared(t, ec);
+  flush_counts(t, nullptr);
+  return 0L;
+}
+
+void shared_driver(vw& all)
+{ MUTEX lock;
+  initialize_mutex(&lock);
+  all.p->barrier_arrivals = 0;
+  all.p->barriers_finished = 0;
+
+  learner_thread* threads = calloc_or_throw<learner_thread>(all.learner_threads);
+  for (size_t i = 0; i < all.learner_threads; i++)
+  { threads[i].all = &all;
+    threads[i].lock = &lock;
+  }
+  // this thread is the first learner
+  for (size_t i = 1; i < all.learner_threads; i++)
+  {
+#ifndef _WIN32
+    pthread_create(&threads[i].thread, nullptr, learner_thread_loop, threads + i);
+#else
+    threads[i].thread = ::CreateThread(nullptr, 0, static_cast<LPTHREAD_START_ROUTINE>(learner_thread_loop), threads + i, 0L, nullptr);
+#endif
+  }
+  learner_thread_loop(threads);
+  for (size_t i = 1; i < all.learner_threads; i++)
+  {
+#ifndef _WIN32
+    pthread_join(threads[i].thread, nullptr);
+#else
+    ::WaitForSingleObject(threads[i].thread, INFINITE);
+    ::CloseHandle(threads[i].thread);
+#endif
+  }
+  free(threads);
+  delete_mutex(&lock);
+  all.l->end_examples();
+}
+
 void generic_driver(vw& all)
-{ generic_driver<vw&, process_example>(all, all); }
+{ if (all.learner_threads > 1)
+    shared_driver(all);
+  else
+    generic_driver<vw&, process_example>(all, all);
+}
 }
@@ -6,6 +6,7 @@ license as described in the file LICENSE.
 #pragma once
 // This is the interface for a learning algorithm
 #include<iostream>
+#include <float.h>
 #include "memory.h"
 #include "cb.h"
 #include "cost_sensitive.h"
@@ -39,6 +40,7 @@ struct learn_data
   void (*predict_f)(void* data, base_learner& base, example&);
   void (*update_f)(void* data, base_learner& base, example&);
   void (*multipredict_f)(void* data, base_learner& base, example&, size_t count, size_t step, polyprediction*pred, bool finalize_predictions);
+  void (*multiupdate_f)(void* data, base_learner& base, example&, size_t count, size_t step, polyprediction*pred, const float* labels);
 };
 
 struct sensitivity_data
@@ -60,6 +62,7 @@ struct finish_example_data
 
 void generic_driver(vw& all);
 void generic_driver(std::vector<vw*> alls);
+void process_example(vw& all, example* ec);
 
 inline void noop_sl(void*, io_buf&, bool, bool) {}
 inline void noop(void*) {}
@@ -68,6 +71,7 @@ inline float noop_sensitivity(void*, base_learner&, example&) { return 0.; }
 typedef void (*tlearn)(void* d, base_learner& base, example& ec);
 typedef float (*tsensitivity)(void* d, base_learner& base, example& ec);
 typedef void (*tmultipredict)(void* d, base_learner& base, example& ec, size_t, size_t, polyprediction*, bool);
+typedef void (*tmultiupdate)(void* d, base_learner& base, example& ec, size_t, size_t, polyprediction*, const float*);
 typedef void (*tsl)(void* d, io_buf& io, bool read, bool text);
 typedef void (*tfunc)(void*d);
 typedef void (*tend_example)(vw& all, void* d, example& ec);
@@ -135,6 +139,29 @@ public:
   inline void set_update(void (*u)(T& data, base_learner& base, example&))
   { learn_fd.update_f = (tlearn)u; }
 
+  // update(ec, i) for i in [lo, lo+count), with simple label labels[i-lo] and prediction pred[i-lo];
+  // those labeled FLT_MAX are left alone
+  inline void multiupdate(example& ec, size_t lo, size_t count, polyprediction* pred, const float* labels)
+  { ec.ft_offset += (uint32_t)(increment*lo);
+    if (learn_fd.multiupdate_f == NULL)
+    { for (size_t c=0; c<count; c++, ec.ft_offset += (uint32_t)increment)
+      { if (labels[c] == FLT_MAX)
+          continue;
+        ec.l.simple.label = labels[c];
+        ec.pred.scalar = pred[c].scalar;
+        learn_fd.update_f(learn_fd.data, *learn_fd.base, ec);
+      }
+      ec.ft_offset -= (uint32_t)(increment*count);
+    }
+    else
+      learn_fd.multiupdate_f(learn_fd.data, *learn_fd.base, ec, count, increment, pred, labels);
+    ec.ft_offset -= (uint32_t)(increment*lo);
+  }
+  inline void set_multiupdate(void (*u)(T&, base_learner&, example&, size_t, size_t, polyprediction*, const float*))
+  { learn_fd.multiupdate_f = (tmultiupdate)u; }
+  // else multiupdate is the loop over update
+  inline bool has_multiupdate() { return learn_fd.multiupdate_f != nullptr; }
+
   //used for active learning and confidence to determine how easily predictions are changed
   inline void set_sensitivity(float (*u)(T& data, base_learner& base, example&))
   { sensitivity_fd.data = learn_fd.data;
@@ -222,6 +249,7 @@ learner<T>& init_learner(T* dat, void (*learn)(T&, base_learner&, example&),
   ret.learn_fd.update_f = (tlearn)learn;
   ret.learn_fd.predict_f = (tlearn)learn;
   ret.learn_fd.multipredict_f = nullptr;
+  ret.learn_fd.multiupdate_f = nullptr;
   ret.sensitivity_fd.sensitivity_f = (tsensitivity)noop_sensitivity;
   ret.finish_example_fd.data = dat;
   ret.finish_example_fd.finish_example_f = return_simple_example;
@@ -242,6 +270,7 @@ learner<T>& init_learner(T* dat, base_learner* base,
   ret.learn_fd.update_f = (tlearn)learn;
   ret.learn_fd.predict_f = (tlearn)predict;
   ret.learn_fd.multipredict_f = nullptr;
+  ret.learn_fd.multiupdate_f = nullptr;
   ret.learn_fd.base = base;
 
   ret.finisher_fd.data = dat;
@@ -15,6 +15,7 @@ license as described in the file LICENSE.
 #include "accumulate.h"
 #include "best_constant.h"
 #include "vw_exception.h"
+#include "event_daemon.h"
 #include <fstream>
 
 using namespace std;
@@ -94,6 +95,9 @@ int main(int argc, char *argv[])
     struct timeb t_start, t_end;
     ftime(&t_start);
 
+    if (all.daemon_epoll)
+      serve_daemon_connections(all);
+
     VW::start_parser(all);
     if (alls.size() == 1)
       LEARNER::generic_driver(all);
@@ -114,6 +118,7 @@ int main(int argc, char *argv[])
   }
   catch (VW::vw_exception& e)
   { cerr << "vw (" << e.Filename() << ":" << e.LineNumber() << "): " << e.what() << endl;
+    exit(1);
   }
   catch (exception& e)
   { // vw is implemented as a library, so we use 'throw runtime_error()'
@@ -0,0 +1,142 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#include "mmap_io_buf.h"
+#include "cache.h"
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+mmap_io_buf::mmap_io_buf()
+{ maps = v_init<mapping>();
+  buffer = space;
+  viewing = -1;
+}
+
+mmap_io_buf::~mmap_io_buf()
+{ if (ahead != nullptr)
+    end_read_ahead();
+  end_view();
+  while (maps.size() > 0)
+    unmap(maps.last().fd);
+  maps.delete_v();
+}
+
+mmap_io_buf::mapping* mmap_io_buf::find(int f)
+{ for (mapping& m : maps)
+    if (m.fd == f)
+      return &m;
+  return nullptr;
+}
+
+void mmap_io_buf::map(int f)
+{ unmap(f); // a previous file with this descriptor may have been closed behind our back
+#ifndef _WIN32
+  struct stat st;
+  if (fstat(f, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+    return;
+  // only map cache files: label parsers write into the text lines they are given
+  size_t v_length;
+  char c;
+  if (pread(f, &v_length, sizeof(v_length), 0) != sizeof(v_length) || v_length == 0 || v_length > 61
+      || pread(f, &c, 1, sizeof(v_length) + v_length) != 1 || (c != CACHE_V1 && c != CACHE_V2))
+    return;
+  void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, f, 0);
+  if (p == MAP_FAILED)
+    return;
+  // passes read the file front to back: read ahead aggressively, drop pages behind us
+  madvise(p, (size_t)st.st_size, MADV_SEQUENTIAL);
+  madvise(p, (size_t)st.st_size, MADV_WILLNEED);
+  mapping m = { f, (char*)p, (size_t)st.st_size, 0 };
+  maps.push_back(m);
+#endif
+}
+
+void mmap_io_buf::unmap(int f)
+{ if (viewing == f)
+    end_view();
+  for (size_t i = 0; i < maps.size(); i++)
+    if (maps[i].fd == f)
+    {
+#ifndef _WIN32
+      munmap(maps[i].begin, maps[i].length);
+#endif
+      maps[i] = maps.last();
+      maps.pop();
+      return;
+    }
+}
+
+// put the allocated space back in place of the view
+void mmap_io_buf::end_view()
+{ if (viewing == -1)
+    return;
+  space = buffer;
+  space.end() = space.begin();
+  head = space.begin();
+  viewing = -1;
+}
+
+int mmap_io_buf::open_file(const char* name, bool stdin_off, int flag)
+{ if (ahead != nullptr)
+    stop_read_ahead(); // the reader looks up maps
+  int ret = io_buf::open_file(name, stdin_off, flag);
+  if (ret != -1 && flag == READ)
+    map(ret);
+  return ret;
+}
+
+void mmap_io_buf::reset_file(int f)
+{ mapping* m = find(f);
+  if (m == nullptr)
+  { end_view();
+    io_buf::reset_file(f);
+    return;
+  }
+  m->offset = 0;
+  end_view();
+}
+
+ssize_t mmap_io_buf::read_file(int f, void* buf, size_t nbytes)
+{ mapping* m = find(f);
+  if (m == nullptr)
+    return io_buf::read_file(f, buf, nbytes);
+  size_t n = std::min(nbytes, m->length - m->offset);
+  memcpy(buf, m->begin + m->offset, n);
+  m->offset += n;
+  return n;
+}
+
+ssize_t mmap_io_buf::fill(int f)
+{ mapping* m = find(f);
+  if (m == nullptr)
+  { end_view();
+    return io_buf::fill(f);
+  }
+  size_t left = m->length - m->offset;
+  if (left == 0)
+    return 0;
+  if (viewing == -1)
+    buffer = space;
+  space.begin() = m->begin + m->offset;
+  space.end() = space.end_array = m->begin + m->length;
+  head = space.begin();
+  m->offset = m->length;
+  viewing = f;
+  return left;
+}
+
+void mmap_io_buf::shift()
+{ if (viewing == -1)
+    io_buf::shift();
+}
+
+int mmap_io_buf::detach_file()
+{ if (ahead != nullptr)
+    stop_read_ahead(files.last());
+  unmap(files.last());
+  return io_buf::detach_file();
+}
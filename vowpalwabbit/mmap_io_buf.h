@@ -0,0 +1,55 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD
+license as described in the file LICENSE.
+ */
+#pragma once
+#include "io_buf.h"
+
+/* An input buffer that maps cache files into memory instead of reading them.
+** While a mapped file is being read, space is a view of the mapping: buf_read
+** hands out pointers into the page cache and nothing is copied or shifted, and
+** reset_file only rewinds the view.  Everything else (text, stdin, pipes, sockets)
+** is read into the usual buffer.
+**
+** Records must not span files: when a mapped file runs out, whatever is left of
+** it is dropped in favor of the next file.
+*/
+class mmap_io_buf : public io_buf
+{
+public:
+  struct mapping
+  { int fd;
+    char* begin;
+    size_t length;
+    size_t offset; // bytes of the file read so far
+  };
+
+  v_array<mapping> maps;
+  v_array<char> buffer; // the allocated space, put aside while space is a view
+  int viewing; // the file space is a view of, or -1
+
+  mmap_io_buf();
+
+  virtual ~mmap_io_buf();
+
+  virtual int open_file(const char* name, bool stdin_off, int flag=READ);
+
+  virtual void reset_file(int f);
+
+  virtual ssize_t read_file(int f, void* buf, size_t nbytes);
+
+  virtual ssize_t fill(int f);
+
+  virtual void shift();
+
+  virtual int detach_file();
+
+  virtual int64_t file_offset(bool) { return -1; }
+
+private:
+  mapping* find(int f);
+  void map(int f);
+  void unmap(int f);
+  void end_view();
+};
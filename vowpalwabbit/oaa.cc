@@ -17,6 +17,7 @@ struct oaa
 { size_t k;
   vw* all; // for raw
   polyprediction* pred;  // for multipredict
+  float* labels; // for multiupdate
   size_t num_subsample; // for randomized subsampling, how many negatives to draw?
   uint32_t* subsample_order; // for randomized subsampling, in what order should we touch classes
   size_t subsample_id; // for randomized subsampling, where do we live in the list
@@ -75,10 +76,8 @@ void predict_or_learn(oaa& o, LEARNER::base_learner& base, example& ec)
 
   if (is_learn)
   { for (uint32_t i=1; i<=o.k; i++)
-    { ec.l.simple = { (mc_label_data.label == i) ? 1.f : -1.f, 0.f, 0.f };
-      ec.pred.scalar = o.pred[i-1].scalar;
-      base.update(ec, i-1);
-    }
+      o.labels[i-1] = (mc_label_data.label == i) ? 1.f : -1.f;
+    base.multiupdate(ec, 0, o.k, o.pred, o.labels);
   }
 
   if (print_all)
@@ -109,6 +108,7 @@ void predict_or_learn(oaa& o, LEARNER::base_learner& base, example& ec)
 
 void finish(oaa&o)
 { free(o.pred);
+  free(o.labels);
   free(o.subsample_order);
 }
 
@@ -195,6 +195,7 @@ LEARNER::base_learner* oaa_setup(vw& all)
 
     data.all = &all;
   data.pred = calloc_or_throw<polyprediction>(data.k);
+  data.labels = calloc_or_throw<float>(data.k);
   data.num_subsample = 0;
   data.subsample_order = nullptr;
   data.subsample_id = 0;
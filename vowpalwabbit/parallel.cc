@@ -0,0 +1,111 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#include "parallel.h"
+#include "example_ring.h"
+#include "memory.h"
+
+namespace PARALLEL
+{
+struct pool_thread
+{ pool* p;
+  size_t index;          // the thread does work(index)
+  uint64_t generation;   // of the last work it saw
+#ifndef _WIN32
+  pthread_t thread;
+#else
+  HANDLE thread;
+#endif
+};
+
+#ifdef _WIN32
+DWORD WINAPI run_pool_thread(LPVOID in)
+#else
+void* run_pool_thread(void* in)
+#endif
+{ pool_thread& t = *(pool_thread*)in;
+  pool& p = *t.p;
+  mutex_lock(&p.lock);
+  while (true)
+  { while (!p.stopping && p.generation == t.generation)
+      condition_variable_wait(&p.work_ready, &p.lock);
+    if (p.stopping)
+      break;
+    t.generation = p.generation;
+    if (t.index < p.count)
+    { mutex_unlock(&p.lock);
+      p.call(p.work, t.index);
+      mutex_lock(&p.lock);
+      if (--p.running == 0)
+        condition_variable_signal_all(&p.work_done);
+    }
+  }
+  mutex_unlock(&p.lock);
+  return 0;
+}
+
+void run(pool& p, size_t count, void (*call)(void*, size_t), void* work)
+{ if (!p.initialized)
+  { initialize_mutex(&p.lock);
+    initialize_condition_variable(&p.work_ready);
+    initialize_condition_variable(&p.work_done);
+    p.initialized = true;
+  }
+  // thread i does work(i + 1); those started now wait for work past the current one
+  while (p.threads.size() + 1 < count)
+  { pool_thread* t = &calloc_or_throw<pool_thread>();
+    t->p = &p;
+    t->index = p.threads.size() + 1;
+    t->generation = p.generation;
+#ifndef _WIN32
+    pthread_create(&t->thread, nullptr, run_pool_thread, t);
+#else
+    t->thread = ::CreateThread(nullptr, 0, static_cast<LPTHREAD_START_ROUTINE>(run_pool_thread), t, 0L, nullptr);
+#endif
+    p.threads.push_back(t);
+  }
+
+  mutex_lock(&p.lock);
+  p.call = call;
+  p.work = work;
+  p.count = count;
+  p.running = count - 1;
+  p.generation++;
+  condition_variable_signal_all(&p.work_ready);
+  mutex_unlock(&p.lock);
+
+  call(work, 0);
+
+  mutex_lock(&p.lock);
+  while (p.running > 0)
+    condition_variable_wait(&p.work_done, &p.lock);
+  mutex_unlock(&p.lock);
+}
+
+void stop(pool& p)
+{ if (!p.initialized)
+    return;
+  mutex_lock(&p.lock);
+  p.stopping = true;
+  condition_variable_signal_all(&p.work_ready);
+  mutex_unlock(&p.lock);
+  for (pool_thread* t : p.threads)
+  {
+#ifndef _WIN32
+    pthread_join(t->thread, nullptr);
+#else
+    ::WaitForSingleObject(t->thread, INFINITE);
+    ::CloseHandle(t->thread);
+#endif
+    free(t);
+  }
+  p.threads.delete_v();
+  delete_mutex(&p.lock);
+  delete_condition_variable(&p.work_ready);
+  delete_condition_variable(&p.work_done);
+  p.initialized = false;
+  p.stopping = false;
+}
+}
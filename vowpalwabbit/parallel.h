@@ -0,0 +1,94 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#pragma once
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <pthread.h>
+#endif
+#include <vector>
+#include "parse_primitives.h"
+#include "v_array.h"
+
+namespace PARALLEL
+{
+template<class W> struct worker
+{ W* work;
+  size_t index;
+#ifndef _WIN32
+  pthread_t thread;
+#else
+  HANDLE thread;
+#endif
+};
+
+template<class W>
+#ifdef _WIN32
+DWORD WINAPI run_worker(LPVOID in)
+#else
+void* run_worker(void* in)
+#endif
+{ worker<W>& w = *(worker<W>*)in;
+  (*w.work)(w.index);
+  return 0;
+}
+
+// work(i) for i < count, each on its own thread; work(0) on this one
+template<class W> void in_parallel(size_t count, W& work)
+{ std::vector<worker<W>> workers(count);
+  for (size_t i = 1; i < count; i++)
+  { workers[i].work = &work;
+    workers[i].index = i;
+#ifndef _WIN32
+    pthread_create(&workers[i].thread, nullptr, run_worker<W>, &workers[i]);
+#else
+    workers[i].thread = ::CreateThread(nullptr, 0, static_cast<LPTHREAD_START_ROUTINE>(run_worker<W>), &workers[i], 0L, nullptr);
+#endif
+  }
+  work(0);
+  for (size_t i = 1; i < count; i++)
+  {
+#ifndef _WIN32
+    pthread_join(workers[i].thread, nullptr);
+#else
+    ::WaitForSingleObject(workers[i].thread, INFINITE);
+    ::CloseHandle(workers[i].thread);
+#endif
+  }
+}
+
+struct pool_thread;
+
+/* Threads kept between calls of in_parallel(pool&, ...), rather than started and
+** joined each time.  A zeroed pool is ready to use; stop ends its threads.
+*/
+struct pool
+{ v_array<pool_thread*> threads;
+  bool initialized;
+  MUTEX lock;
+  CV work_ready;
+  CV work_done;
+  uint64_t generation;  // of the work, counted up each time there is more
+  size_t count;         // how many of the threads take part in it
+  size_t running;       // how many of those are not done yet
+  bool stopping;
+  void (*call)(void*, size_t);
+  void* work;
+};
+
+void run(pool& p, size_t count, void (*call)(void*, size_t), void* work);
+
+template<class W> void call_work(void* work, size_t i)
+{ (*(W*)work)(i);
+}
+
+// work(i) for i < count, each on a thread of p; work(0) on this one
+template<class W> void in_parallel(pool& p, size_t count, W& work)
+{ run(p, count, call_work<W>, &work);
+}
+
+void stop(pool& p);
+}
@@ -66,6 +66,7 @@ license as described in the file LICENSE.
 #include "accumulate.h"
 #include "vw_validate.h"
 #include "vw_allreduce.h"
+#include "feature_dictionary.h"
 #include "OjaNewton.h"
 #include "audit_regressor.h"
 
@@ -82,20 +83,6 @@ bool ends_with(string const &fullString, string const &ending)
   }
 }
 
-unsigned long long hash_file_contents(io_buf *io, int f)
-{ unsigned long long v = 5289374183516789128;
-  unsigned char buf[1024];
-  while (true)
-  { size_t n = io->read_file(f, buf, 1024);
-    if (n == 0) break;
-    for (size_t i=0; i<n; i++)
-    { v *= 341789041;
-      v += buf[i];
-    }
-  }
-  return v;
-}
-
 bool directory_exists(string path)
 { struct stat info;
   if (stat(path.c_str(), &info) != 0)
@@ -146,104 +133,23 @@ void parse_dictionary_argument(vw&all, string str)
   if (fname == "")
     THROW("error: cannot find dictionary '" << s << "' in path; try adding --dictionary_path");
 
-  bool is_gzip = ends_with(fname, ".gz");
-  io_buf* io = is_gzip ? new comp_io_buf : new io_buf;
-  int fd = io->open_file(fname.c_str(), all.stdin_off, io_buf::READ);
-  if (fd < 0)
-    THROW("error: cannot read dictionary from file '" << fname << "'" << ", opening failed");
-
-  unsigned long long fd_hash = hash_file_contents(io, fd);
-  io->close_file();
+  unsigned long long fd_hash;
+  feature_dict* map = load_dictionary(all, s, fname, fd_hash);
+  all.namespace_dictionaries[(size_t)ns].push_back(map);
 
-  if (! all.quiet)
-    cerr << "scanned dictionary '" << s << "' from '" << fname << "', hash=" << hex << fd_hash << dec << endl;
+  if (all.vm.count("dictionary_compile") && map->mapped == nullptr)
+  { save_dictionary(*map, fname + ".vwdict");
+    if (! all.quiet)
+      cerr << "compiled dictionary " << s << " into '" << fname << ".vwdict'" << endl;
+  }
 
   // see if we've already read this dictionary
   for (size_t id=0; id<all.loaded_dictionaries.size(); id++)
-    if (all.loaded_dictionaries[id].file_hash == fd_hash)
-    { all.namespace_dictionaries[(size_t)ns].push_back(all.loaded_dictionaries[id].dict);
-      io->close_file();
-      delete io;
+    if (all.loaded_dictionaries[id].dict == map)
+    { release_dictionary(map);
       return;
     }
 
-  fd = io->open_file(fname.c_str(), all.stdin_off, io_buf::READ);
-  if (fd < 0)
-  { delete io;
-    THROW("error: cannot re-read dictionary from file '" << fname << "'" << ", opening failed");
-  }
-
-  feature_dict* map = new feature_dict(1023, nullptr, substring_equal);
-  example *ec = VW::alloc_examples(all.p->lp.label_size, 1);
-
-  size_t def = (size_t)' ';
-
-  size_t size = 2048, pos, nread;
-  char rc;
-  char*buffer = calloc_or_throw<char>(size);
-  do
-  { pos = 0;
-    do
-    { nread = io->read_file(fd, &rc, 1);
-      if ((rc != EOF) && (nread > 0)) buffer[pos++] = rc;
-      if (pos >= size - 1)
-      { size *= 2;
-        buffer = (char*)realloc(buffer, size);
-        if (buffer == nullptr)
-        { free(ec);
-          VW::dealloc_example(all.p->lp.delete_label, *ec);
-          delete map;
-          io->close_file();
-          delete io;
-          THROW("error: memory allocation failed in reading dictionary");
-        }
-      }
-    }
-    while ( (rc != EOF) && (rc != '\n') && (nread > 0) );
-    buffer[pos] = 0;
-
-    // we now have a line in buffer
-    char* c = buffer;
-    while (*c == ' ' || *c == '\t') ++c; // skip initial whitespace
-    char* d = c;
-    while (*d != ' ' && *d != '\t' && *d != '\n' && *d != '\0') ++d; // gobble up initial word
-    if (d == c) continue; // no word
-    if (*d != ' ' && *d != '\t') continue; // reached end of line
-    char* word = calloc_or_throw<char>(d-c);
-    memcpy(word, c, d-c);
-    substring ss = { word, word + (d - c) };
-    uint64_t hash = uniform_hash( ss.begin, ss.end-ss.begin, quadratic_constant);
-    if (map->get(ss, hash) != nullptr)   // don't overwrite old values!
-    { free(word);
-      continue;
-    }
-    d--;
-    *d = '|';  // set up for parser::read_line
-    VW::read_line(all, ec, d);
-    // now we just need to grab stuff from the default namespace of ec!
-    if (ec->feature_space[def].size() == 0)
-    { free(word);
-      continue;
-    }
-    features* arr = new features;
-    arr->deep_copy_from(ec->feature_space[def]);
-    map->put(ss, hash, arr);
-
-    // clear up ec
-    ec->tag.erase(); ec->indices.erase();
-    for (size_t i=0; i<256; i++) { ec->feature_space[i].erase();}
-  }
-  while ((rc != EOF) && (nread > 0));
-  free(buffer);
-  io->close_file();
-  delete io;
-  VW::dealloc_example(all.p->lp.delete_label, *ec);
-  free(ec);
-
-  if (! all.quiet)
-    cerr << "dictionary " << s << " contains " << map->size() << " item" << (map->size() == 1 ? "\n" : "s\n");
-
-  all.namespace_dictionaries[(size_t)ns].push_back(map);
   dictionary_info info = { calloc_or_throw<char>(strlen(s)+1), fd_hash, map };
   strcpy(info.name, s);
   all.loaded_dictionaries.push_back(info);
@@ -367,13 +273,17 @@ void parse_source(vw& all)
   ("daemon", "persistent daemon mode on port 26542")
   ("port", po::value<size_t>(),"port to listen on; use 0 to pick unused port")
   ("num_children", po::value<size_t>(&(all.num_children)), "number of children for persistent daemon mode")
+  ("epoll", "in persistent daemon mode, each child serves all its clients at once from an epoll loop (Linux, text examples)")
   ("pid_file", po::value< string >(), "Write pid file in persistent daemon mode")
   ("port_file", po::value< string >(), "Write port used in persistent daemon mode")
   ("cache,c", "Use a cache.  The default is <data>.cache")
   ("cache_file", po::value< vector<string> >(), "The location(s) of cache_file.")
   ("kill_cache,k", "do not reuse existing cache: create a new one always")
-  ("compressed", "use gzip format whenever possible. If a cache file is being created, this option creates a compressed cache file. A mixture of raw-text & compressed inputs are supported with autodetection.")
-  ("no_stdin", "do not default to reading from stdin");
+  ("compressed", "use gzip format whenever possible. If a cache file is being created, this option creates a compressed cache file. A mixture of raw-text & compressed (gzip, zstd, lz4) inputs are supported with autodetection.")
+  ("compression", po::value<string>(), "codec of compressed cache files: gzip (default), zstd or lz4. Implies --compressed")
+  ("no_stdin", "do not default to reading from stdin")
+  ("read_ahead", "read input files in a background thread while parsing. Helps with gzipped input and slow (network) file systems.")
+  ("parse_threads", po::value<size_t>(&(all.p->parse_threads)), "number of threads parsing text or cache input. Examples are still learned in input order.");
   add_options(all);
 
   // Be friendly: if -d was left out, treat positional param as data file
@@ -393,24 +303,55 @@ void parse_source(vw& all)
   if ( (vm.count("total") || vm.count("node") || vm.count("unique_id")) && !(vm.count("total") && vm.count("node") && vm.count("unique_id")) )
     THROW("you must specificy unique_id, total, and node if you specify any");
 
-  if (vm.count("daemon") || vm.count("pid_file") || (vm.count("port") && !all.active) )
+  if (vm.count("daemon") || vm.count("pid_file") || vm.count("epoll") || (vm.count("port") && !all.active) )
   { all.daemon = true;
 
     // allow each child to process up to 1e5 connections
     all.numpasses = (size_t) 1e5;
   }
 
-  if (vm.count("compressed"))
-    set_compressed(all.p);
+  if (vm.count("epoll"))
+  { if (all.active)
+      THROW("--epoll does not support --active");
+    all.daemon_epoll = true;
+  }
+
+  if (all.daemon && all.p->parse_threads > 0)
+  { cerr << "warning: --parse_threads is ignored in daemon mode" << endl;
+    all.p->parse_threads = 0;
+  }
+
+  if (all.daemon && all.learner_threads > 1)
+  { cerr << "warning: --learner_threads is ignored in daemon mode" << endl;
+    all.learner_threads = 1;
+  }
+
+  comp_io_buf::codec codec = comp_io_buf::GZIP;
+  if (vm.count("compression"))
+  { string name = vm["compression"].as<string>();
+    if (name == "zstd")
+      codec = comp_io_buf::ZSTD;
+    else if (name == "lz4")
+      codec = comp_io_buf::LZ4;
+    else if (name != "gzip")
+      THROW("unknown --compression " << name << ", use gzip, zstd or lz4");
+    comp_io_buf::check_codec(codec);
+  }
+
+  if (vm.count("compressed") || vm.count("compression"))
+    set_compressed(all.p, codec);
 
   if (vm.count("data"))
   { all.data_filename = vm["data"].as<string>();
-    if (ends_with(all.data_filename, ".gz"))
-      set_compressed(all.p);
+    if (ends_with(all.data_filename, ".gz") || ends_with(all.data_filename, ".zst") || ends_with(all.data_filename, ".lz4"))
+      set_compressed(all.p, codec);
   }
   else
     all.data_filename = "";
 
+  if (vm.count("read_ahead"))
+    all.p->input->enable_read_ahead();
+
   if ((vm.count("cache") || vm.count("cache_file")) && vm.count("invert_hash"))
     THROW("invert_hash is incompatible with a cache file.  Use it in single pass mode only.");
 
@@ -523,6 +464,7 @@ void parse_feature_tweaks(vw& all)
   ("spelling", po::value< vector<string> >(), "compute spelling features for a give namespace (use '_' for default namespace)")
   ("dictionary", po::value< vector<string> >(), "read a dictionary for additional features (arg either 'x:file' or just 'file')")
   ("dictionary_path", po::value< vector<string> >(), "look in this directory for dictionaries; defaults to current directory or env{PATH}")
+  ("dictionary_compile", "compile each text dictionary given with --dictionary into <file>.vwdict, which --dictionary loads instantly (use the same --hash), then exit")
   ("interactions", po::value< vector<string> > (), "Create feature interactions of any level between namespaces.")
   ("permutations", "Use permutations instead of combinations for feature interactions of same namespace.")
   ("leave_duplicate_interactions", "Don't remove interactions with duplicate combinations of namespaces. For ex. this is a duplicate: '-q ab -q ba' and a lot more in '-q ::'.")
@@ -835,6 +777,8 @@ void parse_feature_tweaks(vw& all)
     { parse_dictionary_argument(all, dictionary_ns[id]);
       *all.file_options << " --dictionary " << dictionary_ns[id];
     }
+    if (vm.count("dictionary_compile"))
+      exit(0);
   }
 
   if (vm.count("noconstant"))
@@ -976,6 +920,8 @@ void parse_output_model(vw& all)
   ("invert_hash", po::value< string >(), "Output human-readable final regressor with feature names.  Computationally expensive.")
   ("save_resume", "save extra state so learning can be resumed later with new data")
   ("save_per_pass", "Save the model after every pass over data")
+  ("dense_model", "Save the weights as one page-aligned array, which -t maps into memory instead of reading")
+  ("save_in_background", "Save binary models from a copy of the weights on another thread while learning goes on")
   ("output_feature_regularizer_binary", po::value< string >(&(all.per_feature_regularizer_output)), "Per feature regularization output file")
   ("output_feature_regularizer_text", po::value< string >(&(all.per_feature_regularizer_text)), "Per feature regularization output file, in text")
   ("id", po::value< string >(&(all.id)), "User supplied ID embedded into the final regressor");
@@ -1004,6 +950,12 @@ void parse_output_model(vw& all)
   if (vm.count("save_resume"))
     all.save_resume = true;
 
+  if (vm.count("dense_model"))
+    all.dense_model = true;
+
+  if (vm.count("save_in_background"))
+    all.save_in_background = true;
+
   if (vm.count("id") && find(all.args.begin(), all.args.end(), "--id") == all.args.end())
   { all.args.push_back("--id");
     all.args.push_back(vm["id"].as<string>());
@@ -1033,11 +985,14 @@ void load_input_model(vw& all, io_buf& io_temp)
 }
 
 LEARNER::base_learner* setup_base(vw& all)
-{ LEARNER::base_learner* ret = all.reduction_stack.pop()(all);
+{ LEARNER::base_learner* (*setup)(vw&) = all.reduction_stack.pop();
+  LEARNER::base_learner* ret = setup(all);
   if (ret == nullptr)
     return setup_base(all);
   else
+  { all.enabled_reductions.push_back(setup);
     return ret;
+  }
 }
 
 void parse_reductions(vw& all)
@@ -1098,6 +1053,34 @@ void parse_reductions(vw& all)
   all.reduction_stack.push_back(audit_regressor_setup);
 
   all.l = setup_base(all);
+
+  if (all.learner_threads > 1)
+  { // learner threads share the learners; these keep no state of their own between example and update
+    for (LEARNER::base_learner* (*setup)(vw&) : all.enabled_reductions)
+      if (setup != GD::setup && setup != scorer_setup && setup != binary_setup)
+        THROW("--learner_threads supports the gd learner only, optionally with --binary");
+    if (all.reg_mode)
+      THROW("--learner_threads does not support --l1 and --l2");
+    if (all.audit)
+      THROW("--learner_threads does not support --audit");
+  }
+
+  if (all.use_sparse_weights)
+  { // these learners go through the weight vector rather than foreach_feature
+    for (LEARNER::base_learner* (*setup)(vw&) : all.enabled_reductions)
+      if (setup == bfgs_setup || setup == lda_setup || setup == gd_mf_setup || setup == OjaNewton_setup
+          || setup == print_setup || setup == lrq_setup || setup == lrqfa_setup || setup == stagewise_poly_setup
+          || setup == audit_regressor_setup)
+        THROW("--sparse_weights supports gd, ftrl and svrg based learners only, not --bfgs, --lda, --rank, --OjaNewton, --print, --lrq, --lrqfa, --stage_poly or --audit_regressor");
+    if (all.learner_threads > 1)
+      THROW("--learner_threads does not support --sparse_weights");
+    if (all.all_reduce != nullptr)
+      THROW("--span_server does not support --sparse_weights");
+    if (all.dense_model)
+      THROW("--dense_model does not support --sparse_weights");
+    if (all.random_weights || all.random_positive_weights)
+      THROW("--sparse_weights does not support random initial weights (--random_weights, --new_mf)");
+  }
 }
 
 void add_to_args(vw& all, int argc, char* argv[], int excl_param_count = 0, const char* excl_params[] = NULL)
@@ -1150,25 +1133,35 @@ vw& parse_args(int argc, char *argv[])
     ("initial_regressor,i", po::value< vector<string> >(), "Initial regressor(s)")
     ("initial_weight", po::value<float>(&(all.initial_weight)), "Set all weights to an initial value of arg.")
     ("random_weights", po::value<bool>(&(all.random_weights)), "make initial weights random")
+    ("sparse_weights", "Keep the weights in a hash table, allocating each as it is first learned, instead of an array of 2^b")
     ("input_feature_regularizer", po::value< string >(&(all.per_feature_regularizer_input)), "Per feature regularization input file");
     add_options(all);
 
     new_options(all, "Parallelization options")
     ("span_server", po::value<string>(), "Location of server for setting up spanning tree")
+    ("span_topology", po::value<string>()->default_value("tree"), "how nodes of a cluster job exchange data: tree, or ring (reduce-scatter and allgather, bandwidth-optimal for large weight vectors)")
     ("threads", "Enable multi-threading")
+    ("learner_threads", po::value<size_t>(&(all.learner_threads)), "number of threads learning at once, updating the weights without locking (Hogwild!)")
     ("unique_id", po::value<size_t>()->default_value(0), "unique id used for cluster parallel jobs")
     ("total", po::value<size_t>()->default_value(1), "total number of nodes used in cluster parallel job")
     ("node", po::value<size_t>()->default_value(0), "node number in cluster parallel job");
     add_options(all);
 
     po::variables_map& vm = all.vm;
+    if (vm.count("sparse_weights"))
+      all.use_sparse_weights = true;
+
+    string topology = vm["span_topology"].as<string>();
+    if (topology != "tree" && topology != "ring")
+      THROW("span_topology must be tree or ring, not " << topology);
     if (vm.count("span_server"))
     { all.all_reduce_type = AllReduceType::Socket;
       all.all_reduce = new AllReduceSockets(
         vm["span_server"].as<string>(),
         vm["unique_id"].as<size_t>(),
         vm["total"].as<size_t>(),
-        vm["node"].as<size_t>());
+        vm["node"].as<size_t>(),
+        topology == "ring");
     }
 
     msrand48(all.random_seed);
@@ -1346,8 +1339,13 @@ vw* initialize(string s, io_buf* model)
   return ret;
 }
 
-vw* initialize(int argc, char* argv[], io_buf* model)
+// seed: an instance whose weights to use rather than allocate and initialize a copy
+vw* initialize(int argc, char* argv[], io_buf* model, vw* seed)
 { vw& all = parse_args(argc, argv);
+  if (seed != nullptr)
+  { all.reg = seed->reg;
+    all.seeded = true;
+  }
 
   try
   { // if user doesn't pass in a model, read from arguments
@@ -1372,6 +1370,10 @@ vw* initialize(int argc, char* argv[], io_buf* model)
   }
 }
 
+vw* initialize(int argc, char* argv[], io_buf* model)
+{ return initialize(argc, argv, model, nullptr);
+}
+
 // Create a new VW instance while sharing the model with another instance
 // The extra arguments will be appended to those of the other VW instance
 vw* seed_vw_model(vw* vw_model, const string extra_args)
@@ -1388,26 +1390,26 @@ vw* seed_vw_model(vw* vw_model, const string extra_args)
     init_args << model_args[i] << " ";
   }
 
-  vw* new_model = VW::initialize(init_args.str().c_str());
+  int argc = 0;
+  char** argv = get_argv_from_string(init_args.str(), argc);
+  vw* new_model = nullptr;
+  try
+  { // the new instance never allocates weights of its own
+    new_model = initialize(argc, argv, nullptr, vw_model);
+  }
+  catch(...)
+  { free_args(argc, argv);
+    throw;
+  }
+  free_args(argc, argv);
 
-  free_it(new_model->reg.weight_vector);
+  // reference the shared data stored in the specified VW instance
   free_it(new_model->sd);
-
-  // reference model states stored in the specified VW instance
-  new_model->reg = vw_model->reg; // regressor
-  new_model->sd = vw_model->sd; // shared data
-
-  new_model->seeded = true;
+  new_model->sd = vw_model->sd;
 
   return new_model;
 }
 
-void delete_dictionary_entry(substring ss, features* A)
-{ free(ss.begin);
-  A->delete_v();
-  delete A;
-}
-
 void sync_stats(vw& all)
 { if (all.all_reduce != nullptr)
   { float loss = (float)all.sd->sum_loss;
@@ -1476,13 +1478,14 @@ void finish(vw& all, bool delete_all)
   { finalize_regressor_exception = e;
     finalize_regressor_exception_thrown = true;
   }
+  wait_for_background_save(all);
 
   if (all.l != nullptr)
   { all.l->finish();
     free_it(all.l);
   }
-  if (all.reg.weight_vector != nullptr && !all.seeded) // don't free weight vector if it is shared with another instance
-    free(all.reg.weight_vector);
+  if (!all.seeded) // don't free weight vector if it is shared with another instance
+    free_regressor(all.reg);
   free_parser(all);
   finalize_source(all.p);
   all.p->parse_name.erase();
@@ -1493,6 +1496,7 @@ void finish(vw& all, bool delete_all)
     free(all.sd);
   }
   all.reduction_stack.delete_v();
+  all.enabled_reductions.delete_v();
   delete all.file_options;
   for (size_t i = 0; i < all.final_prediction_sink.size(); i++)
     if (all.final_prediction_sink[i] != 1)
@@ -1500,9 +1504,7 @@ void finish(vw& all, bool delete_all)
   all.final_prediction_sink.delete_v();
   for (size_t i=0; i<all.loaded_dictionaries.size(); i++)
   { free(all.loaded_dictionaries[i].name);
-    all.loaded_dictionaries[i].dict->iter(delete_dictionary_entry);
-    all.loaded_dictionaries[i].dict->delete_v();
-    delete all.loaded_dictionaries[i].dict;
+    release_dictionary(all.loaded_dictionaries[i].dict);
   }
   delete all.loss;
 
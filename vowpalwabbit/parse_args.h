@@ -13,4 +13,5 @@ void parse_sources(vw& all, io_buf& model);
 LEARNER::base_learner* setup_base(vw& all);
 
 std::string spoof_hex_encoded_namespaces(const std::string& arg);
+bool ends_with(std::string const &fullString, std::string const &ending);
 // char** get_argv_from_string(string s, int& argc);
@@ -11,6 +11,7 @@ license as described in the file LICENSE.
 #include "unique_sort.h"
 #include "global_data.h"
 #include "constant.h"
+#include "feature_dictionary.h"
 
 using namespace std;
 
@@ -168,17 +169,17 @@ public:
       { for (size_t dict=0; dict<namespace_dictionaries[index].size(); dict++)
         { feature_dict* map = namespace_dictionaries[index][dict];
           uint64_t hash = uniform_hash(feature_name.begin, feature_name.end-feature_name.begin, quadratic_constant);
-          features* feats = map->get(feature_name, hash);
-          if ((feats != nullptr) && (feats->values.size() > 0))
+          const feature_dict::entry* feats = map->find(feature_name, hash);
+          if ((feats != nullptr) && (feats->count > 0))
             { features& dict_fs = ae->feature_space[dictionary_namespace];
               if (dict_fs.size() == 0)
                 ae->indices.push_back(dictionary_namespace);
-              push_many(dict_fs.values, feats->values.begin(), feats->values.size());
-              push_many(dict_fs.indicies, feats->indicies.begin(), feats->indicies.size());
+              push_many(dict_fs.values, map->values + feats->first, feats->count);
+              push_many(dict_fs.indicies, map->indices + feats->first, feats->count);
               dict_fs.sum_feat_sq += feats->sum_feat_sq;
               if (audit)
-                for (size_t i = 0; i < feats->indicies.size(); ++i)
-                  { uint64_t id = feats->indicies[i];
+                for (size_t i = 0; i < feats->count; ++i)
+                  { uint64_t id = map->indices[feats->first + i];
                     stringstream ss;
                     ss << index << '_';
                     for (char* fc=feature_name.begin; fc!=feature_name.end; ++fc) ss << *fc;
@@ -296,13 +297,13 @@ public:
     }
   }
 
-  TC_parser(char* reading_head, char* endLine, vw& all, example* ae)
+  TC_parser(char* reading_head, char* endLine, vw& all, parser* p, example* ae)
   { spelling = v_init<char>();
     if (endLine != reading_head)
     { this->beginLine = reading_head;
       this->reading_head = reading_head;
       this->endLine = endLine;
-      this->p = all.p;
+      this->p = p;
       this->redefine_some = all.redefine_some;
       this->redefine = &all.redefine;
       this->ae = ae;
@@ -317,8 +318,8 @@ public:
   }
 };
 
-void substring_to_example(vw* all, example* ae, substring example)
-{ all->p->lp.default_label(&ae->l);
+void substring_to_example(vw* all, parser* p, example* ae, substring example)
+{ p->lp.default_label(&ae->l);
   char* bar_location = safe_index(example.begin, '|', example.end);
   char* tab_location = safe_index(example.begin, '\t', bar_location);
   substring label_space;
@@ -331,34 +332,36 @@ void substring_to_example(vw* all, example* ae, substring example)
   label_space.end = bar_location;
 
   if (*example.begin == '|')
-  { all->p->words.erase();
+  { p->words.erase();
   }
   else
-  { tokenize(' ', label_space, all->p->words);
-    if (all->p->words.size() > 0 && (all->p->words.last().end == label_space.end	|| *(all->p->words.last().begin) == '\'')) //The last field is a tag, so record and strip it off
-    { substring tag = all->p->words.pop();
+  { tokenize(' ', label_space, p->words);
+    if (p->words.size() > 0 && (p->words.last().end == label_space.end	|| *(p->words.last().begin) == '\'')) //The last field is a tag, so record and strip it off
+    { substring tag = p->words.pop();
       if (*tag.begin == '\'')
         tag.begin++;
       push_many(ae->tag, tag.begin, tag.end - tag.begin);
     }
   }
 
-  if (all->p->words.size() > 0)
-    all->p->lp.parse_label(all->p, all->sd, &ae->l, all->p->words);
+  if (p->words.size() > 0)
+    p->lp.parse_label(p, all->sd, &ae->l, p->words);
 
   if (all->audit || all->hash_inv)
-    TC_parser<true> parser_line(bar_location,example.end,*all,ae);
+    TC_parser<true> parser_line(bar_location,example.end,*all,p,ae);
   else
-    TC_parser<false> parser_line(bar_location,example.end,*all,ae);
+    TC_parser<false> parser_line(bar_location,example.end,*all,p,ae);
 }
 
-int read_features(void* in, example* ex)
-{ vw* all = (vw*)in;
-  example* ae = (example*)ex;
-  char *line=nullptr;
-  size_t num_chars_initial = readto(*(all->p->input), line, '\n');
+void substring_to_example(vw* all, example* ae, substring example)
+{ substring_to_example(all, all->p, ae, example);
+}
+
+size_t read_example_line(io_buf& input, substring& example)
+{ char *line=nullptr;
+  size_t num_chars_initial = readto(input, line, '\n');
   if (num_chars_initial < 1)
-    return (int)num_chars_initial;
+    return num_chars_initial;
   size_t num_chars = num_chars_initial;
   if (line[0] =='\xef' && num_chars >= 3 && line[1] == '\xbb' && line[2] == '\xbf')
   { line += 3;
@@ -368,7 +371,18 @@ int read_features(void* in, example* ex)
     num_chars--;
   if (line[num_chars-1] == '\r')
     num_chars--;
-  substring example = {line, line + num_chars};
+  example.begin = line;
+  example.end = line + num_chars;
+  return num_chars_initial;
+}
+
+int read_features(void* in, example* ex)
+{ vw* all = (vw*)in;
+  example* ae = (example*)ex;
+  substring example;
+  size_t num_chars_initial = read_example_line(*(all->p->input), example);
+  if (num_chars_initial < 1)
+    return (int)num_chars_initial;
   substring_to_example(all, ae, example);
 
   return (int)num_chars_initial;
@@ -7,10 +7,16 @@ license as described in the file LICENSE.
 #include <stdint.h>
 #include "parse_primitives.h"
 #include "example.h"
+#include "io_buf.h"
+
+struct vw;
+struct parser;
 
 //example processing
 
 int read_features(void* a, example* ex);// read example from  preset buffers.
+size_t read_example_line(io_buf& input, substring& example);// next raw line of input, without the line terminator.
+void substring_to_example(vw* all, parser* p, example* ae, substring example);// parse a line using the scratch space of p.
 namespace VW
 {
 void read_line(vw& all, example* ex, char* line);//read example from the line.
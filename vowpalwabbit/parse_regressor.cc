@@ -11,6 +11,10 @@ using namespace std;
 
 #ifndef _WIN32
 #include <unistd.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#else
+#include <Windows.h>
 #endif
 
 #include <stdlib.h>
@@ -24,15 +28,22 @@ using namespace std;
 #include "vw_exception.h"
 #include "vw_validate.h"
 #include "vw_versions.h"
+#include "weight_blocks.h"
+#include "sparse_weights.h"
 
 void initialize_regressor(vw& all)
 { // Regressor is already initialized.
-  if (all.reg.weight_vector != nullptr)
+  if (all.reg.weight_vector != nullptr || all.reg.sparse != nullptr)
   { return;
   }
 
   size_t length = ((size_t)1) << all.num_bits;
   all.reg.weight_mask = (length << all.reg.stride_shift) - 1;
+  if (all.use_sparse_weights) // weights get blocks as they are used
+  { all.reg.sparse = new_sparse_weights(all.reg.stride_shift);
+    all.reg.sparse->initial[0] = all.initial_weight;
+    return;
+  }
   try
     { all.reg.weight_vector = calloc_mergable_or_throw<weight>(length << all.reg.stride_shift);
     }
@@ -52,6 +63,23 @@ void initialize_regressor(vw& all)
       all.reg.weight_vector[j << all.reg.stride_shift] = (float)(frand48() - 0.5);
 }
 
+void free_regressor(regressor& r)
+{ if (r.sparse != nullptr)
+  { free_sparse_weights(r.sparse);
+    r.sparse = nullptr;
+  }
+  if (r.weight_vector == nullptr)
+    return;
+#ifndef _WIN32
+  if (r.mapped_length > 0)
+    munmap(r.weight_vector, r.mapped_length);
+  else
+#endif
+    free(r.weight_vector);
+  r.weight_vector = nullptr;
+  r.mapped_length = 0;
+}
+
 const size_t default_buf_size = 512;
 
 bool resize_buf_if_needed(char *& __dest, size_t& __dest_size, const size_t __n)
@@ -401,10 +429,114 @@ void dump_regressor(vw& all, io_buf& buf, bool as_text)
   buf.close_file();
 }
 
+/* With --save_in_background everything but the weights of a binary model is
+** written right away, the weights are copied, and another thread writes them,
+** then renames the file.  One model is saved at a time.
+*/
+struct background_save
+{ io_buf model_file;
+  string start_name;
+  string reg_name;
+  float* weights; // the copy, floats of each of length weights
+  uint64_t length;
+  size_t floats;
+#ifndef _WIN32
+  pthread_t thread;
+#else
+  HANDLE thread;
+#endif
+};
+
+void end_save(background_save& s)
+{ s.model_file.flush();
+  s.model_file.close_file();
+  remove(s.reg_name.c_str());
+  rename(s.start_name.c_str(), s.reg_name.c_str());
+}
+
+#ifdef _WIN32
+DWORD WINAPI background_save_loop(LPVOID in)
+#else
+void* background_save_loop(void* in)
+#endif
+{ background_save& s = *(background_save*)in;
+  write_weight_blocks(s.model_file, s.weights, s.length, s.floats, s.floats);
+  end_save(s);
+  return 0;
+}
+
+bool defer_weights(vw& all, size_t floats)
+{ background_save* s = all.pending_save;
+  if (s == nullptr || s->weights != nullptr)
+    return false;
+  uint64_t length = all.length();
+  s->weights = calloc_or_throw<float>(length * floats);
+  for (uint64_t i = 0; i < length; i++)
+    memcpy(s->weights + i * floats, all.reg.weight_vector + (i << all.reg.stride_shift), floats * sizeof(float));
+  s->length = length;
+  s->floats = floats;
+  return true;
+}
+
+void wait_for_background_save(vw& all)
+{ background_save* s = all.pending_save;
+  if (s == nullptr)
+    return;
+  all.pending_save = nullptr;
+  if (s->weights != nullptr)
+  {
+#ifndef _WIN32
+    pthread_join(s->thread, nullptr);
+#else
+    ::WaitForSingleObject(s->thread, INFINITE);
+    ::CloseHandle(s->thread);
+#endif
+    free(s->weights);
+  }
+  delete s;
+}
+
+void start_background_save(vw& all, string start_name, string reg_name)
+{ wait_for_background_save(all);
+  background_save* s = new background_save;
+  s->start_name = start_name;
+  s->reg_name = reg_name;
+  s->weights = nullptr;
+  all.pending_save = s;
+  try
+  { s->model_file.open_file(start_name.c_str(), all.stdin_off, io_buf::WRITE);
+    save_load_header(all, s->model_file, false, false);
+    all.l->save_load(s->model_file, false, false);
+  }
+  catch (...)
+  { s->model_file.close_file();
+    free(s->weights);
+    delete s;
+    all.pending_save = nullptr;
+    throw;
+  }
+
+  if (s->weights == nullptr) // the learner wrote its weights itself
+  { end_save(*s);
+    wait_for_background_save(all);
+    return;
+  }
+  s->model_file.flush();
+#ifndef _WIN32
+  pthread_create(&s->thread, nullptr, background_save_loop, s);
+#else
+  s->thread = ::CreateThread(nullptr, 0, static_cast<LPTHREAD_START_ROUTINE>(background_save_loop), s, 0L, nullptr);
+#endif
+}
+
 void dump_regressor(vw& all, string reg_name, bool as_text)
 { if (reg_name == string(""))
     return;
   string start_name = reg_name+string(".writing");
+  if (all.save_in_background && !as_text)
+  { start_background_save(all, start_name, reg_name);
+    return;
+  }
   io_buf io_temp;
 
   io_temp.open_file(start_name.c_str(), all.stdin_off, io_buf::WRITE);
@@ -462,7 +594,7 @@ void parse_regressor_args(vw& all, io_buf& io_temp)
 
 void parse_mask_regressor_args(vw& all)
 { po::variables_map& vm = all.vm;
-  if (vm.count("feature_mask"))
+  if (vm.count("feature_mask") && !all.seeded) // a seeded instance shares masked weights
   { size_t length = ((size_t)1) << all.num_bits;
     string mask_filename = vm["feature_mask"].as<string>();
     if (vm.count("initial_regressor"))
@@ -490,9 +622,15 @@ void parse_mask_regressor_args(vw& all)
       io_temp.close_file();
 
       // Re-zero the weights, in case weights of initial regressor use different indices
-      for (size_t j = 0; j < length; j++)
-      { all.reg.weight_vector[j << all.reg.stride_shift] = 0.;
-      }
+      if (all.reg.sparse != nullptr)
+        for (uint64_t j = 0; j < all.reg.sparse->buckets; j++)
+        { if (all.reg.sparse->table[j].key != 0)
+            all.reg.sparse->table[j].block[0] = 0.;
+        }
+      else
+        for (size_t j = 0; j < length; j++)
+        { all.reg.weight_vector[j << all.reg.stride_shift] = 0.;
+        }
     }
     else
     { // If no initial regressor, just clear out the options loaded from the header.
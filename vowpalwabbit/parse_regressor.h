@@ -14,8 +14,17 @@ void parse_regressor_args(vw& all, io_buf& io_temp);
 
 void finalize_regressor(vw& all, std::string reg_name);
 void initialize_regressor(vw& all);
+void free_regressor(regressor& r); // allocated or mapped
 
 void save_predictor(vw& all, std::string reg_name, size_t current_pass);
+
+// With --save_in_background, a binary model being saved to a file takes a copy of the
+// weights (floats of each) to write on another thread; false if they are to be
+// written now.
+bool defer_weights(vw& all, size_t floats);
+
+// wait until the model being saved in the background, if any, is written
+void wait_for_background_save(vw& all);
 void save_load_header(vw& all, io_buf& model_file, bool read, bool text);
 
 void parse_mask_regressor_args(vw& all);
@@ -50,6 +50,10 @@ namespace po = boost::program_options;
 #include "vw.h"
 #include "interactions.h"
 #include "vw_exception.h"
+#include "example_ring.h"
+#include "mmap_io_buf.h"
+#include "parse_regressor.h"
+#include "best_constant.h"
 
 using namespace std;
 
@@ -79,6 +83,14 @@ void initialize_condition_variable(CV * pcv)
 #endif
 }
 
+#ifndef _WIN32
+void delete_condition_variable(CV * pcv)
+{ pthread_cond_destroy(pcv);
+}
+#else
+void delete_condition_variable(CV *) { /* no operation necessary here*/ }
+#endif
+
 void mutex_lock(MUTEX * pm)
 {
 #ifndef _WIN32
@@ -141,7 +153,7 @@ bool is_test_only(uint32_t counter, uint32_t period, uint32_t after, bool holdou
 
 parser* new_parser()
 { parser& ret = calloc_or_throw<parser>();
-  ret.input = new io_buf;
+  ret.input = new mmap_io_buf;
   ret.output = new io_buf;
   ret.local_example_number = 0;
   ret.in_pass_counter = 0;
@@ -152,14 +164,15 @@ parser* new_parser()
   return &ret;
 }
 
-void set_compressed(parser* par)
+void set_compressed(parser* par, comp_io_buf::codec write_codec)
 { finalize_source(par);
   par->input = new comp_io_buf;
-  par->output = new comp_io_buf;
+  par->output = new comp_io_buf(write_codec);
 }
 
-uint32_t cache_numbits(io_buf* buf, int filepointer)
+uint32_t cache_numbits(io_buf* buf, int filepointer, char& format)
 { v_array<char> t = v_init<char>();
+  format = CACHE_V1;
 
   try
     {  size_t v_length;
@@ -186,8 +199,9 @@ uint32_t cache_numbits(io_buf* buf, int filepointer)
       if (buf->read_file(filepointer, &temp, 1) < 1)
 	THROW("failed to read");
 
-      if (temp != 'c')
+      if (temp != CACHE_V1 && temp != CACHE_V2)
 	THROW("data file is not a cache file");
+      format = temp;
     }
   catch(...)
     { t.delete_v();
@@ -213,8 +227,10 @@ bool member(v_array<int> ids, int id)
 void reset_source(vw& all, size_t numbits)
 { io_buf* input = all.p->input;
   input->current = 0;
+  all.p->cache_examples_left = 0;
   if (all.p->write_cache)
-    { all.p->output->flush();
+    { finish_cache_blocks(all.p);
+    all.p->output->flush();
     all.p->write_cache = false;
     all.p->output->close_file();
     remove(all.p->output->finalname.begin());
@@ -223,7 +239,7 @@ void reset_source(vw& all, size_t numbits)
       if (input->compressed())
         input->close_file();
       else
-      { int fd = input->files.pop();
+      { int fd = input->detach_file();
         if (!member(all.final_prediction_sink, (size_t) fd))
           io_buf::close_file_or_socket(fd);
       }
@@ -233,10 +249,9 @@ void reset_source(vw& all, size_t numbits)
   if ( all.p->resettable == true )
   { if (all.daemon)
     { // wait for all predictions to be sent back to client
-      mutex_lock(&all.p->output_lock);
-      while (all.p->local_example_number != all.p->end_parsed_examples)
-        condition_variable_wait(&all.p->output_done, &all.p->output_lock);
-      mutex_unlock(&all.p->output_lock);
+      parser* p = all.p;
+      RING::spin_then_park([p] { return RING::load(&p->local_example_number) == RING::load(&p->end_parsed_examples); },
+                           &p->output_lock, &p->output_done, &p->parked_outputs);
 
       // close socket, erase final prediction sink and socket
       io_buf::close_file_or_socket(all.p->input->files[0]);
@@ -256,6 +271,7 @@ void reset_source(vw& all, size_t numbits)
 
       if (isbinary(*(all.p->input)))
       { all.p->reader = read_cached_features;
+        all.p->cache_format = CACHE_V1;
         all.print = binary_print_result;
       }
       else
@@ -266,7 +282,7 @@ void reset_source(vw& all, size_t numbits)
     else
     { for (size_t i = 0; i < input->files.size(); i++)
       { input->reset_file(input->files[i]);
-        if (cache_numbits(input, input->files[i]) < numbits)
+        if (cache_numbits(input, input->files[i], all.p->cache_format) < numbits)
           THROW("argh, a bug in caching of some sort!");
       }
     }
@@ -285,6 +301,7 @@ void finalize_source(parser* p)
   p->input->close_files();
 
   delete p->input;
+  free_cache_blocks(p);
   p->output->close_files();
   delete p->output;
 }
@@ -309,8 +326,9 @@ void make_write_cache(vw& all, string &newname, bool quiet)
 
   output->write_file(f, &v_length, sizeof(v_length));
   output->write_file(f,version.to_string().c_str(),v_length);
-  output->write_file(f,"c",1);
+  output->write_file(f, &CACHE_V2, 1);
   output->write_file(f, &all.num_bits, sizeof(all.num_bits));
+  start_cache_blocks(all.p);
 
   push_many(output->finalname,newname.c_str(),newname.length()+1);
   all.p->write_cache = true;
@@ -334,11 +352,13 @@ void parse_cache(vw& all, po::variables_map &vm, string source,
       try
       { f = all.p->input->open_file(caches[i].c_str(), all.stdin_off, io_buf::READ);
       }
+      catch (VW::vw_codec_exception const&) { throw; }
       catch (exception e) { f = -1; }
     if (f == -1)
       make_write_cache(all, caches[i], quiet);
     else
-    { uint64_t c = cache_numbits(all.p->input, f);
+    { char format;
+      uint64_t c = cache_numbits(all.p->input, f, format);
       if (c < all.num_bits)
       { if (!quiet)
           cerr << "WARNING: cache file is ignored as it's made with less bit precision than required!" << endl;
@@ -349,6 +369,9 @@ void parse_cache(vw& all, po::variables_map &vm, string source,
       { if (!quiet)
           cerr << "using cache_file = " << caches[i].c_str() << endl;
         all.p->reader = read_cached_features;
+        if (all.p->cache_format != 0 && all.p->cache_format != format)
+          THROW("cache files " << caches[0] << " and " << caches[i] << " have different formats, use -k to rebuild them");
+        all.p->cache_format = format;
         if (c == all.num_bits)
           all.p->sorted_cache = true;
         else
@@ -411,8 +434,8 @@ void enable_sources(vw& all, bool quiet, size_t passes)
     if ( ::bind(all.p->bound_sock,(sockaddr*)&address, sizeof(address)) < 0 )
       THROWERRNO("bind");
 
-    // listen on socket
-    if (listen(all.p->bound_sock, 1) < 0)
+    // listen on socket; an epoll daemon takes many clients at once
+    if (listen(all.p->bound_sock, all.daemon_epoll ? SOMAXCONN : 1) < 0)
       THROWERRNO("listen");
 
     // write port file
@@ -451,16 +474,21 @@ void enable_sources(vw& all, bool quiet, size_t passes)
       THROW("not supported on windows");
 #else
       fclose(stdin);
-      // weights will be shared across processes, accessible to children
-      float* shared_weights =
-        (float*)mmap(0,(all.length() << all.reg.stride_shift) * sizeof(float),
-                     PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
-
-      size_t float_count = all.length() << all.reg.stride_shift;
-      weight* dest = shared_weights;
-      memcpy(dest, all.reg.weight_vector, float_count*sizeof(float));
-      free(all.reg.weight_vector);
-      all.reg.weight_vector = dest;
+      // weights will be shared across processes, accessible to children; a mapped
+      // model (only predicting) is shared already, and a --sparse_weights table
+      // cannot be: each child learns on its own copy
+      if (all.reg.mapped_length == 0 && all.reg.sparse == nullptr)
+      { float* shared_weights =
+          (float*)mmap(0,(all.length() << all.reg.stride_shift) * sizeof(float),
+                       PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+
+        size_t float_count = all.length() << all.reg.stride_shift;
+        weight* dest = shared_weights;
+        memcpy(dest, all.reg.weight_vector, float_count*sizeof(float));
+        free_regressor(all.reg);
+        all.reg.weight_vector = dest;
+        all.reg.mapped_length = float_count*sizeof(float);
+      }
 
       // learning state to be shared across children
       shared_data* sd = (shared_data *)mmap(0,sizeof(shared_data),
@@ -519,6 +547,11 @@ void enable_sources(vw& all, bool quiet, size_t passes)
 #ifndef _WIN32
 child:
 #endif
+    if (all.daemon_epoll) // serve_daemon_connections accepts the clients
+    { all.print = print_result;
+      return;
+    }
+
     sockaddr_in client_address;
     socklen_t size = sizeof(client_address);
     all.p->max_fd = 0;
@@ -544,6 +577,7 @@ child:
     else
     { if (isbinary(*(all.p->input)))
       { all.p->reader = read_cached_features;
+        all.p->cache_format = CACHE_V1;
         all.print = binary_print_result;
       }
       else
@@ -565,6 +599,9 @@ child:
       try
       { all.p->input->open_file(temp.c_str(), all.stdin_off, io_buf::READ);
       }
+      catch (VW::vw_codec_exception const&)
+      { throw;
+      }
       catch (exception const& ex)
       { // when trying to fix this exception, consider that an empty temp is valid if all.stdin_off is false
         if (temp.size() != 0)
@@ -590,9 +627,8 @@ child:
 
 void set_done(vw& all)
 { all.early_terminate = true;
-  mutex_lock(&all.p->examples_lock);
-  all.p->done = true;
-  mutex_unlock(&all.p->examples_lock);
+  RING::store(&all.p->done, true);
+  RING::wake_parked(&all.p->examples_lock, &all.p->example_available, &all.p->parked_learners);
 }
 
 void addgrams(vw& all, size_t ngram, size_t skip_gram, features& fs,
@@ -635,30 +671,45 @@ void addgrams(vw& all, size_t ngram, size_t skip_gram, features& fs,
  * Hash is evaluated using the principle h(a, b) = h(a)*X + h(b), where X is a random no.
  * 32 random nos. are maintained in an array and are used in the hashing.
  */
-void generateGrams(vw& all, example* &ex)
+void generateGrams(vw& all, parser* p, example* &ex)
 { for(namespace_index index : ex->indices)
   { size_t length = ex->feature_space[index].size();
     for (size_t n = 1; n < all.ngram[index]; n++)
-    { all.p->gram_mask.erase();
-      all.p->gram_mask.push_back((size_t)0);
+    { p->gram_mask.erase();
+      p->gram_mask.push_back((size_t)0);
       addgrams(all, n, all.skips[index], ex->feature_space[index],
-               length, all.p->gram_mask, 0);
+               length, p->gram_mask, 0);
     }
   }
 }
 
-example* get_unused_example(vw& all)
-{ while (true)
-  { mutex_lock(&all.p->examples_lock);
-    if (all.p->examples[all.p->begin_parsed_examples % all.p->ring_size].in_use == false)
-    { example& ret = all.p->examples[all.p->begin_parsed_examples++ % all.p->ring_size];
-      ret.in_use = true;
-      mutex_unlock(&all.p->examples_lock);
+// like get_unused_example, but returns nullptr instead of waiting for the learner
+example* try_get_unused_example(vw& all)
+{ parser* p = all.p;
+  while (true)
+  { uint64_t begin = RING::load(&p->begin_parsed_examples);
+    example& ret = p->examples[begin % p->ring_size];
+    if (RING::load(&ret.in_use))
+      return nullptr;
+    // producers race for the slot on begin_parsed_examples; the winner owns it until publishing
+    if (RING::compare_exchange(&p->begin_parsed_examples, begin, begin + 1))
+    { RING::store(&ret.in_use, true);
       return &ret;
     }
-    else
-      condition_variable_wait(&all.p->example_unused, &all.p->examples_lock);
-    mutex_unlock(&all.p->examples_lock);
+  }
+}
+
+example* get_unused_example(vw& all)
+{ parser* p = all.p;
+  while (true)
+  { example* ret = try_get_unused_example(all);
+    if (ret != nullptr)
+      return ret;
+    // wait for the learner to finish the oldest example, or for another producer to claim it
+    uint64_t begin = RING::load(&p->begin_parsed_examples);
+    example* next = p->examples + begin % p->ring_size;
+    RING::spin_then_park([p, begin, next] { return !RING::load(&next->in_use) || RING::load(&p->begin_parsed_examples) != begin; },
+                         &p->examples_lock, &p->example_unused, &p->parked_producers);
   }
 }
 
@@ -672,9 +723,7 @@ bool parse_atomic_example(vw& all, example* ae, bool do_read = true)
     unique_sort_features(all.parse_mask, ae);
 
   if (all.p->write_cache)
-    { all.p->lp.cache_label(&ae->l,*(all.p->output));
-    cache_features(*(all.p->output), ae, all.parse_mask);
-  }
+    cache_example(all, ae);
   return true;
 }
 }
@@ -694,15 +743,19 @@ void feature_limit(vw& all, example* ex)
       }
 }
 
-namespace VW
-{
-void setup_example(vw& all, example* ae)
-{ ae->partial_prediction = 0.;
+// the order dependent part of setup_example: counters, holdout assignment and the labels
+// best_constant has seen, which are counted here rather than by the label parsers that
+// --parse_threads runs on its workers
+void setup_example_counter(vw& all, example* ae, uint64_t example_counter)
+{ if (all.p->lp.parse_label == simple_label.parse_label)
+    count_label(ae->l.simple.label);
+
+  ae->partial_prediction = 0.;
   ae->num_features = 0;
   ae->total_sum_feat_sq = 0;
   ae->loss = 0.;
 
-  ae->example_counter = (size_t)(all.p->end_parsed_examples);
+  ae->example_counter = (size_t)example_counter;
   if (!all.p->emptylines_separate_examples)
     all.p->in_pass_counter++;
 
@@ -710,8 +763,12 @@ void setup_example(vw& all, example* ae)
 
   if (all.p->emptylines_separate_examples && example_is_newline(*ae))
     all.p->in_pass_counter++;
+}
 
-  ae->weight = all.p->lp.get_weight(&ae->l);
+// the rest of setup_example only touches ae and the scratch space of p, so it can run on any thread.
+// Without count_generated, num_features and total_sum_feat_sq leave out the generated interactions.
+void setup_example_features(vw& all, parser* p, example* ae, bool count_generated = true)
+{ ae->weight = p->lp.get_weight(&ae->l);
  
   if (all.ignore_some)
     for (unsigned char* i = ae->indices.begin(); i != ae->indices.end(); i++)
@@ -724,7 +781,7 @@ void setup_example(vw& all, example* ae)
       }
 
   if(all.ngram_strings.size() > 0)
-    generateGrams(all, ae);
+    generateGrams(all, p, ae);
 
   if (all.add_constant)//add constant feature
     VW::add_constant_feature(all,ae);
@@ -743,6 +800,8 @@ void setup_example(vw& all, example* ae)
   { ae->num_features += fs.size();
     ae->total_sum_feat_sq += fs.sum_feat_sq;
   }
+  if (!count_generated)
+    return;
 
   size_t new_features_cnt;
   float new_features_sum_feat_sq;
@@ -750,6 +809,13 @@ void setup_example(vw& all, example* ae)
   ae->num_features += new_features_cnt;
   ae->total_sum_feat_sq += new_features_sum_feat_sq;
 }
+
+namespace VW
+{
+void setup_example(vw& all, example* ae)
+{ setup_example_counter(all, ae, all.p->end_parsed_examples);
+  setup_example_features(all, all.p, ae);
+}
 }
 
 namespace VW
@@ -757,8 +823,7 @@ namespace VW
 example* new_unused_example(vw& all)
 { example* ec = get_unused_example(all);
   all.p->lp.default_label(&ec->l);
-  all.p->begin_parsed_examples++;
-  ec->example_counter = (size_t)all.p->begin_parsed_examples;
+  ec->example_counter = (size_t)RING::fetch_add(&all.p->begin_parsed_examples, 1) + 1;
   return ec;
 }
 example* read_example(vw& all, char* example_line)
@@ -767,13 +832,24 @@ example* read_example(vw& all, char* example_line)
   VW::read_line(all, ret, example_line);
   parse_atomic_example(all,ret,false);
   setup_example(all, ret);
-  all.p->end_parsed_examples++;
+  RING::fetch_add(&all.p->end_parsed_examples, 1);
 
   return ret;
 }
 
 example* read_example(vw& all, string example_line) { return read_example(all, (char*)example_line.c_str()); }
 
+void parse_example(vw& all, example* ec, char* example_line)
+{ empty_example(all, *ec);
+  VW::read_line(all, ec, example_line);
+  parse_atomic_example(all, ec, false);
+  ec->partial_prediction = 0.;
+  ec->loss = 0.;
+  ec->test_only = true;
+  // the interactions are not counted here; predict generates them for each example
+  setup_example_features(all, all.p, ec, false);
+}
+
 void add_constant_feature(vw& vw, example*ec)
 {
   ec->indices.push_back(constant_namespace);
@@ -804,7 +880,7 @@ example* import_example(vw& all, string label, primitive_feature_space* features
   }
   VW::parse_atomic_example(all,ret,false);
   setup_example(all, ret);
-  all.p->end_parsed_examples++;
+  RING::fetch_add(&all.p->end_parsed_examples, 1);
   return ret;
 }
 
@@ -862,21 +938,278 @@ void finish_example(vw& all, example* ec)
   if (!is_ring_example(all, ec))
     return;
 
-  mutex_lock(&all.p->output_lock);
-  all.p->local_example_number++;
-  condition_variable_signal(&all.p->output_done);
-  mutex_unlock(&all.p->output_lock);
+  parser* p = all.p;
+  if (is_barrier_example(ec))
+    RING::fetch_add(&p->barriers_finished, 1);
+  RING::fetch_add(&p->local_example_number, 1);
+  RING::wake_parked(&p->output_lock, &p->output_done, &p->parked_outputs);
 
   empty_example(all, *ec);
 
-  mutex_lock(&all.p->examples_lock);
   assert(ec->in_use);
-  ec->in_use = false;
-  condition_variable_signal(&all.p->example_unused);
-  if (all.p->done)
-    condition_variable_signal_all(&all.p->example_available);
-  mutex_unlock(&all.p->examples_lock);
+  RING::store(&ec->in_use, false);
+  RING::wake_parked(&p->examples_lock, &p->example_unused, &p->parked_producers);
+}
+}
+
+void publish_examples(vw& all, size_t count)
+{ RING::fetch_add(&all.p->end_parsed_examples, count);
+  RING::wake_parked(&all.p->examples_lock, &all.p->example_available, &all.p->parked_learners);
+}
+
+// publishes the end of pass example ae, then marks the parser done after the last pass
+void end_pass_reached(vw& all, example* ae, size_t& example_number)
+{ reset_source(all, all.num_bits);
+  all.do_reset_source = false;
+  all.passes_complete++;
+  end_pass_example(all, ae);
+  if (all.passes_complete == all.numpasses && example_number == all.pass_length)
+  { all.passes_complete = 0;
+    all.pass_length = all.pass_length*2+1;
+  }
+  bool finished = all.passes_complete >= all.numpasses && all.max_examples >= example_number;
+  example_number = 0;
+  publish_examples(all, 1);
+  if (finished)
+  { RING::store(&all.p->done, true);
+    RING::wake_parked(&all.p->examples_lock, &all.p->example_available, &all.p->parked_learners);
+  }
+}
+
+/* Parallel parsing (--parse_threads) of text and v2 caches.
+** The parse thread keeps everything that depends on input order: it reads raw lines
+** or cached examples, claims ring slots, assigns example counters and holdout, and
+** writes the cache.  Workers tokenize, hash and featurize the lines of a batch, or
+** decode its cached examples, each with its own parser scratch space.  Examples are handed to the learner in input order, so
+** results are identical to single threaded parsing.
+*/
+enum parse_stage { PARSE_LINES = 1, SETUP_FEATURES = 2, STOP_WORKERS = 3 };
+
+struct parse_worker
+{ parse_pool* pool;
+  size_t id;
+  parser* scratch;
+#ifndef _WIN32
+  pthread_t thread;
+#else
+  HANDLE thread;
+#endif
+};
+
+struct parse_pool
+{ vw* all;
+  size_t num_workers;
+  parse_worker* workers;
+  size_t batch_size;
+
+  MUTEX lock;
+  CV work_available;
+  CV work_complete;
+  parse_stage stage;
+  uint64_t generation; // incremented whenever a stage is posted
+  size_t busy; // workers still running the current stage
+
+  v_array<example*> batch;
+  v_array<v_array<char> > lines; // raw text or cached bytes of each batch entry
+  uint64_t first_example; // example counter of batch[0]
+};
+
+parser* new_parse_scratch(parser& p)
+{ parser& ret = calloc_or_throw<parser>();
+  ret.hasher = p.hasher;
+  ret.lp = p.lp;
+  ret.emptylines_separate_examples = p.emptylines_separate_examples;
+  ret.input = new cache_view;
+  return &ret;
+}
+
+void free_parse_scratch(parser* p)
+{ delete p->input;
+  p->words.delete_v();
+  p->name.delete_v();
+  p->channels.delete_v();
+  p->parse_name.delete_v();
+  p->gram_mask.delete_v();
+  free(p);
+}
+
+void parse_batch_entry(vw& all, parser* scratch, parse_pool& pool, size_t i)
+{ example* ae = pool.batch[i];
+  v_array<char>& line = pool.lines[i];
+  if (all.p->reader == read_cached_features)
+  { cache_view& view = *(cache_view*)scratch->input;
+    view.view(line.begin(), line.end());
+    read_cached_example(&all, view, CACHE_V2, ae);
+  }
+  else
+  { scratch->end_parsed_examples = pool.first_example + i; // only used for parser warnings
+    substring example = { line.begin(), line.end() - 1 };
+    substring_to_example(&all, scratch, ae, example);
+  }
+  if (all.p->sort_features && ae->sorted == false)
+    unique_sort_features(all.parse_mask, ae);
+}
+
+#ifdef _WIN32
+DWORD WINAPI parse_worker_loop(LPVOID in)
+#else
+void *parse_worker_loop(void *in)
+#endif
+{ parse_worker& w = *(parse_worker*) in;
+  parse_pool& pool = *w.pool;
+  vw& all = *pool.all;
+  uint64_t seen = 0;
+
+  while (true)
+  { mutex_lock(&pool.lock);
+    while (pool.generation == seen)
+      condition_variable_wait(&pool.work_available, &pool.lock);
+    seen = pool.generation;
+    parse_stage stage = pool.stage;
+    mutex_unlock(&pool.lock);
+
+    if (stage == STOP_WORKERS)
+      break;
+
+    for (size_t i = w.id; i < pool.batch.size(); i += pool.num_workers)
+      if (stage == PARSE_LINES)
+        parse_batch_entry(all, w.scratch, pool, i);
+      else
+        setup_example_features(all, w.scratch, pool.batch[i]);
+
+    mutex_lock(&pool.lock);
+    if (--pool.busy == 0)
+      condition_variable_signal(&pool.work_complete);
+    mutex_unlock(&pool.lock);
+  }
+  return 0L;
+}
+
+void run_stage(parse_pool& pool, parse_stage stage)
+{ mutex_lock(&pool.lock);
+  pool.stage = stage;
+  pool.busy = pool.num_workers;
+  pool.generation++;
+  condition_variable_signal_all(&pool.work_available);
+  if (stage != STOP_WORKERS)
+    while (pool.busy > 0)
+      condition_variable_wait(&pool.work_complete, &pool.lock);
+  mutex_unlock(&pool.lock);
+}
+
+void start_parse_pool(vw& all)
+{ parse_pool& pool = calloc_or_throw<parse_pool>();
+  pool.all = &all;
+  pool.num_workers = all.p->parse_threads;
+  pool.batch_size = max(all.p->ring_size / 4, (size_t)1);
+  pool.lines.resize(pool.batch_size); // zeroed, i.e. empty v_arrays
+  initialize_mutex(&pool.lock);
+  initialize_condition_variable(&pool.work_available);
+  initialize_condition_variable(&pool.work_complete);
+
+  pool.workers = calloc_or_throw<parse_worker>(pool.num_workers);
+  for (size_t i = 0; i < pool.num_workers; i++)
+  { parse_worker& w = pool.workers[i];
+    w.pool = &pool;
+    w.id = i;
+    w.scratch = new_parse_scratch(*all.p);
+#ifndef _WIN32
+    pthread_create(&w.thread, nullptr, parse_worker_loop, &w);
+#else
+    w.thread = ::CreateThread(nullptr, 0, static_cast<LPTHREAD_START_ROUTINE>(parse_worker_loop), &w, 0L, nullptr);
+#endif
+  }
+  all.p->pool = &pool;
+}
+
+void end_parse_pool(vw& all)
+{ parse_pool& pool = *all.p->pool;
+  run_stage(pool, STOP_WORKERS);
+  for (size_t i = 0; i < pool.num_workers; i++)
+  {
+#ifndef _WIN32
+    pthread_join(pool.workers[i].thread, nullptr);
+#else
+    ::WaitForSingleObject(pool.workers[i].thread, INFINITE);
+    ::CloseHandle(pool.workers[i].thread);
+#endif
+    free_parse_scratch(pool.workers[i].scratch);
+  }
+  free(pool.workers);
+  for (size_t i = 0; i < pool.batch_size; i++)
+    pool.lines[i].delete_v();
+  pool.lines.delete_v();
+  pool.batch.delete_v();
+  delete_mutex(&pool.lock);
+  free(&pool);
+  all.p->pool = nullptr;
 }
+
+// copy the next text line or cached example into line
+bool read_batch_entry(vw& all, v_array<char>& line)
+{ io_buf& input = *all.p->input;
+  line.erase();
+  if (all.p->reader == read_cached_features)
+  { char* c;
+    uint32_t length;
+    if (!next_cached_example(all.p, input, length) || buf_read(input, c, length) < length)
+      return false;
+    push_many(line, c, length);
+    return true;
+  }
+
+  substring example;
+  if (read_example_line(input, example) == 0)
+    return false;
+  push_many(line, example.begin, example.end - example.begin);
+  // keep the byte following the line (normally '\r' or '\n'): parseFloat looks at it
+  line.push_back(example.end < input.space.end() ? *example.end : '\n');
+  return true;
+}
+
+// text and v2 caches can be parsed in batches; v1 caches can not be split into examples up front
+bool batch_parsable(parser* p)
+{ return p->reader == read_features || (p->reader == read_cached_features && p->cache_format == CACHE_V2);
+}
+
+void parse_batch(vw& all, size_t& example_number)
+{ parse_pool& pool = *all.p->pool;
+  pool.batch.erase();
+  pool.first_example = all.p->end_parsed_examples;
+  example* end_pass = nullptr;
+
+  // Read lines until the batch is full.  Only wait for a free ring slot when the batch
+  // is empty: the learner may hold on to published examples until it sees more of them.
+  while (pool.batch.size() < pool.batch_size)
+  { example* ae = pool.batch.size() == 0 ? get_unused_example(all) : try_get_unused_example(all);
+    if (ae == nullptr)
+      break;
+    if (!all.do_reset_source && example_number != all.pass_length && all.max_examples > example_number
+        && read_batch_entry(all, pool.lines[pool.batch.size()]))
+    { pool.batch.push_back(ae);
+      example_number++;
+    }
+    else
+    { end_pass = ae;
+      break;
+    }
+  }
+
+  run_stage(pool, PARSE_LINES);
+
+  for (size_t i = 0; i < pool.batch.size(); i++)
+  { example* ae = pool.batch[i];
+    if (all.p->write_cache)
+      cache_example(all, ae);
+    setup_example_counter(all, ae, pool.first_example + i);
+  }
+
+  run_stage(pool, SETUP_FEATURES);
+
+  publish_examples(all, pool.batch.size());
+
+  if (end_pass != nullptr)
+    end_pass_reached(all, end_pass, example_number);
 }
 
 #ifdef _WIN32
@@ -888,33 +1221,21 @@ void *main_parse_loop(void *in)
   size_t example_number = 0;  // for variable-size batch learning algorithms
 
 
-  while(!all->p->done)
-  { example* ae = get_unused_example(*all);
+  while(!RING::load(&all->p->done))
+  { if (all->p->pool != nullptr && batch_parsable(all->p))
+    { parse_batch(*all, example_number);
+      continue;
+    }
+
+    example* ae = get_unused_example(*all);
     if (!all->do_reset_source && example_number != all->pass_length && all->max_examples > example_number
         && VW::parse_atomic_example(*all, ae) )
     { VW::setup_example(*all, ae);
       example_number++;
+      publish_examples(*all, 1);
     }
     else
-    { reset_source(*all, all->num_bits);
-      all->do_reset_source = false;
-      all->passes_complete++;
-      end_pass_example(*all, ae);
-      if (all->passes_complete == all->numpasses && example_number == all->pass_length)
-      { all->passes_complete = 0;
-        all->pass_length = all->pass_length*2+1;
-      }
-      if (all->passes_complete >= all->numpasses && all->max_examples >= example_number)
-      { mutex_lock(&all->p->examples_lock);
-        all->p->done = true;
-        mutex_unlock(&all->p->examples_lock);
-      }
-      example_number = 0;
-    }
-    mutex_lock(&all->p->examples_lock);
-    all->p->end_parsed_examples++;
-    condition_variable_signal_all(&all->p->example_available);
-    mutex_unlock(&all->p->examples_lock);
+      end_pass_reached(*all, ae, example_number);
   }
   return 0L;
 }
@@ -922,29 +1243,72 @@ void *main_parse_loop(void *in)
 namespace VW
 {
 example* get_example(parser* p)
-{ mutex_lock(&p->examples_lock);
-  if (p->end_parsed_examples != p->used_index)
-  { size_t ring_index = p->used_index++ % p->ring_size;
-    if (!(p->examples+ring_index)->in_use)
-      cout << "error: example should be in_use " << p->used_index << " " << p->end_parsed_examples << " " << ring_index << endl;
-    assert((p->examples+ring_index)->in_use);
-    mutex_unlock(&p->examples_lock);
-
-    return p->examples + ring_index;
-  }
-  else
-  { if (!p->done)
-    { condition_variable_wait(&p->example_available, &p->examples_lock);
-      mutex_unlock(&p->examples_lock);
-      return get_example(p);
+{ while (true)
+  { // done is only set after the last example is published, so check for examples first
+    bool done = RING::load(&p->done);
+    if (RING::load(&p->end_parsed_examples) != p->used_index)
+    { size_t ring_index = p->used_index++ % p->ring_size;
+      if (!RING::load(&(p->examples+ring_index)->in_use))
+        cout << "error: example should be in_use " << p->used_index << " " << p->end_parsed_examples << " " << ring_index << endl;
+      assert((p->examples+ring_index)->in_use);
+      return p->examples + ring_index;
     }
-    else
-    { mutex_unlock(&p->examples_lock);
+    if (done)
       return nullptr;
+    RING::spin_then_park([p] { return RING::load(&p->end_parsed_examples) != p->used_index || RING::load(&p->done); },
+                         &p->examples_lock, &p->example_available, &p->parked_learners);
+  }
+}
+
+}
+
+// examples that end a pass or save the model: they need all the examples before them learned
+bool is_barrier_example(example* ec)
+{ return ec->indices.size() <= 1
+         && (ec->end_pass || (ec->tag.size() >= 4 && !strncmp((const char*) ec->tag.begin(), "save", 4)));
+}
+
+/* Like get_example, for several learner threads that each finish an example before
+** taking the next, in any order.  A barrier example is handed out once all learners
+** have arrived at it, so that everything before it is finished, and the others wait
+** until it is finished in turn.  arrive(context) is called before a learner waits at
+** a barrier.  barriers_passed is kept by each learner and must start at 0 for all of
+** them, like p->barrier_arrivals and p->barriers_finished.
+*/
+example* get_shared_example(parser* p, size_t learners, uint64_t& barriers_passed, void (*arrive)(void*), void* context)
+{ while (true)
+  { bool done = RING::load(&p->done);
+    uint64_t used = RING::load(&p->used_index);
+    if (used != RING::load(&p->end_parsed_examples))
+    { example* ec = p->examples + used % p->ring_size;
+      if (!is_barrier_example(ec))
+      { if (RING::compare_exchange(&p->used_index, used, used + 1))
+          return ec;
+        continue;
+      }
+      if (RING::load(&p->used_index) != used)
+        continue; // somebody took the example while we looked at it: the slot may hold another one by now
+
+      arrive(context);
+      uint64_t barrier = ++barriers_passed;
+      if (RING::fetch_add(&p->barrier_arrivals, 1) + 1 == barrier * learners)
+      { // the last learner to arrive takes the example
+        RING::store(&p->used_index, used + 1);
+        return ec;
+      }
+      RING::spin_then_park([p, barrier] { return RING::load(&p->barriers_finished) >= barrier; },
+                           &p->output_lock, &p->output_done, &p->parked_outputs);
+      continue;
     }
+    if (done)
+      return nullptr;
+    RING::spin_then_park([p] { return RING::load(&p->end_parsed_examples) != RING::load(&p->used_index) || RING::load(&p->done); },
+                         &p->examples_lock, &p->example_available, &p->parked_learners);
   }
 }
 
+namespace VW
+{
 float get_topic_prediction(example* ec, size_t i)
 { return ec->topic_predictions[i]; }
 
@@ -987,6 +1351,11 @@ void initialize_examples(vw& all)
   all.p->begin_parsed_examples = 0;
   all.p->end_parsed_examples = 0;
   all.p->done = false;
+  all.p->parked_learners = 0;
+  all.p->parked_producers = 0;
+  all.p->parked_outputs = 0;
+  all.p->barrier_arrivals = 0;
+  all.p->barriers_finished = 0;
 
   all.p->examples = calloc_or_throw<example>(all.p->ring_size);
 
@@ -1012,7 +1381,8 @@ void initialize_parser_datastructures(vw& all)
 namespace VW
 {
 void start_parser(vw& all)
-{ 
+{ if (all.p->parse_threads > 0 && !all.daemon && !all.active)
+    start_parse_pool(all);
 #ifndef _WIN32
   pthread_create(&all.parse_thread, nullptr, main_parse_loop, &all);
 #else
@@ -1059,6 +1429,8 @@ void end_parser(vw& all)
   ::WaitForSingleObject(all.parse_thread, INFINITE);
   ::CloseHandle(all.parse_thread);
 #endif
+  if (all.p->pool != nullptr)
+    end_parse_pool(all);
   release_parser_datastructures(all);
 }
 
@@ -5,6 +5,7 @@ license as described in the file LICENSE.
  */
 #pragma once
 #include "io_buf.h"
+#include "comp_io.h"
 #include "parse_primitives.h"
 #include "example.h"
 
@@ -12,6 +13,8 @@ license as described in the file LICENSE.
 namespace po = boost::program_options;
 
 struct vw;
+struct parse_pool;
+struct cache_writer;
 
 struct parser
 { v_array<substring> channels;//helper(s) for text parsing
@@ -24,6 +27,9 @@ struct parser
   bool resettable; //Whether or not the input can be reset.
   io_buf* output; //Where to output the cache.
   bool write_cache;
+  cache_writer* cache_out; // block being written to the cache
+  char cache_format; // of the cache being read, see cache.h
+  uint32_t cache_examples_left; // in the current block of the cache being read
   bool sort_features;
   bool sorted_cache;
 
@@ -35,15 +41,25 @@ struct parser
   example* examples;
   uint64_t used_index;
   bool emptylines_separate_examples; // true if you want to have holdout computed on a per-block basis rather than a per-line basis
+  // The ring counters, done and example::in_use are accessed atomically (see example_ring.h);
+  // the locks and condition variables are only used by threads that wait for too long.
   MUTEX examples_lock;
   CV example_available;
   CV example_unused;
   MUTEX output_lock;
   CV output_done;
+  uint64_t parked_learners;  // threads sleeping on example_available
+  uint64_t parked_producers; // threads sleeping on example_unused
+  uint64_t parked_outputs;   // threads sleeping on output_done
+  uint64_t barrier_arrivals;  // learner threads that reached a barrier example, over all barriers (see get_shared_example)
+  uint64_t barriers_finished; // barrier examples finished
 
   bool done;
   v_array<size_t> gram_mask;
 
+  size_t parse_threads; // number of worker threads parsing text input; 0 parses on the parser thread alone
+  parse_pool* pool;
+
   v_array<size_t> ids; //unique ids for sources
   v_array<size_t> counts; //partial examples received from sources
   size_t finished_count;//the number of finished examples;
@@ -67,6 +83,10 @@ void initialize_parser_datastructures(vw& all);
 void release_parser_datastructures(vw& all);
 void adjust_used_index(vw& all);
 
+// for learner threads (--learner_threads) taking examples from the ring in any order
+bool is_barrier_example(example* ec);
+example* get_shared_example(parser* p, size_t learners, uint64_t& barriers_passed, void (*arrive)(void*), void* context);
+
 //parser control
 void make_example_available();
 void set_done(vw& all);
@@ -75,6 +95,6 @@ void set_done(vw& all);
 bool inconsistent_cache(size_t numbits, io_buf& cache);
 void reset_source(vw& all, size_t numbits);
 void finalize_source(parser* source);
-void set_compressed(parser* par);
+void set_compressed(parser* par, comp_io_buf::codec write_codec = comp_io_buf::GZIP);
 void initialize_examples(vw& all);
 void free_parser(vw& all);
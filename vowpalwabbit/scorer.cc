@@ -32,6 +32,12 @@ void update(scorer& s, LEARNER::base_learner& base, example& ec)
   base.update(ec);
 }
 
+void multiupdate(scorer& s, LEARNER::base_learner& base, example& ec, size_t count, size_t, polyprediction* pred, const float* labels)
+{ for (size_t c=0; c<count; c++)
+    s.all->set_minmax(s.all->sd, labels[c]);
+  base.multiupdate(ec, 0, count, pred, labels);
+}
+
 // y = f(x) -> [0, 1]
 inline float logistic(float in) { return 1.f / (1.f + correctedExp(- in)); }
 
@@ -81,6 +87,8 @@ LEARNER::base_learner* scorer_setup(vw& all)
 
   l->set_multipredict(multipredict_f);
   l->set_update(update);
+  if (base->has_multiupdate())
+    l->set_multiupdate(multiupdate);
   all.scorer = make_base(*l);
 
   return all.scorer;
@@ -21,6 +21,8 @@ license as described in the file LICENSE.
 #include "active.h"
 #include "label_dictionary.h"
 #include "vw_exception.h"
+#include "parallel.h"
+#include "scorer.h"
 
 using namespace LEARNER;
 using namespace std;
@@ -113,6 +115,51 @@ struct action_cache
 };
 std::ostream& operator << (std::ostream& os, const action_cache& x) { os << x.k << ':' << x.cost; if (x.is_opt) os << '*'; return os; }
 
+// what the rollouts of one timestep leave for generate_training_example: the learn_* fields of
+// the search_private of the rollout thread that ran them
+struct rollout_capture
+{ polylabel losses;
+  example* ec_ref;
+  size_t ec_ref_cnt;
+  v_array<example> ec_copy;
+  v_array<ptag> condition_on;
+  v_array<action_repr> condition_on_act;
+  v_array<char> condition_on_names;
+  v_array<action> allowed_actions;
+  size_t learner_id;
+};
+
+// a prediction remembered by the whole state it was made in (see prediction_state): the time
+// step and tag, the policy and learner, what was conditioned on, the allowed actions and the
+// features of the examples. the same state in the test pass, the roll-in or any roll-out of
+// an example is predicted once.
+struct cache_entry
+{ uint64_t hash;
+  v_array<unsigned char> key;
+  scored_action sa;
+  uint32_t next;                 // the next entry in the same bucket
+  uint32_t newer, older;         // neighbours in the order of use
+};
+
+struct feature_digest
+{ example* ecs;
+  size_t ec_cnt;
+  uint64_t hash;
+};
+
+// entries are kept in the order they were last used in; once max_entries are in use, the
+// least recently used one makes room for the next
+struct rollout_cache
+{ vector<cache_entry> entries;   // the first used are in use, the rest keep their keys' memory
+  size_t used;
+  v_array<uint32_t> buckets;     // a power of two of them, as many as there are entries in use
+  uint32_t newest, oldest;
+  size_t max_entries;            // value of --search_cache_size
+  rollout_cache* parent;         // a rollout thread also finds, but never stores, predictions in the learner's cache
+  v_array<feature_digest> digests;  // the hashes of the features of this search example's examples
+  size_t last_digest;            // the one found last
+};
+
 struct search_private
 { vw* all;
 
@@ -202,9 +249,11 @@ struct search_private
   size_t total_examples_generated;
   size_t total_predictions_made;
   size_t total_cache_hits;
+  size_t total_cache_lookups;
+  size_t total_cache_evictions;
 
   vector<example*> ec_seq;  // the collected examples
-  v_hashmap<unsigned char*, scored_action> cache_hash_map;
+  rollout_cache cache;
 
   // for foreach_feature temporary storage for conditioning
   uint64_t dat_new_feature_idx;
@@ -235,6 +284,14 @@ struct search_private
   BaseTask* metaoverride;
   size_t meta_t;  // the metatask has it's own notion of time. meta_t+t, during a single run, is the way to think about the "real" decision step but this really only matters for caching purposes
   v_array< v_array<action_cache>* > memo_foreach_action; // when foreach_action is on, we need to cache TRAIN trajectory actions for LEARN
+
+  size_t rollout_threads;        // value of --search_rollout_threads; 0 means rollouts are run one after another, learning from each timestep before rolling out the next
+  v_array<search*> rollout_workers;          // the searches the rollout threads run the task in
+  PARALLEL::pool rollout_pool;               // the rollout threads, kept from one example to the next
+  v_array<rollout_capture> rollout_captures; // by timestep, what they rolled out
+  v_array<example> ec_seq_copy;  // a rollout thread's copies of the learner's ec_seq
+  bool own_random;               // a rollout thread draws from random_state rather than rand48's global state
+  uint64_t random_state;
 };
 
 string   audit_feature_space("conditional");
@@ -257,6 +314,15 @@ inline bool need_memo_foreach_action(search_private& priv)
   //        (priv.metaoverride->_foreach_action || priv.metaoverride->_post_prediction);
 }
 
+float search_frand48(search_private& priv, bool advance_prng=true)
+{ if (! priv.own_random)
+    return advance_prng ? frand48() : frand48_noadvance();
+  uint64_t state = priv.random_state;
+  float r = merand48(state);
+  if (advance_prng) priv.random_state = state;
+  return r;
+}
+
 int random_policy(search_private& priv, bool allow_current, bool allow_optimal, bool advance_prng=true)
 { if (priv.beta >= 1)
   { if (allow_current) return (int)priv.current_policy;
@@ -276,10 +342,10 @@ int random_policy(search_private& priv, bool allow_current, bool allow_optimal,
   else if (num_valid_policies == 1)
     pid = 0;
   else if (num_valid_policies == 2)
-    pid = (advance_prng ? frand48() : frand48_noadvance()) >= priv.beta;
+    pid = search_frand48(priv, advance_prng) >= priv.beta;
   else
   { // SPEEDUP this up in the case that beta is small!
-    float r = (advance_prng ? frand48() : frand48_noadvance());
+    float r = search_frand48(priv, advance_prng);
     pid = 0;
 
     if (r > priv.beta)
@@ -557,7 +623,8 @@ void reset_search_structure(search_private& priv)
 
   if (! priv.cb_learner)   // was: if rollout_all_actions
   { uint32_t seed = (uint32_t)(priv.read_example_last_id * 147483 + 4831921) * 2147483647;
-    msrand48(seed);
+    if (priv.own_random) priv.random_state = seed;
+    else msrand48(seed);
   }
 }
 
@@ -581,7 +648,7 @@ template<class T> void cdbg_print_array(string str, v_array<T>& A) { cdbg << str
 template<class T> void cerr_print_array(string str, v_array<T>& A) { std::cerr << str << " = ["; for (size_t i=0; i<A.size(); i++) std::cerr << " " << A[i]; std::cerr << " ]" << endl; }
 
 
-size_t random(size_t max) { return (size_t)(frand48() * (float)max); }
+size_t random(search_private& priv, size_t max) { return (size_t)(search_frand48(priv) * (float)max); }
 template<class T> bool array_contains(T target, const T*A, size_t n)
 { if (A == nullptr) return false;
   for (size_t i=0; i<n; i++)
@@ -858,7 +925,7 @@ action choose_oracle_action(search_private& priv, size_t ec_cnt, const action* o
         if (allowed_actions_cost[k] <= min_cost)
         { cdbg << ", hit @ " << k;
           count++;
-          if ((count == 1) || (frand48() < 1./(float)count))
+          if ((count == 1) || (search_frand48(priv) < 1./(float)count))
           { a = (allowed_actions == nullptr) ? (uint32_t)(k+1) : allowed_actions[k];
             cdbg << "***";
           }
@@ -868,12 +935,12 @@ action choose_oracle_action(search_private& priv, size_t ec_cnt, const action* o
   }
 
   if (a == (action)-1)
-  { if ((priv.perturb_oracle > 0.) && (priv.state == INIT_TRAIN) && (frand48() < priv.perturb_oracle))
+  { if ((priv.perturb_oracle > 0.) && (priv.state == INIT_TRAIN) && (search_frand48(priv) < priv.perturb_oracle))
       oracle_actions_cnt = 0;
-    a = ( oracle_actions_cnt > 0) ?  oracle_actions[random(oracle_actions_cnt )] :
-        (allowed_actions_cnt > 0) ? allowed_actions[random(allowed_actions_cnt)] :
-        priv.is_ldf ? (action)random(ec_cnt) :
-        (action)(1 + random(priv.A));
+    a = ( oracle_actions_cnt > 0) ?  oracle_actions[random(priv, oracle_actions_cnt )] :
+        (allowed_actions_cnt > 0) ? allowed_actions[random(priv, allowed_actions_cnt)] :
+        priv.is_ldf ? (action)random(priv, ec_cnt) :
+        (action)(1 + random(priv, priv.A));
   }
   cdbg << "choose_oracle_action from oracle_actions = ["; for (size_t i=0; i<oracle_actions_cnt; i++) cdbg << " " << oracle_actions[i]; cdbg << " ], ret=" << a << endl;
   if (need_memo_foreach_action(priv) && (priv.state == INIT_TRAIN))
@@ -1077,53 +1144,240 @@ int choose_policy(search_private& priv, bool advance_prng=true)
   }
 }
 
-bool cached_item_equivalent(unsigned char*& A, unsigned char*& B)
-{ size_t sz_A = *A;
-  size_t sz_B = *B;
-  if (sz_A != sz_B) return false;
-  return memcmp(A, B, sz_A) == 0;
-}
+const uint32_t no_entry = (uint32_t)-1;
+
+void clear_cache(rollout_cache& c)
+{ for (uint32_t& b : c.buckets)
+    b = no_entry;
+  c.used = 0;
+  c.newest = c.oldest = no_entry;
+  c.digests.erase();
+  c.last_digest = 0;
+}
+
+void delete_cache(rollout_cache& c)
+{ for (cache_entry& e : c.entries)
+    e.key.delete_v();
+  c.entries.~vector<cache_entry>();
+  c.buckets.delete_v();
+  c.digests.delete_v();
+}
+
+// the state a prediction is made in
+struct prediction_state
+{ size_t t;
+  ptag mytag;
+  int policy;
+  size_t learner_id;
+  example* ecs;
+  size_t ec_cnt;
+  const ptag* condition_on;
+  const char* condition_on_names;
+  const action_repr* condition_on_actions;
+  size_t condition_on_cnt;
+  const action* allowed_actions;
+  size_t allowed_actions_cnt;
+  const float* allowed_actions_cost;
+  size_t A;
+};
 
-void free_key(unsigned char* mem, scored_action) { free(mem); } // sa.repr.delete_v(); }
-void clear_cache_hash_map(search_private& priv)
-{ priv.cache_hash_map.iter(free_key);
-  priv.cache_hash_map.clear();
+// the state but the features is taken apart into what is hashed or compared by visit
+template<class V> void visit_state(V& visit, const prediction_state& st)
+{ visit(st.t);
+  visit(st.mytag);
+  visit(st.policy);
+  visit(st.learner_id);
+  visit(st.condition_on_cnt);
+  for (size_t i=0; i<st.condition_on_cnt; i++)
+  { visit(st.condition_on[i]);
+    visit(st.condition_on_actions[i].a);
+    visit(st.condition_on_names[i]);
+  }
+  visit(st.allowed_actions_cnt);
+  visit((char)((st.allowed_actions ? 1 : 0) + (st.allowed_actions_cost ? 2 : 0)));
+  if (st.allowed_actions) visit(st.allowed_actions, st.allowed_actions_cnt);
+  if (st.allowed_actions_cost) visit(st.allowed_actions_cost, st.allowed_actions ? st.allowed_actions_cnt : st.A);
+  visit(st.ec_cnt);
+}
+
+template<class V> void visit_features(V& visit, example* ecs, size_t ec_cnt)
+{ for (size_t n=0; n<ec_cnt; n++)
+  { visit(ecs[n].indices.size());
+    for (namespace_index ns : ecs[n].indices)
+    { features& fs = ecs[n].feature_space[ns];
+      visit(ns);
+      visit(fs.values.size());
+      visit(fs.values.begin(), fs.values.size());
+      visit(fs.indicies.size());
+      visit(fs.indicies.begin(), fs.indicies.size());
+    }
+  }
 }
 
-// returns true if found and do_store is false. if do_store is true, always returns true.
-bool cached_action_store_or_find(search_private& priv, ptag mytag, const ptag* condition_on, const char* condition_on_names, action_repr* condition_on_actions, size_t condition_on_cnt, int policy, size_t learner_id, action &a, bool do_store, float& a_cost)
-{ if (priv.no_caching) return do_store;
-  if (mytag == 0) return do_store; // don't attempt to cache when tag is zero
+// hashes what it visits, without copying it anywhere
+struct key_hasher
+{ uint64_t hash;
+  template<class T> void operator()(const T& x) { hash = uniform_hash(&x, sizeof(T), hash); }
+  template<class T> void operator()(const T* x, size_t n) { hash = uniform_hash(x, n * sizeof(T), hash); }
+};
+
+// writes what it visits to a cache entry's key
+struct key_writer
+{ v_array<unsigned char>& key;
+  template<class T> void operator()(const T& x) { push_many(key, (const unsigned char*)&x, sizeof(T)); }
+  template<class T> void operator()(const T* x, size_t n) { push_many(key, (const unsigned char*)x, n * sizeof(T)); }
+};
 
-  size_t sz  = sizeof(size_t) + sizeof(ptag) + sizeof(int) + sizeof(size_t) + sizeof(size_t) + condition_on_cnt * (sizeof(ptag) + sizeof(action) + sizeof(char));
-  if (sz % 4 != 0)
-    sz += 4 - (sz % 4); // make sure sz aligns to 4 so that uniform_hash does the right thing
+// matches what it visits against a cache entry's key
+struct key_matcher
+{ const unsigned char* at;
+  const unsigned char* end;
+  bool same;
+  void match(const void* x, size_t bytes)
+  { same = same && (size_t)(end - at) >= bytes && memcmp(at, x, bytes) == 0;
+    at += same ? bytes : 0;
+  }
+  template<class T> void operator()(const T& x) { match(&x, sizeof(T)); }
+  template<class T> void operator()(const T* x, size_t n) { match(x, n * sizeof(T)); }
+};
 
-  unsigned char* item = calloc_or_throw<unsigned char>(sz);
-  unsigned char* here = item;
-  *here = (unsigned char)sz; here += sizeof(size_t);
-  *here = mytag;             here += sizeof(ptag);
-  *here = policy;            here += sizeof(int);
-  *here = (unsigned char)learner_id;        here += sizeof(size_t);
-  *here = (unsigned char)condition_on_cnt;  here += sizeof(size_t);
-  for (size_t i=0; i<condition_on_cnt; i++)
-  { *here = condition_on[i];             here += sizeof(ptag);
-    *here = condition_on_actions[i].a;   here += sizeof(action);
-    *here = condition_on_names[i];       here += sizeof(char);  // SPEEDUP: should we align this at 4?
+// the hash of the features of ecs.  when the task leaves its examples alone, the features of
+// a search example are hashed once, however many predictions are made on them.
+uint64_t features_hash(search_private& priv, example* ecs, size_t ec_cnt)
+{ rollout_cache& c = priv.cache;
+  if (priv.examples_dont_change)
+  { // the predictions are mostly made on one example after the other
+    for (size_t k=0; k<c.digests.size(); k++)
+    { feature_digest& d = c.digests[(c.last_digest + k) % c.digests.size()];
+      if (d.ecs == ecs && d.ec_cnt == ec_cnt)
+      { c.last_digest = &d - c.digests.begin();
+        return d.hash;
+      }
+    }
+  }
+  key_hasher h = { 3419 };
+  visit_features(h, ecs, ec_cnt);
+  if (priv.examples_dont_change)
+  { feature_digest d = { ecs, ec_cnt, h.hash };
+    c.last_digest = c.digests.size();
+    c.digests.push_back(d);
   }
-  uint64_t hash = uniform_hash(item, sz, 3419);
+  return h.hash;
+}
+
+uint64_t state_hash(search_private& priv, const prediction_state& st)
+{ key_hasher h = { features_hash(priv, st.ecs, st.ec_cnt) };
+  visit_state(h, st);
+  return h.hash;
+}
 
-  if (do_store)
-  { priv.cache_hash_map.put(item, hash, scored_action(a, a_cost));
-    return true;
+// only once the hashes are equal are the states compared
+cache_entry* find_in_cache(rollout_cache& c, uint64_t hash, const prediction_state& st)
+{ if (c.used == 0)
+    return nullptr;
+  for (uint32_t i = c.buckets[hash & (c.buckets.size()-1)]; i != no_entry; i = c.entries[i].next)
+  { cache_entry& e = c.entries[i];
+    if (e.hash != hash)
+      continue;
+    key_matcher m = { e.key.begin(), e.key.end(), true };
+    visit_state(m, st);
+    visit_features(m, st.ecs, st.ec_cnt);
+    if (m.same && m.at == m.end)
+      return &e;
+  }
+  return nullptr;
+}
+
+void unlink_use(rollout_cache& c, uint32_t i)
+{ cache_entry& e = c.entries[i];
+  if (e.newer != no_entry) c.entries[e.newer].older = e.older;
+  else                     c.newest = e.older;
+  if (e.older != no_entry) c.entries[e.older].newer = e.newer;
+  else                     c.oldest = e.newer;
+}
+
+void link_newest(rollout_cache& c, uint32_t i)
+{ cache_entry& e = c.entries[i];
+  e.newer = no_entry;
+  e.older = c.newest;
+  if (c.newest != no_entry) c.entries[c.newest].newer = i;
+  else                      c.oldest = i;
+  c.newest = i;
+}
+
+void link_bucket(rollout_cache& c, uint32_t i)
+{ uint32_t& first = c.buckets[c.entries[i].hash & (c.buckets.size()-1)];
+  c.entries[i].next = first;
+  first = i;
+}
+
+void unlink_bucket(rollout_cache& c, uint32_t i)
+{ uint32_t* at = &c.buckets[c.entries[i].hash & (c.buckets.size()-1)];
+  while (*at != i)
+    at = &c.entries[*at].next;
+  *at = c.entries[i].next;
+}
+
+// find a prediction made in state st, here or in the learner's cache
+bool cached_action_find(search_private& priv, uint64_t hash, const prediction_state& st, action& a, float& a_cost)
+{ rollout_cache& c = priv.cache;
+  priv.total_cache_lookups++;
+  cache_entry* e = find_in_cache(c, hash, st);
+  if (e != nullptr)
+  { uint32_t i = (uint32_t)(e - c.entries.data());
+    unlink_use(c, i);
+    link_newest(c, i);
+  }
+  else if (c.parent != nullptr)
+    e = find_in_cache(*c.parent, hash, st);
+  if (e == nullptr)
+    return false;
+  a = e->sa.a;
+  a_cost = e->sa.s;
+  priv.total_cache_hits++;
+  return true;
+}
+
+void cached_action_store(search_private& priv, uint64_t hash, const prediction_state& st, action a, float a_cost)
+{ rollout_cache& c = priv.cache;
+  cache_entry* e = find_in_cache(c, hash, st);
+  uint32_t i;
+  if (e != nullptr)
+  { i = (uint32_t)(e - c.entries.data());
+    unlink_use(c, i);
   }
-  else     // its a find
-  { scored_action sa = priv.cache_hash_map.get(item, hash);
-    a = sa.a;
-    a_cost = sa.s;
-    free(item);
-    return a != (action)-1;
+  else
+  { if (c.used < c.max_entries)
+    { if (c.used == c.entries.size())
+        c.entries.emplace_back();
+      i = (uint32_t)c.used++;
+    }
+    else   // make room by reusing the least recently used entry
+    { i = c.oldest;
+      unlink_use(c, i);
+      unlink_bucket(c, i);
+      priv.total_cache_evictions++;
+    }
+    cache_entry& fresh = c.entries[i];
+    fresh.hash = hash;
+    fresh.key.erase();
+    key_writer w = { fresh.key };
+    visit_state(w, st);
+    visit_features(w, st.ecs, st.ec_cnt);
+    if (c.used > c.buckets.size())
+    { size_t n = max(2 * c.buckets.size(), (size_t)64);
+      c.buckets.resize(n);
+      c.buckets.end() = c.buckets.begin() + n;
+      for (uint32_t& b : c.buckets)
+        b = no_entry;
+      for (uint32_t j=0; j<c.used; j++)
+        link_bucket(c, j);
+    }
+    else
+      link_bucket(c, i);
   }
+  c.entries[i].sa = scored_action(a, a_cost);
+  link_newest(c, i);
 }
 
 void generate_training_example(search_private& priv, polylabel& losses, float weight, bool add_conditioning=true, float min_loss=FLT_MAX)    // min_loss = FLT_MAX means "please compute it for me as the actual min"; any other value means to use this
@@ -1414,10 +1668,14 @@ action search_predict(search_private& priv, example* ecs, size_t ec_cnt, ptag my
 
       bool not_test = priv.all->training && !ecs[0].test_only;
 
-      if ((!skip) && (!need_fea) && not_test && cached_action_store_or_find(priv, mytag, condition_on, condition_on_names, priv.condition_on_actions.begin(), condition_on_cnt, policy, learner_id, a, false, a_cost))
-        // if this succeeded, 'a' has the right action
-        priv.total_cache_hits++;
-      else   // we need to predict, and then cache, and maybe run foreach_action
+      // passthrough representations are not cached, nor are the partial predictions the metatask needs
+      bool cache = not_test && (!skip) && (!priv.no_caching) && !(priv.auto_condition_features && priv.acset.use_passthrough_repr);
+      bool find = cache && (!need_fea) && (!need_memo_foreach_action(priv)) && !(priv.metaoverride && priv.metaoverride->_foreach_action);
+      prediction_state state = { priv.meta_t + priv.t, mytag, policy, learner_id, ecs, ec_cnt, condition_on, condition_on_names, priv.condition_on_actions.begin(), condition_on_cnt, allowed_actions, allowed_actions_cnt, allowed_actions_cost, priv.A };
+      uint64_t key_hash = cache ? state_hash(priv, state) : 0;
+
+      // if the prediction is found, 'a' has the right action; otherwise we need to predict, and then cache, and maybe run foreach_action
+      if ((!find) || !cached_action_find(priv, key_hash, state, a, a_cost))
       { size_t start_K = (priv.is_ldf && COST_SENSITIVE::ec_is_example_header(ecs[0])) ? 1 : 0;
         priv.last_action_repr.erase();
         if (priv.auto_condition_features)
@@ -1466,8 +1724,8 @@ action search_predict(search_private& priv, example* ecs, size_t ec_cnt, ptag my
           for (size_t n=start_K; n<ec_cnt; n++)
             del_example_conditioning(priv, ecs[n]);
 
-        if (not_test && (!skip))
-          cached_action_store_or_find(priv, mytag, condition_on, condition_on_names, priv.condition_on_actions.begin(), condition_on_cnt, policy, learner_id, a, true, a_cost);
+        if (cache)
+          cached_action_store(priv, key_hash, state, a, a_cost);
       }
     }
 
@@ -1618,14 +1876,198 @@ void run_task(search& sch, vector<example*>& ec)
     priv.task->run(sch, ec);
 }
 
+// roll out every action at timestep learn_t, collecting their losses in learn_losses
+void roll_out_actions(search& sch, vector<example*>& ec_seq, size_t learn_t)
+{ search_private& priv = *sch.priv;
+  priv.learn_a_idx = 0;
+  priv.done_with_all_actions = false;
+  // for each action, roll out to get a loss
+  while (! priv.done_with_all_actions)
+  { reset_search_structure(priv);
+
+    priv.state = LEARN;
+    priv.learn_t = learn_t;
+    cdbg << "-------------------------------------------------------------------------------------" << endl;
+    cdbg << "learn_t = " << priv.learn_t << ", learn_a_idx = " << priv.learn_a_idx << endl;
+    run_task(sch, ec_seq);
+    //cerr_print_array("in GENER, learn_allowed_actions", priv.learn_allowed_actions);
+    float this_loss = priv.learn_loss;
+    cs_cost_push_back(priv.cb_learner, priv.learn_losses, priv.is_ldf ? (uint32_t)(priv.learn_a_idx - 1) : (uint32_t)priv.learn_a_idx, this_loss);
+    //                          (priv.learn_allowed_actions.size() > 0) ? priv.learn_allowed_actions[priv.learn_a_idx-1] : priv.is_ldf ? (priv.learn_a_idx-1) : (priv.learn_a_idx),
+    //                           priv.learn_loss);
+  }
+}
+
+// make the training example of the rollouts of a timestep
+void learn_from_rollouts(search_private& priv)
+{ if (priv.learn_allowed_actions.size() > 0)
+  { for (size_t i=0; i<priv.learn_allowed_actions.size(); i++)
+    { priv.learn_losses.cs.costs[i].class_index = priv.learn_allowed_actions[i];
+    }
+  }
+  generate_training_example(priv, priv.learn_losses, 1., true); // , min_loss);  // TODO: weight
+  if (! priv.examples_dont_change)
+    for (size_t n=0; n<priv.learn_ec_copy.size(); n++)
+    { if (priv.is_ldf) CS::cs_label.delete_label(&priv.learn_ec_copy[n].l.cs);
+      else             MC::mc_label.delete_label(&priv.learn_ec_copy[n].l.multi);
+    }
+  if (priv.cb_learner) priv.learn_losses.cb.costs.erase();
+  else                 priv.learn_losses.cs.costs.erase();
+}
+
+void swap_capture(search_private& priv, rollout_capture& c)
+{ std::swap(priv.learn_losses, c.losses);
+  std::swap(priv.learn_ec_ref, c.ec_ref);
+  std::swap(priv.learn_ec_ref_cnt, c.ec_ref_cnt);
+  std::swap(priv.learn_ec_copy, c.ec_copy);
+  std::swap(priv.learn_condition_on, c.condition_on);
+  std::swap(priv.learn_condition_on_act, c.condition_on_act);
+  std::swap(priv.learn_condition_on_names, c.condition_on_names);
+  std::swap(priv.learn_allowed_actions, c.allowed_actions);
+  std::swap(priv.learn_learner_id, c.learner_id);
+}
+
+void delete_capture(search_private& priv, rollout_capture& c)
+{ c.losses.cs.costs.delete_v();
+  if (! priv.examples_dont_change)
+  { void (*delete_label)(void*) = priv.is_ldf ? CS::cs_label.delete_label : MC::mc_label.delete_label;
+    for(example& ec : c.ec_copy)
+      VW::dealloc_example(delete_label, ec);
+  }
+  c.ec_copy.delete_v();
+  c.condition_on.delete_v();
+  c.condition_on_act.delete_v();
+  c.condition_on_names.delete_v();
+  c.allowed_actions.delete_v();
+}
+
+void search_initialize(vw* all, search& sch);
+
+search* new_rollout_worker(search& sch)
+{ search& w = calloc_or_throw<search>();
+  w.priv = &calloc_or_throw<search_private>();
+  search_initialize(sch.priv->all, w);
+  search_private& wp = *w.priv;
+  wp.task = sch.priv->task;
+  wp.examples_dont_change = sch.priv->examples_dont_change;
+  wp.allowed_actions_cache = &calloc_or_throw<polylabel>();
+  CS::cs_label.default_label(wp.allowed_actions_cache);
+  wp.learn_losses.cs.costs = v_init<CS::wclass>();
+  wp.gte_label.cs.costs = v_init<CS::wclass>();
+  wp.own_random = true;
+  w.task_name = sch.task_name;
+  return &w;
+}
+
+// give a rollout thread the settings, examples and task data of the learner's search
+void prepare_rollout_worker(search& sch, search& w)
+{ search_private& priv = *sch.priv;
+  search_private& wp = *w.priv;
+  wp.auto_condition_features = priv.auto_condition_features;
+  wp.auto_hamming_loss = priv.auto_hamming_loss;
+  wp.examples_dont_change = priv.examples_dont_change;
+  wp.is_ldf = priv.is_ldf;
+  wp.use_action_costs = priv.use_action_costs;
+  wp.acset = priv.acset;
+  wp.history_length = priv.history_length;
+  wp.A = priv.A;
+  wp.num_learners = priv.num_learners;
+  wp.cb_learner = priv.cb_learner;
+  wp.no_caching = priv.no_caching;
+  wp.rollout_num_steps = priv.rollout_num_steps;
+  wp.label_is_test = priv.label_is_test;
+  wp.T = priv.T;
+  copy_array(wp.train_trajectory, priv.train_trajectory);
+  wp.force_oracle = priv.force_oracle;
+  wp.beta = priv.beta;
+  wp.alpha = priv.alpha;
+  wp.rollout_method = priv.rollout_method;
+  wp.rollin_method = priv.rollin_method;
+  wp.xv = priv.xv;
+  wp.allow_current_policy = priv.allow_current_policy;
+  wp.adaptive_beta = priv.adaptive_beta;
+  wp.current_policy = priv.current_policy;
+  wp.total_number_of_policies = priv.total_number_of_policies;
+  wp.read_example_last_id = priv.read_example_last_id;
+  wp.total_examples_generated = priv.total_examples_generated;
+  wp.base_learner = priv.base_learner;
+  wp.cache.max_entries = priv.cache.max_entries;
+  wp.cache.parent = &priv.cache;
+  clear_cache(wp.cache);
+
+  label_parser& lp = priv.all->p->lp;
+  while (wp.ec_seq_copy.size() < priv.ec_seq.size())
+  { example ec{};
+    wp.ec_seq_copy.push_back(ec);
+  }
+  wp.ec_seq.clear();
+  for (size_t i=0; i<priv.ec_seq.size(); i++)
+  { VW::copy_example_data(false, &wp.ec_seq_copy[i], priv.ec_seq[i], lp.label_size, lp.copy_label);
+    wp.ec_seq.push_back(&wp.ec_seq_copy[i]);
+  }
+  priv.task->copy(sch, w);
+}
+
+// --search_rollout_threads: the timesteps are rolled out on threads, each running the task in
+// a search of its own, on copies of the examples.  Nothing is learned until all of them are
+// rolled out, so they are all rolled out against the same weights, and their training
+// examples are then made in the order of the timesteps; how many threads there are does not
+// change the results.
+void roll_out_on_threads(search& sch)
+{ search_private& priv = *sch.priv;
+  size_t timesteps = priv.timesteps.size();
+  if (timesteps == 0)
+    return;
+  size_t threads = min(priv.rollout_threads, timesteps);
+  while (priv.rollout_workers.size() < threads)
+    priv.rollout_workers.push_back(new_rollout_worker(sch));
+  while (priv.rollout_captures.size() < timesteps)
+  { rollout_capture c{};
+    priv.rollout_captures.push_back(c);
+  }
+
+  auto roll_out = [&](size_t t)
+  { search& w = *priv.rollout_workers[t];
+    search_private& wp = *w.priv;
+    prepare_rollout_worker(sch, w);
+    for (size_t tid = t; tid < timesteps; tid += threads)
+    { wp.learn_allowed_actions.erase();
+      wp.learn_condition_on.erase();
+      roll_out_actions(w, wp.ec_seq, priv.timesteps[tid]);
+      if (wp.examples_dont_change)  // learn from the learner's own example
+        for (size_t n=0; n<wp.ec_seq.size(); n++)
+          if (wp.learn_ec_ref == wp.ec_seq[n])
+            wp.learn_ec_ref = priv.ec_seq[n];
+      swap_capture(wp, priv.rollout_captures[tid]);
+    }
+  };
+  PARALLEL::in_parallel(priv.rollout_pool, threads, roll_out);
+
+  for (size_t tid=0; tid<timesteps; tid++)
+  { swap_capture(priv, priv.rollout_captures[tid]);
+    learn_from_rollouts(priv);
+    swap_capture(priv, priv.rollout_captures[tid]);
+  }
+  for (search* w : priv.rollout_workers)
+  { priv.total_predictions_made += w->priv->total_predictions_made;
+    priv.total_cache_hits += w->priv->total_cache_hits;
+    priv.total_cache_lookups += w->priv->total_cache_lookups;
+    priv.total_cache_evictions += w->priv->total_cache_evictions;
+    w->priv->total_predictions_made = 0;
+    w->priv->total_cache_hits = 0;
+    w->priv->total_cache_lookups = 0;
+    w->priv->total_cache_evictions = 0;
+  }
+}
+
 template <bool is_learn>
 void train_single_example(search& sch, bool is_test_ex, bool is_holdout_ex)
 { search_private& priv = *sch.priv;
   vw&all = *priv.all;
   bool ran_test = false;  // we must keep track so that even if we skip test, we still update # of examples seen
 
-  //if (! priv.no_caching)
-  clear_cache_hash_map(priv);
+  // the weights changed since the last example
+  clear_cache(priv.cache);
 
   cdbg << "is_test_ex=" << is_test_ex << " vw_is_main=" << all.vw_is_main << endl;
   cdbg << "must_run_test = " << must_run_test(all, priv.ec_seq, is_test_ex) << endl;
@@ -1665,7 +2107,7 @@ void train_single_example(search& sch, bool is_test_ex, bool is_holdout_ex)
   cdbg << "======================================== INIT TRAIN (" << priv.current_policy << "," << priv.read_example_last_pass << ") ========================================" << endl;
   //cerr << "training" << endl;
 
-  clear_cache_hash_map(priv);
+  // the predictions of the test pass are kept: they were made with the same weights
   reset_search_structure(priv);
   clear_memo_foreach_action(priv);
   priv.state = INIT_TRAIN;
@@ -1703,6 +2145,11 @@ void train_single_example(search& sch, bool is_test_ex, bool is_holdout_ex)
   if (priv.cb_learner) priv.learn_losses.cb.costs.erase();
   else                 priv.learn_losses.cs.costs.erase();
 
+  if (priv.rollout_threads > 0)
+  { roll_out_on_threads(sch);
+    return;
+  }
+
   for (size_t tid=0; tid<priv.timesteps.size(); tid++)
   { cdbg << "timestep = " << priv.timesteps[tid] << " [" << tid << "/" << priv.timesteps.size() << "]" << endl;
 
@@ -1711,41 +2158,12 @@ void train_single_example(search& sch, bool is_test_ex, bool is_holdout_ex)
       continue;
     }
 
-    priv.learn_a_idx = 0;
-    priv.done_with_all_actions = false;
-    // for each action, roll out to get a loss
-    while (! priv.done_with_all_actions)
-    { reset_search_structure(priv);
-
-      priv.state = LEARN;
-      priv.learn_t = priv.timesteps[tid];
-      cdbg << "-------------------------------------------------------------------------------------" << endl;
-      cdbg << "learn_t = " << priv.learn_t << ", learn_a_idx = " << priv.learn_a_idx << endl;
-      run_task(sch, priv.ec_seq);
-      //cerr_print_array("in GENER, learn_allowed_actions", priv.learn_allowed_actions);
-      float this_loss = priv.learn_loss;
-      cs_cost_push_back(priv.cb_learner, priv.learn_losses, priv.is_ldf ? (uint32_t)(priv.learn_a_idx - 1) : (uint32_t)priv.learn_a_idx, this_loss);
-      //                          (priv.learn_allowed_actions.size() > 0) ? priv.learn_allowed_actions[priv.learn_a_idx-1] : priv.is_ldf ? (priv.learn_a_idx-1) : (priv.learn_a_idx),
-      //                           priv.learn_loss);
-    }
-    // now we can make a training example
-    if (priv.learn_allowed_actions.size() > 0)
-    { for (size_t i=0; i<priv.learn_allowed_actions.size(); i++)
-      { priv.learn_losses.cs.costs[i].class_index = priv.learn_allowed_actions[i];
-      }
-    }
+    roll_out_actions(sch, priv.ec_seq, priv.timesteps[tid]);
     //float min_loss = 0.;
     //if (priv.metatask)
     //  for (size_t aid=0; aid<priv.memo_foreach_action[tid]->size(); aid++)
     //    min_loss = MIN(min_loss, priv.memo_foreach_action[tid]->get(aid).cost);
-    generate_training_example(priv, priv.learn_losses, 1., true); // , min_loss);  // TODO: weight
-    if (! priv.examples_dont_change)
-      for (size_t n=0; n<priv.learn_ec_copy.size(); n++)
-      { if (sch.priv->is_ldf) CS::cs_label.delete_label(&priv.learn_ec_copy[n].l.cs);
-        else                  MC::mc_label.delete_label(&priv.learn_ec_copy[n].l.multi);
-      }
-    if (priv.cb_learner) priv.learn_losses.cb.costs.erase();
-    else                 priv.learn_losses.cs.costs.erase();
+    learn_from_rollouts(priv);
   }
 }
 
@@ -1909,10 +2327,9 @@ void search_initialize(vw* all, search& sch)
 
   priv.acset.feature_value = 1.;
 
-  scored_action sa((action)-1,0.);
-  new (&priv.cache_hash_map) v_hashmap<unsigned char*, scored_action>();
-  priv.cache_hash_map.set_default_value(sa);
-  priv.cache_hash_map.set_equivalent(cached_item_equivalent);
+  new (&priv.cache.entries) vector<cache_entry>();
+  priv.cache.max_entries = 1 << 16;
+  clear_cache(priv.cache);
 
   sch.task_data = nullptr;
 
@@ -1932,12 +2349,14 @@ void search_finish(search& sch)
 { search_private& priv = *sch.priv;
   cdbg << "search_finish" << endl;
 
-  clear_cache_hash_map(priv);
+  if (!priv.all->quiet && (priv.total_cache_lookups > 0))
+    fprintf(stderr, "search cache hits = %lu of %lu lookups (%.1f%%), %lu evicted\n", (unsigned long)priv.total_cache_hits,
+            (unsigned long)priv.total_cache_lookups, 100. * priv.total_cache_hits / priv.total_cache_lookups, (unsigned long)priv.total_cache_evictions);
 
   delete priv.truth_string;
   delete priv.pred_string;
   delete priv.bad_string_stream;
-  priv.cache_hash_map.~v_hashmap<unsigned char*, scored_action>();
+  delete_cache(priv.cache);
   priv.rawOutputString.~string();
   priv.ec_seq.~vector<example*>();
   priv.test_action_sequence.~vector<action>();
@@ -1987,6 +2406,19 @@ void search_finish(search& sch)
   priv.learn_condition_on.delete_v();
   priv.learn_condition_on_act.delete_v();
 
+  PARALLEL::stop(priv.rollout_pool);
+  for (search* w : priv.rollout_workers)
+  { search_finish(*w);
+    free(w);
+  }
+  priv.rollout_workers.delete_v();
+  for (rollout_capture& c : priv.rollout_captures)
+    delete_capture(priv, c);
+  priv.rollout_captures.delete_v();
+  for (example& ec : priv.ec_seq_copy)
+    VW::dealloc_example(priv.all->p->lp.delete_label, ec);
+  priv.ec_seq_copy.delete_v();
+
   if (priv.task->finish) priv.task->finish(sch);
   if (priv.metatask && priv.metatask->finish) priv.metatask->finish(sch);
 
@@ -2140,9 +2572,11 @@ base_learner* setup(vw&all)
   ("search_history_length",    po::value<size_t>(), "some tasks allow you to specify how much history their depend on; specify that here [def: 1]")
 
   ("search_no_caching",                             "turn off the built-in caching ability (makes things slower, but technically more safe)")
+  ("search_cache_size",        po::value<size_t>(), "remember at most this many predictions per example, forgetting the least recently used (def: 65536; 0 turns caching off)")
   ("search_xv",                                     "train two separate policies, alternating prediction/learning")
   ("search_perturb_oracle",    po::value<float>(),  "perturb the oracle on rollin with this probability (def: 0)")
   ("search_linear_ordering",                        "insist on generating examples in linear order (def: hoopla permutation)")
+  ("search_rollout_threads",   po::value<size_t>(), "roll out the timesteps of an example on this many threads, all against the weights it starts with, and learn from them afterwards")
   ;
   add_options(all);
   po::variables_map& vm = all.vm;
@@ -2187,7 +2621,10 @@ base_learner* setup(vw&all)
 
   if (vm.count("search_subsample_time"))          priv.subsample_timesteps  = vm["search_subsample_time"].as<float>();
   if (vm.count("search_no_caching"))              priv.no_caching           = true;
+  if (vm.count("search_cache_size"))              priv.cache.max_entries    = min(vm["search_cache_size"].as<size_t>(), (size_t)no_entry);
+  if (priv.cache.max_entries == 0)                priv.no_caching           = true;
   if (vm.count("search_rollout_num_steps"))       priv.rollout_num_steps    = vm["search_rollout_num_steps"].as<size_t>();
+  if (vm.count("search_rollout_threads"))         priv.rollout_threads      = max(vm["search_rollout_threads"].as<size_t>(), (size_t)1);
 
   priv.A = vm["search"].as<size_t>();
 
@@ -2336,6 +2773,21 @@ base_learner* setup(vw&all)
 
   if (vm.count("search_allowed_transitions"))     read_allowed_transitions((action)priv.A, vm["search_allowed_transitions"].as<string>().c_str());
 
+  if (priv.rollout_threads > 0)
+  { // rollout threads predict through the learners below search at once; these keep no state between predictions
+    for (base_learner* (*setup)(vw&) : all.enabled_reductions)
+      if (setup != GD::setup && setup != scorer_setup && setup != csoaa_setup)
+        THROW("--search_rollout_threads supports --csoaa over the gd learner only");
+    if (priv.is_ldf || priv.cb_learner)
+      THROW("--search_rollout_threads does not support ldf tasks or --cb");
+    if (priv.metatask)
+      THROW("--search_rollout_threads does not support --search_metatask");
+    if (priv.task && ! priv.task->copy)
+      THROW("--search_rollout_threads is not supported by --search_task " << task_string);
+    if (all.audit)
+      THROW("--search_rollout_threads does not support --audit");
+  }
+
   // set up auto-history (used to only do this if AUTO_CONDITION_FEATURES was on, but that doesn't work for hooktask)
   handle_condition_options(all, priv.acset);
 
@@ -202,6 +202,11 @@ struct search_task
   void (*finish)(search&);
   void (*run_setup)(search&, std::vector<example*>&);
   void (*run_takedown)(search&, std::vector<example*>&);
+
+  // optional: bring the task data of a --search_rollout_threads thread (to, whose task data
+  // starts out nullptr and is freed by finish) up to date with that of the learner (from),
+  // after run_setup; tasks without it do not support rollout threads
+  void (*copy)(search& from, search& to);
 };
 
 struct search_metatask
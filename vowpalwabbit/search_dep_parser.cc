@@ -17,7 +17,7 @@ using namespace std;
 #define arc_eager 2
 
 
-namespace DepParserTask         {  Search::search_task task = { "dep_parser", run, initialize, finish, setup, nullptr};  }
+namespace DepParserTask         {  Search::search_task task = { "dep_parser", run, initialize, finish, setup, nullptr, copy};  }
 
 struct task_data
 { example *ex;
@@ -43,6 +43,16 @@ const action REDUCE_LEFT  = 3;
 const action REDUCE       = 4;
 const uint32_t my_null = 9999999; /*representing_defalut*/
 
+// the example run fills with the features of a parser state
+example* new_feature_example()
+{ example* ex = VW::alloc_examples(sizeof(polylabel), 1);
+  ex->indices.push_back(val_namespace);
+  for(size_t i=1; i<14; i++)
+    ex->indices.push_back((unsigned char)i+'A');
+  ex->indices.push_back(constant_namespace);
+  return ex;
+}
+
 void initialize(Search::search& sch, size_t& /*num_actions*/, po::variables_map& vm)
 { vw& all = sch.get_vw_pointer_unsafe();
   task_data *data = new task_data();
@@ -72,11 +82,7 @@ void initialize(Search::search& sch, size_t& /*num_actions*/, po::variables_map&
   check_option<uint32_t>(data->transition_system, all, vm, "transition_system", false, uint32_equal,
                          "warning: you specified a different value for --transition_system than the one loaded from regressor. proceeding with loaded value: ", "");
 
-  data->ex = VW::alloc_examples(sizeof(polylabel), 1);
-  data->ex->indices.push_back(val_namespace);
-  for(size_t i=1; i<14; i++)
-    data->ex->indices.push_back((unsigned char)i+'A');
-  data->ex->indices.push_back(constant_namespace);
+  data->ex = new_feature_example();
 
   data->old_style_labels = vm.count("old_style_labels") > 0;
   if(data->one_learner)
@@ -126,6 +132,30 @@ void finish(Search::search& sch)
   delete data;
 }
 
+void copy(Search::search& from, Search::search& to)
+{ task_data *data = from.get_task_data<task_data>();
+  task_data *mine = to.get_task_data<task_data>();
+  if (mine == nullptr)
+  { mine = new task_data();
+    mine->action_loss.resize(5);
+    mine->ex = new_feature_example();
+    to.set_task_data<task_data>(mine);
+  }
+  mine->root_label = data->root_label;
+  mine->num_label = data->num_label;
+  mine->old_style_labels = data->old_style_labels;
+  mine->cost_to_go = data->cost_to_go;
+  mine->one_learner = data->one_learner;
+  mine->transition_system = data->transition_system;
+  // what setup made of the sentence; run fills in heads, tags and children
+  copy_array(mine->gold_heads, data->gold_heads);
+  copy_array(mine->gold_tags, data->gold_tags);
+  mine->heads.resize(data->heads.end_array - data->heads.begin());
+  mine->tags.resize(data->tags.end_array - data->tags.begin());
+  for (size_t i=0; i<6; i++)
+    mine->children[i].resize(data->children[i].end_array - data->children[i].begin());
+}
+
 void inline add_feature(example& ex, uint64_t idx, unsigned char ns, uint64_t mask, uint64_t multiplier, bool audit=false)
 {
   ex.feature_space[(int)ns].push_back(1.0f, (idx * multiplier) & mask);
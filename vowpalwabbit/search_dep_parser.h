@@ -12,5 +12,6 @@ void initialize(Search::search&, size_t&, po::variables_map&);
 void finish(Search::search&);
  void run(Search::search&, std::vector<example*>&);
  void setup(Search::search&, std::vector<example*>&);
+void copy(Search::search&, Search::search&);
 extern Search::search_task task;
 }
@@ -6,7 +6,7 @@
 #include "search_multiclasstask.h"
 using namespace std;
 
-namespace MulticlassTask { Search::search_task task = { "multiclasstask", run, initialize, finish, nullptr, nullptr };  }
+namespace MulticlassTask { Search::search_task task = { "multiclasstask", run, initialize, finish, nullptr, nullptr, copy };  }
 
 namespace MulticlassTask
 {
@@ -34,6 +34,16 @@ void finish(Search::search& sch)
   delete my_task_data;
 }
 
+void copy(Search::search& from, Search::search& to)
+{ task_data* my_task_data = from.get_task_data<task_data>();
+  if (to.get_task_data<task_data>() == nullptr)
+    to.set_task_data(new task_data());
+  task_data* copy_data = to.get_task_data<task_data>();
+  copy_data->max_label = my_task_data->max_label;
+  copy_data->num_level = my_task_data->num_level;
+  copy_array(copy_data->y_allowed, my_task_data->y_allowed);
+}
+
 void run(Search::search& sch, vector<example*>& ec)
 { task_data * my_task_data = sch.get_task_data<task_data>();
   size_t gold_label = ec[0]->l.multi.label;
@@ -8,10 +8,10 @@ license as described in the file LICENSE.
 
 using namespace std;
 
-namespace SequenceTask         { Search::search_task task = { "sequence",          run, initialize, nullptr,   nullptr,  nullptr     }; }
-namespace SequenceSpanTask     { Search::search_task task = { "sequencespan",      run, initialize, finish, setup, takedown }; }
-namespace SequenceTaskCostToGo { Search::search_task task = { "sequence_ctg",      run, initialize, nullptr,   nullptr,  nullptr     }; }
-namespace ArgmaxTask           { Search::search_task task = { "argmax",            run, initialize, finish,   nullptr,  nullptr     }; }
+namespace SequenceTask         { Search::search_task task = { "sequence",          run, initialize, nullptr,   nullptr,  nullptr,   copy }; }
+namespace SequenceSpanTask     { Search::search_task task = { "sequencespan",      run, initialize, finish, setup, takedown,     copy }; }
+namespace SequenceTaskCostToGo { Search::search_task task = { "sequence_ctg",      run, initialize, nullptr,   nullptr,  nullptr,   copy }; }
+namespace ArgmaxTask           { Search::search_task task = { "argmax",            run, initialize, finish,   nullptr,  nullptr,   copy }; }
 namespace SequenceTask_DemoLDF { Search::search_task task = { "sequence_demoldf",  run, initialize, finish, nullptr,  nullptr     }; }
 
 namespace SequenceTask
@@ -23,6 +23,8 @@ void initialize(Search::search& sch, size_t& /*num_actions*/, po::variables_map&
                    0);
 }
 
+void copy(Search::search& /*from*/, Search::search& /*to*/) {} // no task data
+
   void run(Search::search& sch, vector<example*>& ec)
 { Search::predictor P(sch, (ptag)0);
   for (size_t i=0; i<ec.size(); i++)
@@ -148,6 +150,17 @@ void finish(Search::search& sch)
   delete D;
 }
 
+void copy(Search::search& from, Search::search& to)
+{ task_data& D = *from.get_task_data<task_data>();
+  if (to.get_task_data<task_data>() == nullptr)
+    to.set_task_data<task_data>(new task_data());
+  task_data& mine = *to.get_task_data<task_data>();
+  mine.encoding = D.encoding;
+  mine.multipass = D.multipass;
+  copy_array(mine.allowed_actions, D.allowed_actions); // run overwrites its last action
+  copy_array(mine.only_two_allowed, D.only_two_allowed);
+}
+
 void setup(Search::search& sch, vector<example*>& ec)
 { task_data& D = *sch.get_task_data<task_data>();
   if (D.encoding == BILOU)
@@ -221,6 +234,8 @@ void initialize(Search::search& sch, size_t& num_actions, po::variables_map& /*v
   sch.set_task_data<size_t>(&num_actions);
 }
 
+void copy(Search::search& from, Search::search& to) { to.set_task_data<size_t>(from.get_task_data<size_t>()); }
+
 void run(Search::search& sch, vector<example*>& ec)
 { size_t K = * sch.get_task_data<size_t>();
   float*costs = calloc_or_throw<float>(K);
@@ -276,6 +291,12 @@ void finish(Search::search& sch)
   delete D;
 }
 
+void copy(Search::search& from, Search::search& to)
+{ if (to.get_task_data<task_data>() == nullptr)
+    to.set_task_data<task_data>(new task_data());
+  *to.get_task_data<task_data>() = *from.get_task_data<task_data>();
+}
+
 void run(Search::search& sch, vector<example*>& ec)
 { task_data& D = *sch.get_task_data<task_data>();
   uint32_t max_prediction = 1;
@@ -10,6 +10,7 @@ namespace SequenceTask
 {
 void initialize(Search::search&, size_t&, po::variables_map&);
  void run(Search::search&, std::vector<example*>&);
+void copy(Search::search&, Search::search&);
 extern Search::search_task task;
 }
 
@@ -20,6 +21,7 @@ void finish(Search::search&);
  void run(Search::search&, std::vector<example*>&);
  void setup(Search::search&, std::vector<example*>&);
  void takedown(Search::search&, std::vector<example*>&);
+void copy(Search::search&, Search::search&);
 extern Search::search_task task;
 }
 
@@ -27,6 +29,7 @@ namespace SequenceTaskCostToGo
 {
 void initialize(Search::search&, size_t&, po::variables_map&);
  void run(Search::search&, std::vector<example*>&);
+void copy(Search::search&, Search::search&);
 extern Search::search_task task;
 }
 
@@ -35,6 +38,7 @@ namespace ArgmaxTask
 void initialize(Search::search&, size_t&, po::variables_map&);
  void run(Search::search&, std::vector<example*>&);
 void finish(Search::search&);
+void copy(Search::search&, Search::search&);
 extern Search::search_task task;
 }
 
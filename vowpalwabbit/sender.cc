@@ -1,4 +1,5 @@
 #include <vector>
+#include <chrono>
 #ifdef _WIN32
 #include <WinSock2.h>
 #ifndef SHUT_RD
@@ -14,26 +15,157 @@
 #endif
 #else
 #include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <unistd.h>
 #endif
+#include <errno.h>
+#include <string.h>
 #include "io_buf.h"
 #include "cache.h"
 #include "network.h"
 #include "reductions.h"
+#include "example_ring.h"
+#include "vw_exception.h"
 
 using namespace std;
-struct sender
-{ io_buf* buf;
+
+/* --sendto sends the examples, in the cache format, to one or more daemons and reads
+** their predictions back.  An example goes to the host with the fewest examples out,
+** and sits in that host's buffer until --sendto_batch examples are there, or the
+** sender has to wait for a prediction.  Each host has a thread that reads its
+** predictions as they come, so the sender only stops when half the ring is out; the
+** examples are finished in the order they were read.
+*/
+
+struct sender;
+
+struct prediction // as written by binary_print_result
+{ float p;
+  float weight;
+};
+
+struct host
+{ char* name;
   int sd;
+  io_buf* buf;
+  size_t unflushed; // examples in buf
+  example** pending; // sent, by number % ring_size
+  uint64_t sent;
+  uint64_t received; // by the receiving thread
+  bool failed; // by the receiving thread
+  bool receiving;
+  sender* s;
+#ifndef _WIN32
+  pthread_t thread;
+#else
+  HANDLE thread;
+#endif
+};
+
+struct sent_example
+{ example* ec;
+  host* h;
+  uint64_t number; // of ec among those sent to h
+};
+
+struct sender
+{ host* hosts;
+  size_t host_count;
+  size_t batch;
   vw* all;//loss ring_size others
-  example** delay_ring;
+  sent_example* delay_ring;
   size_t sent_index;
   size_t received_index;
+
+  MUTEX lock; // the sender waits on prediction_back for predictions
+  CV prediction_back;
+  uint64_t parked;
+  bool closing;
+
+  bool started;
+  chrono::steady_clock::time_point start;
 };
 
-void open_sockets(sender& s, string host)
-{ s.sd = open_socket(host.c_str());
-  s.buf = new io_buf();
-  s.buf->files.push_back(s.sd);
+#ifdef _WIN32
+DWORD WINAPI receive_predictions(LPVOID in)
+#else
+void* receive_predictions(void* in)
+#endif
+{ host& h = *(host*)in;
+  sender& s = *h.s;
+  size_t ring_size = s.all->p->ring_size;
+  prediction predictions[512];
+  size_t bytes = 0;
+  while (true)
+  {
+#ifdef _WIN32
+    int r = recv(h.sd, (char*)predictions + bytes, (int)(sizeof(predictions) - bytes), 0);
+#else
+    ssize_t r = read(h.sd, (char*)predictions + bytes, sizeof(predictions) - bytes);
+    if (r < 0 && errno == EINTR)
+      continue;
+#endif
+    uint64_t received = h.received;
+    if (r <= 0)
+    { if (received != RING::load(&h.sent) && !RING::load(&s.closing))
+      { cerr << "sendto: lost " << h.name << (r < 0 ? ": " : "") << (r < 0 ? strerror(errno) : "") << endl;
+        RING::store(&h.failed, true);
+        RING::wake_parked(&s.lock, &s.prediction_back, &s.parked);
+      }
+      break;
+    }
+#ifdef TCP_QUICKACK
+    // a daemon writes each prediction by itself, and holds back the next small write
+    // until this one is acknowledged; the sender may have nothing to send it meanwhile
+    int one = 1;
+    setsockopt(h.sd, IPPROTO_TCP, TCP_QUICKACK, &one, sizeof(one));
+#endif
+    bytes += r;
+    size_t count = bytes / sizeof(prediction);
+    RING::load(&h.sent); // the pending examples of these predictions were stored before it
+    for (size_t i = 0; i < count; i++)
+      h.pending[(received + i) % ring_size]->pred.scalar = predictions[i].p;
+    RING::store(&h.received, received + count);
+    RING::wake_parked(&s.lock, &s.prediction_back, &s.parked);
+
+    bytes -= count * sizeof(prediction);
+    memmove(predictions, (char*)predictions + count * sizeof(prediction), bytes);
+  }
+  return 0;
+}
+
+void open_sockets(sender& s, string hosts)
+{ vector<string> names;
+  for (size_t begin = 0, end; begin <= hosts.size(); begin = end + 1)
+  { end = hosts.find(',', begin);
+    if (end == string::npos)
+      end = hosts.size();
+    if (end > begin)
+      names.push_back(hosts.substr(begin, end - begin));
+  }
+  if (names.empty())
+    THROW("--sendto needs a host");
+
+  s.host_count = names.size();
+  s.hosts = calloc_or_throw<host>(s.host_count);
+  for (size_t i = 0; i < s.host_count; i++)
+  { host& h = s.hosts[i];
+    h.name = calloc_or_throw<char>(names[i].size() + 1);
+    memcpy(h.name, names[i].c_str(), names[i].size());
+    h.sd = open_socket(h.name);
+    h.buf = new io_buf();
+    h.buf->files.push_back(h.sd);
+    h.pending = calloc_or_throw<example*>(s.all->p->ring_size);
+    h.s = &s;
+    h.receiving = true;
+#ifndef _WIN32
+    pthread_create(&h.thread, nullptr, receive_predictions, &h);
+#else
+    h.thread = ::CreateThread(nullptr, 0, static_cast<LPTHREAD_START_ROUTINE>(receive_predictions), &h, 0L, nullptr);
+#endif
+  }
 }
 
 void send_features(io_buf *b, example& ec, uint32_t mask)
@@ -45,15 +177,29 @@ void send_features(io_buf *b, example& ec, uint32_t mask)
       continue;
     output_features(*b, ns, ec.feature_space[ns], mask);
   }
-  b->flush();
 }
 
-void receive_result(sender& s)
-{ float res, weight;
+void flush(host& h)
+{ if (h.unflushed > 0)
+  { h.buf->flush();
+    h.unflushed = 0;
+  }
+}
+
+bool head_received(sender& s)
+{ sent_example& head = s.delay_ring[s.received_index % s.all->p->ring_size];
+  return RING::load(&head.h->received) > head.number;
+}
+
+bool any_failed(sender& s)
+{ for (size_t i = 0; i < s.host_count; i++)
+    if (RING::load(&s.hosts[i].failed))
+      return true;
+  return false;
+}
 
-  get_prediction(s.sd,res,weight);
-  example& ec = *s.delay_ring[s.received_index++ % s.all->p->ring_size];
-  ec.pred.scalar = res;
+void receive_result(sender& s)
+{ example& ec = *s.delay_ring[s.received_index++ % s.all->p->ring_size].ec;
 
   label_data& ld = ec.l.simple;
   ec.loss = s.all->loss->getLoss(s.all->sd, ec.pred.scalar, ld.label) * ec.weight;
@@ -61,47 +207,135 @@ void receive_result(sender& s)
   return_simple_example(*(s.all), nullptr, ec);
 }
 
-void learn(sender& s, LEARNER::base_learner&, example& ec)
-{ if (s.received_index + s.all->p->ring_size / 2 - 1 == s.sent_index)
+// finish the examples whose predictions are back, waiting for the first if wait
+void receive_results(sender& s, bool wait)
+{ if (wait && s.received_index != s.sent_index && !head_received(s))
+  { for (size_t i = 0; i < s.host_count; i++)
+      flush(s.hosts[i]);
+    RING::spin_then_park([&]() { return head_received(s) || any_failed(s); }, &s.lock, &s.prediction_back, &s.parked);
+  }
+  if (any_failed(s))
+    THROW("sendto: a daemon closed its connection before sending all predictions");
+  while (s.received_index != s.sent_index && head_received(s))
     receive_result(s);
+}
 
+host& least_loaded(sender& s)
+{ host* best = &s.hosts[s.sent_index % s.host_count];
+  for (size_t i = 0; i < s.host_count; i++)
+  { host& h = s.hosts[i];
+    if (h.sent - RING::load(&h.received) < best->sent - RING::load(&best->received))
+      best = &h;
+  }
+  return *best;
+}
+
+void learn(sender& s, LEARNER::base_learner&, example& ec)
+{ if (!s.started)
+  { s.start = chrono::steady_clock::now();
+    s.started = true;
+  }
+  receive_results(s, s.received_index + s.all->p->ring_size / 2 - 1 == s.sent_index);
+
+  host& h = least_loaded(s);
   s.all->set_minmax(s.all->sd, ec.l.simple.label);
-  s.all->p->lp.cache_label(&ec.l, *s.buf);//send label information.
-  cache_tag(*s.buf, ec.tag);
-  send_features(s.buf,ec, (uint32_t)s.all->parse_mask);
-  s.delay_ring[s.sent_index++ % s.all->p->ring_size] = &ec;
+  s.all->p->lp.cache_label(&ec.l, *h.buf);//send label information.
+  cache_tag(*h.buf, ec.tag);
+  send_features(h.buf,ec, (uint32_t)s.all->parse_mask);
+
+  sent_example& e = s.delay_ring[s.sent_index++ % s.all->p->ring_size];
+  e.ec = &ec;
+  e.h = &h;
+  e.number = h.sent;
+  h.pending[h.sent % s.all->p->ring_size] = &ec;
+  RING::store(&h.sent, h.sent + 1);
+  if (++h.unflushed >= s.batch)
+    flush(h);
 }
 
 void finish_example(vw&, sender&, example&) {}
 
+void report_throughput(sender& s)
+{ double seconds = chrono::duration<double>(chrono::steady_clock::now() - s.start).count();
+  cerr << "sent " << s.sent_index << " examples to " << s.host_count << (s.host_count == 1 ? " host" : " hosts")
+       << " in " << seconds << " seconds";
+  if (seconds > 0.)
+    cerr << ", " << (size_t)(s.sent_index / seconds) << " examples per second";
+  cerr << endl;
+  if (s.host_count > 1)
+    for (size_t i = 0; i < s.host_count; i++)
+      cerr << "  " << s.hosts[i].name << ": " << s.hosts[i].sent << " examples" << endl;
+}
+
 void end_examples(sender& s)
-{ //close our outputs to signal finishing.
-  while (s.received_index != s.sent_index)
-    receive_result(s);
-  shutdown(s.buf->files[0],SHUT_WR);
+{ while (s.received_index != s.sent_index)
+    receive_results(s, true);
+  if (s.started && !s.all->quiet)
+    report_throughput(s);
+  //close our outputs to signal finishing, and stop the receiving threads.
+  for (size_t i = 0; i < s.host_count; i++)
+  { host& h = s.hosts[i];
+    shutdown(h.sd, SHUT_WR);
+    shutdown(h.sd, SHUT_RD);
+#ifndef _WIN32
+    pthread_join(h.thread, nullptr);
+#else
+    ::WaitForSingleObject(h.thread, INFINITE);
+    ::CloseHandle(h.thread);
+#endif
+    h.receiving = false;
+  }
 }
 
 void finish(sender& s)
-{ s.buf->files.delete_v();
-  s.buf->space.delete_v();
+{ for (size_t i = 0; i < s.host_count; i++)
+  { host& h = s.hosts[i];
+    if (h.receiving) // examples never ended; the thread goes with the socket
+    { RING::store(&s.closing, true);
+      shutdown(h.sd, SHUT_RDWR);
+#ifndef _WIN32
+      pthread_join(h.thread, nullptr);
+#else
+      ::WaitForSingleObject(h.thread, INFINITE);
+      ::CloseHandle(h.thread);
+#endif
+    }
+    h.buf->close_files();
+    h.buf->space.delete_v();
+    h.buf->files.delete_v();
+    delete h.buf;
+    free(h.pending);
+    free(h.name);
+  }
+  // no receiving thread is left to wake the sender
+  delete_mutex(&s.lock);
+  delete_condition_variable(&s.prediction_back);
+  free(s.hosts);
   free(s.delay_ring);
-  delete s.buf;
 }
 
 LEARNER::base_learner* sender_setup(vw& all)
-{ if (missing_option<string, true>(all, "sendto", "send examples to <host>"))
+{ if (missing_option<string, true>(all, "sendto", "send examples to <host>[,<host>...], each example to the one with the fewest outstanding"))
     return nullptr;
+  new_options(all, "Sender options")
+  ("sendto_batch", po::value<size_t>(), "examples sent in one write, at most (default 1)");
+  add_options(all);
 
   sender& s = calloc_or_throw<sender>();
-  s.sd = -1;
+  s.all = &all;
+  s.batch = 1;
+  if (all.vm.count("sendto_batch"))
+    s.batch = max(all.vm["sendto_batch"].as<size_t>(), (size_t)1);
+  s.delay_ring = calloc_or_throw<sent_example>(all.p->ring_size);
+  initialize_mutex(&s.lock);
+  initialize_condition_variable(&s.prediction_back);
   if (all.vm.count("sendto"))
-  { string host = all.vm["sendto"].as< string >();
-    open_sockets(s, host);
+  { string hosts = all.vm["sendto"].as< string >();
+    open_sockets(s, hosts);
+    // a full buffer for each host fits in the half of the ring that may be out
+    s.batch = min(s.batch, max((all.p->ring_size / 2 - 1) / s.host_count, (size_t)1));
   }
 
-  s.all = &all;
-  s.delay_ring = calloc_or_throw<example*>(all.p->ring_size);
-
   LEARNER::learner<sender>& l = init_learner(&s, learn, 1);
   l.set_finish(finish);
   l.set_finish_example(finish_example);
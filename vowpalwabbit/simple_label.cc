@@ -5,7 +5,7 @@
 
 #include "cache.h"
 #include "accumulate.h"
-#include "best_constant.h"
+#include "vw.h"
 
 using namespace std;
 
@@ -17,7 +17,6 @@ char* bufread_simple_label(shared_data*, label_data* ld, char* c)
   memcpy(&ld->initial, c, sizeof(ld->initial));
   c += sizeof(ld->initial);
 
-  count_label(ld->label);
   return c;
 }
 
@@ -89,7 +88,6 @@ void parse_simple_label(parser*, shared_data*, void* v, v_array<substring>& word
         print_substring(words[i]);
       cout << endl;
   }
-  count_label(ld->label);
 }
 
 label_parser simple_label = {default_simple_label, parse_simple_label,
@@ -106,15 +104,17 @@ void print_update(vw& all, example& ec)
   }
 }
 
-void output_and_account_example(vw& all, example& ec)
+void account_simple_example(shared_data& sd, example& ec)
 { label_data ld = ec.l.simple;
 
-  all.sd->update(ec.test_only, ec.loss, ec.weight, ec.num_features);
+  sd.update(ec.test_only, ec.loss, ec.weight, ec.num_features);
   if (ld.label != FLT_MAX && !ec.test_only)
-    all.sd->weighted_labels += ld.label * ec.weight;
-  all.sd->weighted_unlabeled_examples += ld.label == FLT_MAX ? ec.weight : 0;
+    sd.weighted_labels += ld.label * ec.weight;
+  sd.weighted_unlabeled_examples += ld.label == FLT_MAX ? ec.weight : 0;
+}
 
-  all.print(all.raw_prediction, ec.partial_prediction, -1, ec.tag);
+void output_simple_example(vw& all, example& ec)
+{ all.print(all.raw_prediction, ec.partial_prediction, -1, ec.tag);
   for (size_t i = 0; i<all.final_prediction_sink.size(); i++)
   { int f = (int)all.final_prediction_sink[i];
     if (all.lda > 0)
@@ -122,7 +122,11 @@ void output_and_account_example(vw& all, example& ec)
     else
       all.print(f, ec.pred.scalar, 0, ec.tag);
   }
+}
 
+void output_and_account_example(vw& all, example& ec)
+{ account_simple_example(*all.sd, ec);
+  output_simple_example(all, ec);
   print_update(all, ec);
 }
 
@@ -8,6 +8,7 @@ license as described in the file LICENSE.
 
 struct example;
 struct vw;
+struct shared_data;
 
 struct label_data
 { float label;
@@ -22,3 +23,6 @@ extern label_parser simple_label;
 bool summarize_holdout_set(vw& all, size_t& no_win_counter);
 void print_update(vw& all, example &ec);
 void output_and_account_example(vw& all, example& ec);
+// the two halves of output_and_account_example
+void account_simple_example(shared_data& sd, example& ec);
+void output_simple_example(vw& all, example& ec);
@@ -5,6 +5,7 @@ license as described in the file LICENSE.
 */
 
 #include "spanning_tree.h"
+#include "allreduce.h"
 #include "vw_exception.h"
 
 #include <string.h>
@@ -28,6 +29,7 @@ struct client
 struct partial
 { client* nodes;
   size_t filled;
+  bool ring;
 };
 
 static int socket_sort(const void* s1, const void* s2)
@@ -116,11 +118,15 @@ void SpanningTree::Start()
 }
 
 void SpanningTree::Stop()
-{ CLOSESOCK(sock);
+{
+#ifndef _WIN32
+  shutdown(sock, SHUT_RDWR); // close alone does not wake up accept() in Run
+#endif
+  CLOSESOCK(sock);
   m_stop = true;
 
   // wait for run to stop
-  if (m_future != nullptr)
+  if (m_future != nullptr && m_future->valid())
   { m_future->get();
   }
 }
@@ -179,8 +185,10 @@ void SpanningTree::Run()
            << "): node id read failed, exiting" << endl;
       exit(1);
     }
-    else cerr << dotted_quad << "(" << hostname << ':' << ntohs(port)
-                << "): node id=" << id << endl;
+    bool ring = (id & span_ring_request) != 0;
+    id &= ~span_ring_request;
+    cerr << dotted_quad << "(" << hostname << ':' << ntohs(port)
+         << "): node id=" << id << (ring ? " (ring)" : "") << endl;
 
     int ok = true;
     if (id >= total)
@@ -195,6 +203,7 @@ void SpanningTree::Run()
       for (size_t i = 0; i < total; i++)
         partial_nodeset.nodes[i].client_ip = (uint32_t)-1;
       partial_nodeset.filled = 0;
+      partial_nodeset.ring = ring;
     }
     else
     { partial_nodeset = partial_nodesets[nonce];
@@ -203,6 +212,12 @@ void SpanningTree::Run()
 
     if (ok && partial_nodeset.nodes[id].client_ip != (uint32_t)-1)
       ok = false;
+    if (ok && partial_nodeset.ring != ring)
+    { cout << dotted_quad << "(" << hostname << ':' << ntohs(port)
+           << "): node " << id << " asked for a " << (ring ? "ring" : "tree")
+           << " but nonce " << nonce << " is a " << (ring ? "tree" : "ring") << " !" << endl;
+      ok = false;
+    }
     fail_send(f, &ok, sizeof(ok));
 
     if (ok)
@@ -228,8 +243,17 @@ void SpanningTree::Run()
       int* parent = (int*)calloc(total, sizeof(int));
       uint16_t* kid_count = (uint16_t*)calloc(total, sizeof(uint16_t));
 
-      int root = build_tree(parent, kid_count, total, 0);
-      parent[root] = -1;
+      if (partial_nodeset.ring)
+      { // each node connects to the next one, address order keeping the nodes of a host together
+        for (size_t i = 0; i < total; i++)
+        { parent[i] = total > 1 ? (int)((i + 1) % total) : -1;
+          kid_count[i] = total > 1 ? 1 : 0;
+        }
+      }
+      else
+      { int root = build_tree(parent, kid_count, total, 0);
+        parent[root] = -1;
+      }
 
       for (size_t i = 0; i < total; i++)
       { fail_send(partial_nodeset.nodes[i].socket, &kid_count[i], sizeof(kid_count[i]));
@@ -249,11 +273,13 @@ void SpanningTree::Run()
           fail_send(partial_nodeset.nodes[i].socket, &client_ports[parent[i]], sizeof(client_ports[parent[i]]));
         }
         else
-        { int bogus = -1;
+        { uint16_t bogus = -1;
           uint32_t bogus2 = -1;
           fail_send(partial_nodeset.nodes[i].socket, &bogus2, sizeof(bogus2));
           fail_send(partial_nodeset.nodes[i].socket, &bogus, sizeof(bogus));
         }
+        if (partial_nodeset.ring)
+          fail_send(partial_nodeset.nodes[i].socket, &i, sizeof(i));
         CLOSESOCK(partial_nodeset.nodes[i].socket);
       }
       free(client_ports);
@@ -0,0 +1,89 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#include <algorithm>
+#include <string.h>
+#include "sparse_weights.h"
+#include "memory.h"
+
+using namespace std;
+
+namespace
+{
+const uint32_t initial_bucket_bits = 16;
+const uint64_t chunk_blocks = 1 << 16;
+
+void allocate_table(sparse_weights& w, uint32_t bits)
+{ w.buckets = (uint64_t)1 << bits;
+  w.hash_shift = 64 - bits;
+  w.table = calloc_or_throw<sparse_weights::slot>(w.buckets);
+}
+
+// twice the buckets, each weight's slot found again
+void grow(sparse_weights& w)
+{ sparse_weights::slot* old = w.table;
+  uint64_t old_buckets = w.buckets;
+  allocate_table(w, 64 - w.hash_shift + 1);
+  for (uint64_t j = 0; j < old_buckets; j++)
+    if (old[j].key != 0)
+    { uint64_t i = w.bucket(old[j].key);
+      while (w.table[i].key != 0)
+        i = (i + 1) & (w.buckets - 1);
+      w.table[i] = old[j];
+    }
+  free(old);
+}
+}
+
+float* sparse_weights::add(uint64_t i, uint64_t key)
+{ if (4 * (used + 1) > 3 * buckets)
+  { grow(*this);
+    i = bucket(key);
+    while (table[i].key != 0)
+      i = (i + 1) & (buckets - 1);
+  }
+
+  size_t stride = (size_t)1 << stride_shift;
+  if (chunks.size() == 0 || chunk_used == chunk_blocks)
+  { chunks.push_back(calloc_or_throw<float>(chunk_blocks * stride));
+    chunk_used = 0;
+  }
+  float* block = chunks.last() + chunk_used++ * stride;
+  memcpy(block, initial, stride * sizeof(float));
+
+  table[i].key = key;
+  table[i].block = block;
+  used++;
+  return block;
+}
+
+vector<uint64_t> sparse_weights::weight_numbers() const
+{ vector<uint64_t> numbers;
+  numbers.reserve(used);
+  for (uint64_t i = 0; i < buckets; i++)
+    if (table[i].key != 0)
+      numbers.push_back(table[i].key - 1);
+  sort(numbers.begin(), numbers.end());
+  return numbers;
+}
+
+sparse_weights* new_sparse_weights(uint32_t stride_shift)
+{ sparse_weights* w = calloc_or_throw<sparse_weights>(1);
+  allocate_table(*w, initial_bucket_bits);
+  w->stride_shift = stride_shift;
+  w->stride_mask = ((uint64_t)1 << stride_shift) - 1;
+  w->initial = calloc_or_throw<float>((size_t)1 << stride_shift);
+  w->chunks = v_init<float*>();
+  return w;
+}
+
+void free_sparse_weights(sparse_weights* w)
+{ for (float* chunk : w->chunks)
+    free(chunk);
+  w->chunks.delete_v();
+  free(w->table);
+  free(w->initial);
+  free(w);
+}
@@ -0,0 +1,86 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include "v_array.h"
+
+/* With --sparse_weights the weights are kept in an open-addressing table rather
+** than an array of 1 << num_bits: a weight gets its 1 << stride_shift floats (its
+** stride block) the first time it is updated, so memory grows with the number of
+** distinct features seen, however large -b is.  Blocks are carved out of chunks
+** and never move, so a reference to a weight stays good while the table grows.
+** Weights never updated read as the initial block: initial_weight, and initial_t
+** in the adaptive float.
+*/
+struct sparse_weights
+{ struct slot
+  { uint64_t key; // weight number + 1, 0 for an empty slot
+    float* block;
+  };
+
+  slot* table;
+  uint64_t buckets; // a power of 2
+  uint32_t hash_shift; // 64 - log2(buckets)
+  uint64_t used;
+  uint32_t stride_shift;
+  uint64_t stride_mask;
+  float* initial; // the block a weight starts as
+  v_array<float*> chunks;
+  uint64_t chunk_used; // blocks handed out of the last chunk
+
+  uint64_t bucket(uint64_t key) const
+  { return (key * 0x9E3779B97F4A7C15ULL) >> hash_shift;
+  }
+
+  // float index & stride_mask of weight index >> stride_shift, given it if needed
+  float& operator[](uint64_t index)
+  { uint64_t key = (index >> stride_shift) + 1;
+    for (uint64_t i = bucket(key); ; i = (i + 1) & (buckets - 1))
+    { if (table[i].key == key)
+        return table[i].block[index & stride_mask];
+      if (table[i].key == 0)
+        return add(i, key)[index & stride_mask];
+    }
+  }
+
+  // the same float, of the initial block if the weight has none: not to be written
+  float& find(uint64_t index)
+  { uint64_t key = (index >> stride_shift) + 1;
+    for (uint64_t i = bucket(key); table[i].key != 0; i = (i + 1) & (buckets - 1))
+      if (table[i].key == key)
+        return table[i].block[index & stride_mask];
+    return initial[index & stride_mask];
+  }
+
+  // give weight key - 1 a block in the empty slot i
+  float* add(uint64_t i, uint64_t key);
+
+  // the numbers of the weights that have blocks, in order
+  std::vector<uint64_t> weight_numbers() const;
+};
+
+sparse_weights* new_sparse_weights(uint32_t stride_shift);
+void free_sparse_weights(sparse_weights* w);
+
+/* What foreach_feature reads and updates weights through: w[index] is the float of
+** index & mask, of the weight vector or of the table.
+*/
+struct dense_weights
+{ float* vector;
+  uint64_t mask;
+  float& operator[](uint64_t index) const { return vector[index & mask]; }
+};
+
+struct sparse_weights_view
+{ sparse_weights* table;
+  uint64_t mask;
+  bool add; // else weights without blocks read as the initial block, as when only predicting
+  float& operator[](uint64_t index) const
+  { return add ? (*table)[index & mask] : table->find(index & mask);
+  }
+};
@@ -606,6 +606,8 @@ void finish(stagewise_poly &poly)
 
   poly.synth_ec.feature_space[tree_atomics].delete_v();
   poly.synth_ec.indices.delete_v();
+  poly.synth_ec.interaction_state.delete_v();
+  poly.synth_ec.interaction_sums.delete_v();
   sort_data_destroy(poly);
   depthsbits_destroy(poly);
 }
@@ -40,11 +40,7 @@ void print_result(int f, priority_queue<scored_example, vector<scored_example>,
     }
     ss << '\n';
     ssize_t len = ss.str().size();
-#ifdef _WIN32
-    ssize_t t = _write(f, ss.str().c_str(), (unsigned int)len);
-#else
-    ssize_t t = write(f, ss.str().c_str(), (unsigned int)len);
-#endif
+    ssize_t t = io_buf::write_file_or_socket(f, ss.str().c_str(), (unsigned int)len);
     if (t != len)
       cerr << "write error: " << strerror(errno) << endl;
   }
@@ -200,6 +200,27 @@ public:
     }
   }
 
+  // same as get(), but leaves last_position alone so that concurrent readers are safe
+  V& lookup(K& key, uint64_t hash)
+  { size_t sz  = base_size();
+    size_t first_position = hash % sz;
+    size_t position = first_position;
+    while (true)
+    { if (!dat[position].occupied)
+        return default_value;
+
+      if ((dat[position].hash == hash) && is_equivalent(key, dat[position].key))
+        return dat[position].val;
+
+      position++;
+      if (position >= sz)
+        position = 0;
+
+      if (position == first_position)
+        THROW("error: v_hashmap did not grow enough!");
+    }
+  }
+
   bool contains(K& key, size_t hash)
   { size_t sz  = base_size();
     size_t first_position = hash % sz;
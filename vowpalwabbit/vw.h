@@ -18,6 +18,7 @@ license as described in the file LICENSE.
 #include "simple_label.h"
 #include "parser.h"
 #include "parse_example.h"
+#include "sparse_weights.h"
 
 namespace VW
 {
@@ -72,6 +73,25 @@ example* read_example(vw& all, char* example_line);
 example *alloc_examples(size_t, size_t);
 void dealloc_example(void(*delete_label)(void*), example&ec, void(*delete_prediction)(void*) = nullptr);
 
+/* Predicting many examples at once, as when scoring the candidates of a request.
+   The examples are allocated once with alloc_examples and refilled from their lines
+   by parse_example, which never goes through the parser's ring; predict_batch then
+   predicts them in order, fetching the weights of the examples ahead into the cache
+   while one is predicted.  Predictions are left in the examples, nothing is printed
+   or added to the statistics, and num_features leaves out the interactions.  Only for
+   learners predicting one example at a time (not the ldf/adf reductions).
+
+   By default each example is predicted in full, exactly as by all.l->predict.  With
+   share_common_terms the namespaces whose features are the same in every example
+   (e.g. the query's) are found, the sum of their linear terms and of the interactions
+   among them is computed once, and each example is predicted from its other terms
+   starting from that sum.  The sums are added in another order, so predictions may
+   differ from the unshared ones in the last bits.  Only for examples with simple
+   labels predicted by a linear model (gd, not nn, lrq, stagewise_poly or bfgs).
+ */
+void parse_example(vw& all, example* ec, char* example_line);
+void predict_batch(vw& all, example* examples, size_t count, bool share_common_terms = false);
+
  void parse_example_label(vw&all, example&ec, std::string label);
 void setup_example(vw& all, example* ae);
 example* new_unused_example(vw& all);
@@ -145,10 +165,17 @@ inline uint32_t hash_feature_cstr(vw& all, char* fstr, unsigned long u)
 }
 
 inline float get_weight(vw& all, uint32_t index, uint32_t offset)
-{ return all.reg.weight_vector[(((index << all.reg.stride_shift) + offset) & all.reg.weight_mask)];}
+{ uint64_t i = ((index << all.reg.stride_shift) + offset) & all.reg.weight_mask;
+  return all.reg.sparse != nullptr ? all.reg.sparse->find(i) : all.reg.weight_vector[i];
+}
 
 inline void set_weight(vw& all, uint32_t index, uint32_t offset, float value)
-{ all.reg.weight_vector[(((index << all.reg.stride_shift) + offset) & all.reg.weight_mask)] = value;}
+{ uint64_t i = ((index << all.reg.stride_shift) + offset) & all.reg.weight_mask;
+  if (all.reg.sparse != nullptr)
+    (*all.reg.sparse)[i] = value;
+  else
+    all.reg.weight_vector[i] = value;
+}
 
 inline uint32_t num_weights(vw& all)
 { return (uint32_t)all.length();}
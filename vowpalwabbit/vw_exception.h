@@ -41,6 +41,14 @@ public:
   int LineNumber() const;
 };
 
+// input that opens but cannot be decoded: unlike a missing input file it is not skipped
+class vw_codec_exception : public vw_exception
+{
+public:
+  vw_codec_exception(const char* file, int lineNumber, std::string message)
+    : vw_exception(file, lineNumber, message) {}
+};
+
 #ifdef _WIN32
 void vw_trace(const char* filename, int linenumber, const char* fmt, ...);
 
@@ -15,3 +15,4 @@ license as described in the file LICENSE.
 #define VERSION_FILE_WITH_HEADER_HASH "8.0.1" // first version with header hash used for validating model content
 #define VERSION_FILE_WITH_HEADER_CHAINED_HASH "8.0.2" // first version with header's chained hash used for more reliably validating model content
 #define VERSION_FILE_WITH_HEADER_ID "8.0.3" // first version with user supplied header
+#define VERSION_FILE_WITH_WEIGHT_BLOCKS "8.2.1" // first version whose binary regressors and online states may come in weight blocks
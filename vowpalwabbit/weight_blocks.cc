@@ -0,0 +1,242 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "weight_blocks.h"
+#include "sparse_weights.h"
+#include "io_buf.h"
+#include "parallel.h"
+
+using namespace std;
+using namespace PARALLEL;
+
+namespace
+{
+const uint64_t block_weights = 1 << 15; // offsets and lengths fit uint16_t
+const uint64_t segment_weights = 1 << 20; // encoded or decoded by a thread at once
+const size_t chunk_bytes = 1 << 16; // moved through the io_buf at once
+
+struct block_header
+{ uint64_t first;
+  uint32_t runs;
+  uint32_t weights;
+  uint32_t checksum;
+  uint32_t reserved;
+};
+
+struct run
+{ uint16_t offset;
+  uint16_t length; // - 1
+};
+
+size_t worker_count(uint64_t length)
+{ if (length < 2 * segment_weights)
+    return 1;
+  return max(1u, min(std::thread::hardware_concurrency(), 8u));
+}
+
+uint32_t checksum(const run* runs, uint32_t run_count, const float* values, size_t value_count)
+{ uint64_t h = uniform_hash(runs, run_count * sizeof(run), 0);
+  return (uint32_t)uniform_hash(values, value_count * sizeof(float), h);
+}
+
+void write_bytes(io_buf& model_file, const char* p, size_t n)
+{ for (size_t done = 0; done < n; done += chunk_bytes)
+    bin_write_fixed(model_file, p + done, min(n - done, chunk_bytes));
+}
+
+size_t read_bytes(io_buf& model_file, char* p, size_t n)
+{ size_t done = 0;
+  while (done < n)
+  { size_t got = bin_read_fixed(model_file, p + done, min(n - done, chunk_bytes), "");
+    if (got == 0)
+      break;
+    done += got;
+  }
+  return done;
+}
+
+// append the block starting at weight first, unless it has no runs
+void append_block(uint64_t first, const vector<run>& runs, const vector<float>& values, size_t floats, vector<char>& out)
+{ if (runs.empty())
+    return;
+  block_header h = { first, (uint32_t)runs.size(), (uint32_t)(values.size() / floats), 0, 0 };
+  h.checksum = checksum(runs.data(), h.runs, values.data(), values.size());
+  const char* parts[] = { (const char*)&h, (const char*)runs.data(), (const char*)values.data() };
+  size_t sizes[] = { sizeof(h), runs.size() * sizeof(run), values.size() * sizeof(float) };
+  for (size_t p = 0; p < 3; p++)
+    out.insert(out.end(), parts[p], parts[p] + sizes[p]);
+}
+
+// append the blocks of the weights [begin, end) to out
+void encode(const float* weights, uint64_t begin, uint64_t end, uint64_t stride, size_t floats, vector<char>& out)
+{ vector<run> runs;
+  vector<float> values;
+  for (uint64_t first = begin; first < end; first += block_weights)
+  { uint64_t last = min(first + block_weights, end);
+    runs.clear();
+    values.clear();
+    for (uint64_t i = first; i < last;)
+    { if (weights[i * stride] == 0.)
+      { i++;
+        continue;
+      }
+      uint64_t j = i + 1;
+      while (j < last && weights[j * stride] != 0.)
+        j++;
+      run r = { (uint16_t)(i - first), (uint16_t)(j - i - 1) };
+      runs.push_back(r);
+      for (; i < j; i++)
+        values.insert(values.end(), weights + i * stride, weights + i * stride + floats);
+    }
+    append_block(first, runs, values, floats, out);
+  }
+}
+
+// the same for the weights of a table, numbers being those that have blocks, written
+// to model_file as they are encoded
+void encode(sparse_weights& weights, const vector<uint64_t>& numbers, size_t floats, io_buf& model_file)
+{ vector<char> out;
+  vector<run> runs;
+  vector<float> values;
+  for (size_t k = 0; k < numbers.size();)
+  { uint64_t first = numbers[k] - numbers[k] % block_weights;
+    uint64_t previous = first; // the last weight in runs, if there are any
+    runs.clear();
+    values.clear();
+    for (; k < numbers.size() && numbers[k] < first + block_weights; k++)
+    { const float* w = &weights.find(numbers[k] << weights.stride_shift);
+      if (*w == 0.)
+        continue;
+      if (!runs.empty() && numbers[k] == previous + 1)
+        runs.back().length++;
+      else
+      { run r = { (uint16_t)(numbers[k] - first), 0 };
+        runs.push_back(r);
+      }
+      previous = numbers[k];
+      values.insert(values.end(), w, w + floats);
+    }
+    append_block(first, runs, values, floats, out);
+    if (out.size() >= chunk_bytes || k == numbers.size())
+    { write_bytes(model_file, out.data(), out.size());
+      out.clear();
+    }
+  }
+}
+
+// where decode puts the floats of weight i
+struct dense_target
+{ float* weights;
+  uint64_t stride;
+  float* operator()(uint64_t i) const { return weights + i * stride; }
+};
+
+struct sparse_target
+{ sparse_weights* weights;
+  float* operator()(uint64_t i) const { return &(*weights)[i << weights->stride_shift]; }
+};
+
+// copy a block into the weights; false if it is corrupted
+template<class T>
+bool decode(const block_header& h, const char* payload, const T& to, uint64_t length, size_t floats)
+{ const run* runs = (const run*)payload;
+  const float* values = (const float*)(payload + h.runs * sizeof(run));
+  if (checksum(runs, h.runs, values, (size_t)h.weights * floats) != h.checksum)
+    return false;
+  uint64_t copied = 0;
+  for (uint32_t r = 0; r < h.runs; r++)
+  { uint64_t i = h.first + runs[r].offset;
+    uint64_t n = (uint64_t)runs[r].length + 1;
+    if (runs[r].offset + n > block_weights || i + n > length || copied + n > h.weights)
+      return false;
+    for (uint64_t end = i + n; i < end; i++, values += floats)
+    { float* w = to(i);
+      for (size_t f = 0; f < floats; f++)
+        w[f] = values[f];
+    }
+    copied += n;
+  }
+  return copied == h.weights;
+}
+
+template<class T>
+void read_blocks(io_buf& model_file, const T& to, uint64_t length, size_t floats, size_t threads)
+{ vector<block_header> blocks;
+  vector<size_t> offsets; // of the blocks' runs in payload
+  vector<char> payload;
+  vector<char> corrupted(threads);
+  bool more = true;
+  while (more)
+  { // read about as many blocks as threads * segment_weights weights need
+    blocks.clear();
+    offsets.clear();
+    payload.clear();
+    while (more && payload.size() < threads * segment_weights * floats * sizeof(float))
+    { block_header h;
+      if (bin_read_fixed(model_file, (char*)&h, sizeof(h), "") < sizeof(h))
+        THROW("Model content is corrupted, the file ends within the weights");
+      if (h.runs == 0)
+      { more = false;
+        break;
+      }
+      if (h.first >= length || h.first % block_weights != 0 || h.runs > h.weights || h.weights > block_weights)
+        THROW("Model content is corrupted, bad block of weights at weight " << h.first);
+      size_t bytes = h.runs * sizeof(run) + (size_t)h.weights * floats * sizeof(float);
+      offsets.push_back(payload.size());
+      payload.resize(payload.size() + bytes);
+      if (read_bytes(model_file, payload.data() + offsets.back(), bytes) < bytes)
+        THROW("Model content is corrupted, the file ends within the weights");
+      blocks.push_back(h);
+    }
+
+    auto work = [&](size_t t)
+    { corrupted[t] = false;
+      for (size_t b = t; b < blocks.size(); b += threads)
+        if (!decode(blocks[b], payload.data() + offsets[b], to, length, floats))
+          corrupted[t] = true;
+    };
+    in_parallel(threads, work);
+    for (size_t t = 0; t < threads; t++)
+      if (corrupted[t])
+        THROW("Model content is corrupted, a block of weights does not match its checksum");
+  }
+}
+}
+
+void write_weight_blocks(io_buf& model_file, const float* weights, uint64_t length, uint64_t stride, size_t floats)
+{ size_t threads = worker_count(length);
+  vector<vector<char>> out(threads);
+  for (uint64_t begin = 0; begin < length; begin += threads * segment_weights)
+  { auto work = [&](size_t t)
+    { uint64_t b = min(begin + t * segment_weights, length);
+      out[t].clear();
+      encode(weights, b, min(b + segment_weights, length), stride, floats, out[t]);
+    };
+    in_parallel(threads, work);
+    for (vector<char>& o : out)
+      write_bytes(model_file, o.data(), o.size());
+  }
+  block_header end = { length, 0, 0, 0, 0 };
+  bin_write_fixed(model_file, (const char*)&end, sizeof(end));
+}
+
+void read_weight_blocks(io_buf& model_file, float* weights, uint64_t length, uint64_t stride, size_t floats)
+{ dense_target to = { weights, stride };
+  read_blocks(model_file, to, length, floats, worker_count(length));
+}
+
+void write_weight_blocks(io_buf& model_file, sparse_weights& weights, uint64_t length, size_t floats)
+{ encode(weights, weights.weight_numbers(), floats, model_file);
+  block_header end = { length, 0, 0, 0, 0 };
+  bin_write_fixed(model_file, (const char*)&end, sizeof(end));
+}
+
+void read_weight_blocks(io_buf& model_file, sparse_weights& weights, uint64_t length, size_t floats)
+{ sparse_target to = { &weights };
+  read_blocks(model_file, to, length, floats, 1); // blocks are given one at a time
+}
@@ -0,0 +1,32 @@
+/*
+Copyright (c) by respective owners including Yahoo!, Microsoft, and
+individual contributors. All rights reserved.  Released under a BSD (revised)
+license as described in the file LICENSE.
+ */
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+class io_buf;
+struct sparse_weights;
+
+/* Binary models hold their weights in blocks, encoded and decoded on several
+** threads.  A block covers up to 1 << 15 weights, starting at a multiple of that,
+** and is written only if one of them is nonzero:
+**   uint64_t first weight, uint32_t runs, uint32_t weights, uint32_t checksum,
+**   uint32_t reserved, runs * (uint16_t offset from first, uint16_t length - 1)
+**   of nonzero weights, weights * floats floats.
+** The checksum is a hash of the runs and the floats.  A block with no runs ends
+** the weights.
+*/
+
+// the weights i < length whose first float, weights[i * stride], is nonzero: floats
+// floats of each
+void write_weight_blocks(io_buf& model_file, const float* weights, uint64_t length, uint64_t stride, size_t floats);
+
+// read what write_weight_blocks wrote into weights, leaving the other weights alone
+void read_weight_blocks(io_buf& model_file, float* weights, uint64_t length, uint64_t stride, size_t floats);
+
+// the same for the weights of a --sparse_weights table, on this thread
+void write_weight_blocks(io_buf& model_file, sparse_weights& weights, uint64_t length, size_t floats);
+void read_weight_blocks(io_buf& model_file, sparse_weights& weights, uint64_t length, size_t floats);